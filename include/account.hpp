@@ -1,30 +1,81 @@
 #ifndef CLASS_ACCOUNT
 #define CLASS_ACCOUNT
 
-#include "sqlite3.h"
+#include <list>
+#include <string>
+#include <unordered_map>
 #include "client.hpp"
+#include "credentials.hpp"
+#include "flow.hpp"
+#include "storage.hpp"
 
 #define CREATE_TEST_ACCOUNT 1
+// accounts kept in the cache, least recently used written ones are dropped when full
+#define ACCOUNT_CACHE_SIZE 4096
+// seconds between writing the position of players that moved
+#define PLAYER_SAVE_INTERVAL 10
+// password attempts before the connection is closed
+#define LOGIN_PASSWORD_TRIES 3
+// milliseconds before another password attempt is taken
+#define LOGIN_RETRY_DELAY 1000
+
+// account in the cache, written_by is 0 once storage has it, -1 while it is
+// not handed over yet, otherwise the checkpoint that writes it
+struct CachedAccount
+{
+    AccountRecord record;
+    long long written_by;
+    std::list<std::string>::iterator lru;
+};
 
 class AccountManager
 {
 private:
     static bool m_Initialized;
-    AccountManager(sqlite3 *db);
+    AccountManager(Storage *storage);
     ~AccountManager();
 
-    // database reference
-    sqlite3 *m_DB;
+    // account writes may be queued by storage, the cache holds them until they are written
+    Storage *m_Storage;
+
+    // account rows by formatted name, names without an account are cached as well
+    // so repeated tries do not go to storage (network thread only)
+    std::unordered_map<std::string, CachedAccount> m_AccountCache;
+    std::list<std::string> m_AccountLRU;        // most recently used first
+    CachedAccount *findAccount(std::string username);
+    // drop least recently used account storage already has, false if all are waiting on a write
+    bool evictAccount();
+    // keep account until the checkpoint covering changes made now is written
+    void pinAccount(CachedAccount *account);
+
+    // player rooms waiting to be written, by formatted name
+    std::unordered_map<std::string, int> m_PendingSaves;
+
+    bool addAccount(std::string username, const std::string &stored);
+    bool setPassword(const std::string &username, const std::string &stored);
+    // false if already logged in elsewhere
+    bool completeLogin(Client *tclient, const std::string &username, int room_id);
 
 public:
 
-    int loginClient(Client *tclient, std::string username, std::string password);
+    // finished credential job handed back on the network thread, resumes the flow waiting on it
+    void credentialResult(const CredentialJob &tjob);
+    // stored password and room of account, false if not found
+    bool getAccount(std::string username, std::string *stored, int *room_id);
 
-    static int loginProcess(Client *tclient);
+    // login and account creation, run with startFlow
+    static Flow loginFlow(Client *tclient);
     static bool stringIsValidUsername(std::string str);
     static std::string formatUsername(std::string username);
 
+    // hashes on the calling thread, logins go through the credential pool instead
     bool createAccount(std::string username, std::string password);
+
+    // queue player position for the next flush (network thread only)
+    void queuePlayerSave(const std::string &username, int room_id);
+    bool hasPendingSaves() { return !m_PendingSaves.empty();}
+    // hand queued players to the checkpointer (or storage) as one write, returns number queued
+    int flushPlayerSaves();
     bool usernameTaken(std::string username);
     bool userLoggedIn(std::string username);
 
@@ -0,0 +1,87 @@
+#ifndef CLASS_CHECKPOINT
+#define CLASS_CHECKPOINT
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <SFML/System.hpp>
+#include "storage.hpp"
+#include "journal.hpp"
+
+// seconds between checkpoints of changed rooms and player positions
+#define CHECKPOINT_INTERVAL 10
+
+class ZoneManager;
+
+// writes world and player state to storage from its own thread
+// room states are copy on write, so a checkpoint only holds the room mutex long enough
+// to take the list of changed states, everything else happens while the game runs
+// with a journal, each checkpoint compacts the journal records it wrote to storage
+// once a write fails the journal is kept, the next start replays it
+class Checkpointer
+{
+private:
+    static bool m_Initialized;
+    Checkpointer(ZoneManager *zonemgr, Storage *storage, Journal *journal);
+    ~Checkpointer();
+
+    ZoneManager *m_ZoneManager;
+    Storage *m_Storage;
+    Journal *m_Journal;                 // NULL if not journaling
+
+    // player rooms handed over since the last checkpoint, by formatted name
+    sf::Mutex m_PlayerMutex;
+    std::unordered_map<std::string, int> m_PlayerRooms;
+
+    sf::Thread *m_Thread;
+    std::atomic<bool> m_Running;
+    sf::Clock m_Clock;
+    sf::Time m_LastCheckpoint;
+    std::atomic<long long> m_Requested;     // checkpoint wanted before the interval is up
+    std::atomic<long long> m_Completed;     // requests covered by finished checkpoints
+    // requests and completions are counted under the wake mutex, the thread waits on
+    // m_WakeUp for a request or the interval, flushes wait on m_Done
+    std::mutex m_WakeMutex;
+    std::condition_variable m_WakeUp;
+    std::condition_variable m_Done;
+    std::atomic<long long> m_Started;       // number of the last checkpoint started
+    std::atomic<long long> m_Written;       // number of the last checkpoint in storage
+    long long m_ConfirmedMark;              // storage write mark up to which every write went in
+    sf::Mutex m_CheckpointMutex;            // held while a checkpoint runs
+    void run();
+    void checkpoint();
+
+    // statistics
+    std::atomic<int> m_CheckpointCount;
+    std::atomic<long long> m_RoomCount;
+    std::atomic<long long> m_PlayerCount;
+    std::atomic<long long> m_TotalTime;     // microseconds
+    std::atomic<long long> m_MaxTime;       // microseconds
+    std::atomic<long long> m_TotalPause;    // microseconds the room mutex was held
+    std::atomic<long long> m_MaxPause;      // microseconds
+
+public:
+
+    void start();
+    // runs a last checkpoint before returning
+    void stop();
+    bool isRunning() { return m_Running;}
+
+    // checkpoint soon without waiting for it
+    void request();
+    // take player rooms for the next checkpoint, rooms is left empty
+    void addPlayerRooms(std::unordered_map<std::string, int> *rooms);
+    // wait until everything changed before the call is in storage
+    void flush();
+    // checkpoint that writes changes handed over now, done once isWritten says so
+    long long nextCheckpoint() { return m_Started + 1;}
+    bool isWritten(long long checkpoint) { return m_Written >= checkpoint;}
+
+    void printStats();
+
+    friend class Mud;
+};
+
+#endif // CLASS_CHECKPOINT
@@ -1,8 +1,12 @@
 #ifndef CLASS_CLIENT
 #define CLASS_CLIENT
 
+#include <atomic>
+#include <string>
+#include <vector>
 #include <SFML/Network.hpp>
 #include "command.hpp"
+#include "flow.hpp"
 
 #define CLIENT_RECEIVE_SIZE 100
 
@@ -13,13 +17,29 @@ class Client
 {
 private:
 
-    sf::TcpSocket *m_Socket;
-    bool m_Connected;
+    // fields used for every line in or out come first, login and reconnect state after
+    // an idle session in the world comes to a little over 400 bytes with its socket and mutexes
+    sf::TcpSocket *m_Socket;            // from the mud's socket pool
+    CommandList *m_CommandList;         // shared command set, owned by the command manager
+    sf::Mutex m_SendMutex;
+
+    // zone actor ownership, in game input runs on the zone the client is in
+    std::atomic<int> m_CurrentRoom;
+    std::atomic<int> m_Zone;            // zone name id, 0 if not in the world
+    std::atomic<int> m_PendingEvents;   // zone events and credential jobs still referring to client
+    int m_InputRead;                    // next line in m_InputQueue
+    sf::Mutex m_InputMutex;
+    std::vector<std::string> m_InputQueue;  // no allocation until the first line, capacity is kept
+
+    std::atomic<bool> m_Connected;
+    std::atomic<bool> m_Dirty;          // moved since position was last queued for saving
+    std::atomic<bool> m_Quit;           // left on purpose, session ends with the connection
+    bool m_Leaving;                     // waiting for zone or credential jobs to let go (network thread only)
+    // connection dropped while in the world, session is kept for reconnecting (network thread only)
+    bool m_LinkDead;
+    sf::Clock m_LinkDeadClock;
 
     std::string m_Username;
-    int m_CurrentRoom;
-
-    CommandList m_CommandList;
 
 public:
     Client(sf::TcpSocket *tsocket);
@@ -27,24 +47,29 @@ public:
 
     std::string getName() { return m_Username;}
     int getRoom() { return m_CurrentRoom;}
+    int getZone() { return m_Zone;}
     bool setRoom(int room_id);
 
     // client data storage
     std::string m_LastInput;                // last recieved input
-    std::vector<int> m_IntRegisters;        // storage utility
-    std::vector<std::string> m_StrRegisters;// storage utility
-    void clearStorage();                    // zero out storage utlities
+    FlowState m_Flow;                       // interactive flow client is in (network thread only)
 
     // connection status
     bool isConnected() { return m_Connected;}
+    bool isLinkDead() { return m_LinkDead;}
+    bool hasQuit() { return m_Quit;}
     void disconnect();
+    // disconnect and end the session without keeping it link-dead
+    void quit();
+    // take over socket of client, which is left with this client's old socket
+    void swapSocket(Client *tclient);
 
     // socket hand shaking
     bool addToSelector(sf::SocketSelector *tselector);
     bool isReady(sf::SocketSelector *tselector);
 
-    // receive data from the client, results are stored in m_LastInput
-    bool receive();
+    // receive data from the client, results are stored in m_LastInput (or input if given)
+    bool receive(std::string *input = NULL);
     bool parseCommand(std::string str);
 
     // send data to the client
@@ -56,6 +81,9 @@ public:
     int (*func)(Client *tclient);
 
     friend class AccountManager;
+    friend class CredentialPool;
+    friend class ZoneScheduler;
+    friend class Mud;
 
 };
 #endif // CLASS_CLIENT
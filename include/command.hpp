@@ -41,6 +41,12 @@ private:
     bool addNewCommand(std::string cmd, std::string help, int (*func)(Client *tclient, std::string cmd, std::string args));
     bool addAlias(std::string alias, std::string cmd, std::string args = "");
 
+    // command sets shared by every client that has them, read only once built
+    CommandList *m_PlayerCommands;
+
+    // move client to room and tell both rooms, messages follow the client's name
+    static bool moveClient(Client *tclient, int to_room, const std::string &leave_msg, const std::string &arrive_msg);
+
 public:
 
     bool isCommand(std::string cmd);
@@ -49,12 +55,18 @@ public:
     bool parseCommand(Client *tclient, CommandList *tlist, std::string str);
     bool addCommandToCommandList(std::string cmd, CommandList *cmdlist);
     bool showHelp(Client *tclient, CommandList *cmdlist, std::string str);
+    CommandList *getPlayerCommands() { return m_PlayerCommands;}
 
     // some general commands
     static int commandQuit(Client *tclient, std::string cmd, std::string args);
     static int commandLook(Client *tclient, std::string cmd, std::string args);
+    static int commandWho(Client *tclient, std::string cmd, std::string args);
     static int commandHelp(Client *tclient, std::string cmd, std::string args);
     static int commandMoveDirection(Client *tclient, std::string cmd, std::string args);
+    static int commandTravel(Client *tclient, std::string cmd, std::string args);
+    static int commandMap(Client *tclient, std::string cmd, std::string args);
+    static int commandDoor(Client *tclient, std::string cmd, std::string args);
+    static int commandEnter(Client *tclient, std::string cmd, std::string args);
 
     friend class Mud;
 };
@@ -0,0 +1,82 @@
+#ifndef CLASS_CREDENTIALS
+#define CLASS_CREDENTIALS
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+
+// password hashing is slow on purpose, it runs on its own threads so logins
+// do not hold up the network thread
+#define CREDENTIAL_WORKER_THREADS 2
+// jobs waiting or running, logins are turned away when full
+#define CREDENTIAL_QUEUE_SIZE 64
+// milliseconds the network thread waits for data while jobs are outstanding
+#define CREDENTIAL_POLL_TIME 5
+
+// forward dec
+class Client;
+
+enum CREDENTIAL_JOB_TYPE{CJ_VERIFY, CJ_CREATE};
+
+struct CredentialJob
+{
+    int type;
+    Client *client;             // client waiting on result
+    std::string username;
+    std::string password;       // plaintext from client, cleared by the worker
+    std::string stored;         // verify: stored password, create: new hash
+    int room;                   // verify: room to log into
+    bool done;                  // false if the job never ran
+    bool success;
+    bool rehashed;              // verify: stored was plaintext or old settings and now holds a new hash
+
+    CredentialJob()
+    {
+        type = CJ_VERIFY;
+        client = NULL;
+        room = 0;
+        done = false;
+        success = false;
+        rehashed = false;
+    }
+};
+
+class CredentialPool
+{
+private:
+    static bool m_Initialized;
+    CredentialPool();
+    ~CredentialPool();
+
+    // idle workers wait on m_JobReady
+    std::mutex m_JobMutex;
+    std::condition_variable m_JobReady;
+    std::deque<CredentialJob> m_Jobs;
+    sf::Mutex m_FinishedMutex;
+    std::vector<CredentialJob> m_Finished;
+    std::atomic<int> m_Outstanding;     // submitted and not yet taken back
+
+    std::vector<sf::Thread*> m_Workers;
+    std::atomic<bool> m_Running;
+    void run();
+
+public:
+
+    void start();
+    void stop();
+
+    // queue job, false if the pool is full
+    // jobs with a client count towards its pending events until taken back
+    bool submit(const CredentialJob &tjob);
+    // jobs finished since last call
+    void takeFinished(std::vector<CredentialJob> *jobs);
+    bool hasOutstanding() { return m_Outstanding != 0;}
+
+    friend class Mud;
+};
+
+#endif // CLASS_CREDENTIALS
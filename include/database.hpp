@@ -0,0 +1,182 @@
+#ifndef CLASS_DATABASE
+#define CLASS_DATABASE
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+#include "sqlite3.h"
+#include "statementcache.hpp"
+
+// writes are queued and committed by their own thread in groups, so a slow
+// commit (fsync) is never waited on by the network or zone threads
+// group is committed once it has this many writes
+#define DB_WRITE_GROUP_SIZE 256
+// or once its oldest write has waited this many milliseconds
+#define DB_WRITE_GROUP_TIME 50
+// read only connections kept open for readers off the network thread
+#define DB_READ_CONNECTIONS 2
+// milliseconds a connection waits on a lock held by another connection
+#define DB_BUSY_TIMEOUT 5000
+// seconds between online backups of the database, 0 for none
+#define DB_BACKUP_INTERVAL 3600
+// backup is written next to the database with this added to the name
+#define DB_BACKUP_SUFFIX ".backup"
+// pages copied each time the writer steps the backup, between write groups
+#define DB_BACKUP_PAGES 64
+
+// open database connection in WAL mode so readers and the writer do not block each other
+// returns NULL on error
+sqlite3 *openDatabase(const std::string &file, bool read_only = false);
+
+enum DB_VALUE_TYPE{DB_VALUE_NULL, DB_VALUE_INT, DB_VALUE_TEXT};
+
+struct DatabaseValue
+{
+    int type;
+    sf::Int64 number;
+    std::string text;
+
+    DatabaseValue()
+    {
+        type = DB_VALUE_NULL;
+        number = 0;
+    }
+};
+
+struct DatabaseStatement
+{
+    std::string sql;
+    std::vector<DatabaseValue> values;  // bound in order
+
+    void bind(sf::Int64 number);
+    void bind(const std::string &text);
+};
+
+// statements written together, all or nothing
+struct DatabaseWrite
+{
+    std::vector<DatabaseStatement> statements;
+    sf::Time queued;                    // set by the writer
+    long long number;                   // set by the writer, counts up from 1
+
+    DatabaseWrite()
+    {
+        number = 0;
+    }
+
+    // add statement, returned pointer is good until the next add
+    DatabaseStatement *add(const std::string &sql);
+    bool empty() { return statements.empty();}
+};
+
+class DatabaseWriter
+{
+private:
+    static bool m_Initialized;
+    DatabaseWriter(const std::string &file);
+    ~DatabaseWriter();
+
+    // writer connection (writer thread only once started)
+    sqlite3 *m_DB;
+    StatementCache *m_Statements;
+
+    // the writer waits on m_QueueReady for work, flushes wait on m_CommitDone
+    std::mutex m_QueueMutex;
+    std::condition_variable m_QueueReady;
+    std::condition_variable m_CommitDone;
+    std::deque<DatabaseWrite> m_Queue;
+    sf::Clock m_Clock;
+    std::atomic<long long> m_Submitted;
+    std::atomic<long long> m_Committed;     // written or failed, either way no longer waiting
+    std::atomic<long long> m_FlushTarget;   // commit without waiting for the group to fill up to here
+    std::atomic<long long> m_LastFailed;    // number of the newest write that failed
+
+    sf::Thread *m_Thread;
+    std::atomic<bool> m_Running;
+    sf::Mutex m_WriteMutex;             // held while a group is written
+    void run();
+    // wait until there may be something to do, expects queue mutex to be locked
+    void waitForWork(std::unique_lock<std::mutex> &lock);
+    void addCommitted(int count);
+    // returns number of writes that failed, the newest of them is kept in m_LastFailed
+    int commitGroup(std::vector<DatabaseWrite> *group);
+    bool runWrite(const DatabaseWrite &twrite);
+
+    // online backup, copied a few pages at a time by the writer thread from its own
+    // connection, so writes made meanwhile go into the copy instead of restarting it
+    std::string m_BackupFile;
+    sqlite3 *m_BackupDB;                // backup being written, to a temporary file until done
+    sqlite3_backup *m_Backup;
+    std::atomic<int> m_BackupPages;
+    std::atomic<bool> m_BackupRequested;
+    sf::Time m_LastBackup;
+    sf::Clock m_BackupClock;            // time since the backup was started
+    bool beginBackup();
+    void stepBackup();
+    void endBackup(bool done);
+
+    // statistics, written by whoever holds the write mutex
+    std::atomic<int> m_GroupCount;
+    std::atomic<long long> m_WriteCount;
+    std::atomic<int> m_ErrorCount;
+    std::atomic<long long> m_TotalCommitTime;   // microseconds
+    std::atomic<long long> m_MaxCommitTime;     // microseconds
+    std::atomic<int> m_BackupCount;
+    std::atomic<int> m_BackupErrorCount;
+    std::atomic<long long> m_BackupStepCount;
+    std::atomic<long long> m_MaxBackupStep;     // microseconds
+    std::atomic<long long> m_LastBackupTime;    // milliseconds start to finish
+    std::atomic<int> m_LastBackupPageCount;
+
+public:
+
+    bool isOpen() { return m_DB != NULL;}
+    void start();
+    // commits whatever is queued before returning
+    void stop();
+
+    // queue write, never waits on the database
+    void submit(const DatabaseWrite &twrite);
+    // wait until everything submitted so far is committed
+    void flush();
+    bool hasPending() { return m_Committed != m_Submitted;}
+    // number of the newest write submitted, a write that fails after it shows in failedSince
+    long long writeMark() { return m_Submitted;}
+    bool failedSince(long long mark) { return m_LastFailed > mark;}
+
+    // back up soon instead of waiting for the interval
+    void requestBackup();
+    void setBackupPages(int pages) { if(pages > 0) m_BackupPages = pages;}
+
+    void printStats();
+
+    friend class SqliteStorage;
+};
+
+// read only connections for threads other than the network thread
+class DatabaseReaders
+{
+private:
+    static bool m_Initialized;
+    DatabaseReaders(const std::string &file);
+    ~DatabaseReaders();
+
+    std::string m_File;
+    sf::Mutex m_Mutex;
+    std::vector<sqlite3*> m_Free;
+    std::vector<sqlite3*> m_Extra;      // opened because all connections were in use, closed on release
+
+public:
+
+    // get connection for this thread's use, NULL on error
+    sqlite3 *acquire();
+    void release(sqlite3 *db);
+
+    friend class SqliteStorage;
+};
+
+#endif // CLASS_DATABASE
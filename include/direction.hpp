@@ -4,19 +4,53 @@
 #include <string>
 #include <vector>
 
-// if adding or removing directions, update dir count
-#define DIR_COUNT 4
-static std::string dirs[DIR_COUNT][5] =
+// directions are fixed at compile time, rooms store exits by direction index
+// the database stores exits by direction name so the table can change without a schema change
+struct Direction
+{
+    const char *name;
+    const char *abbreviation;
+    int opposite;               // index of direction leading back
+    const char *leave_msg;
+    const char *arrive_msg;
+    int x, y, z;                // map offset of the room in this direction, y grows to the south
+};
+
+enum DIRECTION_INDEX{DIR_NORTH, DIR_SOUTH, DIR_EAST, DIR_WEST,
+                     DIR_NORTHEAST, DIR_NORTHWEST, DIR_SOUTHEAST, DIR_SOUTHWEST,
+                     DIR_UP, DIR_DOWN, DIR_COUNT};
+
+constexpr Direction dirs[DIR_COUNT] =
     {
-        {"north", "south", "left to the north", "entered from the north", "n"},
-        {"south", "north", "left to the south", "entered from the south", "s"},
-        {"east", "west", "left to the east", "entered from the east", "e"},
-        {"west", "east", "left to the west", "entered form the west", "w"}
+        {"north", "n", DIR_SOUTH, "left to the north", "entered from the north", 0, -1, 0},
+        {"south", "s", DIR_NORTH, "left to the south", "entered from the south", 0, 1, 0},
+        {"east", "e", DIR_WEST, "left to the east", "entered from the east", 1, 0, 0},
+        {"west", "w", DIR_EAST, "left to the west", "entered from the west", -1, 0, 0},
+        {"northeast", "ne", DIR_SOUTHWEST, "left to the northeast", "entered from the northeast", 1, -1, 0},
+        {"northwest", "nw", DIR_SOUTHEAST, "left to the northwest", "entered from the northwest", -1, -1, 0},
+        {"southeast", "se", DIR_NORTHWEST, "left to the southeast", "entered from the southeast", 1, 1, 0},
+        {"southwest", "sw", DIR_NORTHEAST, "left to the southwest", "entered from the southwest", -1, 1, 0},
+        {"up", "u", DIR_DOWN, "went up", "came up from below", 0, 0, 1},
+        {"down", "d", DIR_UP, "went down", "came down from above", 0, 0, -1}
     };
 
+// every direction must lead back the way it came
+constexpr bool directionsReversible(int i)
+{
+    return i >= DIR_COUNT || (dirs[dirs[i].opposite].opposite == i &&
+                              dirs[i].x == -dirs[dirs[i].opposite].x &&
+                              dirs[i].y == -dirs[dirs[i].opposite].y &&
+                              dirs[i].z == -dirs[dirs[i].opposite].z && directionsReversible(i + 1));
+}
+static_assert(directionsReversible(0), "direction table opposites do not match");
 
 std::vector<std::string> getDirections();
-int getDirectionIndex(std::string dir);
-std::string oppositeDirection(std::string dir);
+// direction index of name or abbreviation, -1 if not a direction
+int getDirectionIndex(const std::string &dir);
+std::string oppositeDirection(const std::string &dir);
+
+// read exits stored as text by older databases, "north=12 up=40", into exits[DIR_COUNT]
+// returns number of entries that could not be read
+int parseExits(const std::string &text, std::vector<int> *exits);
 
 #endif // CLASS_DIRECTION
@@ -0,0 +1,88 @@
+#ifndef CLASS_EPOCH
+#define CLASS_EPOCH
+
+#include <atomic>
+#include <cstddef>
+#include <vector>
+#include <SFML/System.hpp>
+
+// maximum number of threads that can read at the same time, one more aborts the server
+#define EPOCH_MAX_THREADS 64
+
+// epoch based reclamation
+// readers mark themselves active with enter/exit (or an EpochGuard) and never block,
+// writers unlink old data and retire it, retired data is freed by reclaim once
+// every reader that might still be looking at it has finished
+
+struct EpochSlot
+{
+    std::atomic<unsigned long long> epoch;  // epoch reader entered in, 0 if not reading
+    int depth;                              // nested enters, only touched by owning thread
+
+    EpochSlot()
+    {
+        epoch.store(0);
+        depth = 0;
+    }
+};
+
+struct RetiredItem
+{
+    void (*func)(void *owner, void *ptr);   // frees ptr
+    void *owner;
+    void *ptr;
+    unsigned long long epoch;               // epoch item was retired in
+};
+
+class EpochManager
+{
+private:
+
+    std::atomic<unsigned long long> m_Epoch;
+    EpochSlot m_Slots[EPOCH_MAX_THREADS];
+
+    sf::Mutex m_RetireMutex;
+    std::vector<RetiredItem> m_Retired;
+
+    static int getThreadSlot();
+
+    template <class T>
+    static void deleteObject(void *owner, void *ptr) { delete static_cast<T*>(ptr); }
+
+public:
+    EpochManager();
+    ~EpochManager();
+
+    // reader section, may be nested
+    void enter();
+    void exit();
+
+    // free ptr with func once no reader can still see it
+    void retire(void (*func)(void *owner, void *ptr), void *owner, void *ptr);
+    template <class T>
+    void retire(T *ptr) { retire(deleteObject<T>, NULL, ptr); }
+
+    // advance epoch and free what is safe to free, returns number of items freed
+    int reclaim();
+    int getPendingCount();
+};
+
+// reader section for the lifetime of the guard
+class EpochGuard
+{
+private:
+    EpochManager *m_Manager;
+
+public:
+    EpochGuard(EpochManager *manager)
+    {
+        m_Manager = manager;
+        m_Manager->enter();
+    }
+    ~EpochGuard()
+    {
+        m_Manager->exit();
+    }
+};
+
+#endif // CLASS_EPOCH
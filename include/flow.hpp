@@ -0,0 +1,119 @@
+#ifndef CLASS_FLOW
+#define CLASS_FLOW
+
+#include <coroutine>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include "credentials.hpp"
+
+// interactive flows (login, and anything else that asks the client questions) are
+// coroutines that co_await the next line of input, a timer or a credential check
+// instead of being written as state machines. flows run on the network thread.
+//
+//      Flow askName(Client *tclient)
+//      {
+//          tclient->send("Name?\n");
+//          std::string name = co_await flowInput(tclient);
+//          ...
+//      }
+//      startFlow(tclient, askName(tclient));
+
+// coroutine frames up to this size are recycled instead of going back to the heap
+#define FLOW_FRAME_SIZE 2048
+// free frames kept for reuse
+#define FLOW_FRAME_POOL_MAX 256
+
+// forward dec
+class Client;
+
+enum FLOW_WAIT{FLOW_WAIT_NONE, FLOW_WAIT_INPUT, FLOW_WAIT_TIMER, FLOW_WAIT_CREDENTIALS};
+
+// flow a client is in, kept on the client
+struct FlowState
+{
+    std::coroutine_handle<> handle;     // suspended flow, null if none
+    int wait;                           // what the flow is waiting for
+    std::string *input;                 // input: where the line goes
+    CredentialJob *job;                 // credentials: where the result goes
+
+    FlowState()
+    {
+        wait = FLOW_WAIT_NONE;
+        input = NULL;
+        job = NULL;
+    }
+};
+
+class Flow
+{
+public:
+    struct promise_type
+    {
+        Flow get_return_object() { return Flow(std::coroutine_handle<promise_type>::from_promise(*this));}
+        // flows start when handed to startFlow, and are destroyed by whoever resumed them last
+        std::suspend_always initial_suspend() { return std::suspend_always();}
+        std::suspend_always final_suspend() noexcept { return std::suspend_always();}
+        void return_void() {}
+        void unhandled_exception();
+
+        static void *operator new(std::size_t size);
+        static void operator delete(void *frame, std::size_t size);
+    };
+
+    explicit Flow(std::coroutine_handle<promise_type> handle) : m_Handle(handle) {}
+
+    std::coroutine_handle<promise_type> m_Handle;
+};
+
+// awaitables, only for use inside a flow running for tclient
+struct FlowInput
+{
+    Client *client;
+    std::string line;
+
+    bool await_ready() { return false;}
+    void await_suspend(std::coroutine_handle<> handle);
+    std::string await_resume() { return line;}
+};
+
+struct FlowSleep
+{
+    Client *client;
+    int milliseconds;
+
+    bool await_ready() { return milliseconds <= 0;}
+    void await_suspend(std::coroutine_handle<> handle);
+    void await_resume() {}
+};
+
+struct FlowCredentials
+{
+    Client *client;
+    CredentialJob job;
+
+    bool await_ready() { return false;}
+    // does not suspend if the pool is full, the job comes back with done false
+    bool await_suspend(std::coroutine_handle<> handle);
+    CredentialJob await_resume() { return job;}
+};
+
+// next line of input from client
+FlowInput flowInput(Client *tclient);
+// wait, resumed from the network loop so at most a loop iteration late
+FlowSleep flowSleep(Client *tclient, int milliseconds);
+// run job on the credential pool (job.client is set to tclient)
+FlowCredentials flowCredentials(Client *tclient, const CredentialJob &tjob);
+
+// replace any flow client is in and run it up to its first wait, not for use from inside a flow
+void startFlow(Client *tclient, Flow flow);
+// client function pointer for clients in a flow, hands input to the flow
+int runFlow(Client *tclient);
+// hand finished credential job to the flow waiting on it, false if none was
+bool resumeFlowCredentials(Client *tclient, const CredentialJob &tjob);
+// resume flows whose sleep is over, clients resumed are added to resumed
+void runFlowTimers(std::vector<Client*> *resumed);
+// destroy flow without resuming it (client is going away)
+void endFlow(Client *tclient);
+
+#endif // CLASS_FLOW
@@ -0,0 +1,73 @@
+#ifndef CLASS_JOURNAL
+#define CLASS_JOURNAL
+
+#include <atomic>
+#include <cstdio>
+#include <string>
+#include <vector>
+#include <SFML/System.hpp>
+#include "storage.hpp"
+
+// log changes to a journal file between checkpoints so a crash loses nothing
+// that made it to the journal, replayed into storage on the next start
+#define JOURNAL 1
+#define JOURNAL_FILE "mud.journal"
+// bytes buffered before records are handed to the OS, flush() hands them over sooner
+#define JOURNAL_BUFFER_SIZE 65536
+
+// record layout, integers in host byte order:
+//   sf::Uint32 payload size, sf::Uint8 type, payload, sf::Uint32 checksum of type and payload
+// strings in the payload are a sf::Uint32 length followed by the characters
+enum JOURNAL_RECORD{JOURNAL_ROOM = 1, JOURNAL_PLAYER_ROOM, JOURNAL_ACCOUNT, JOURNAL_PASSWORD};
+
+// append only journal, records go to the current file
+// a checkpoint moves the current file aside and deletes it once storage has everything in it
+class Journal
+{
+private:
+    static bool m_Initialized;
+    Journal(const std::string &file);
+    ~Journal();
+
+    std::string m_File;
+    FILE *m_FP;
+    sf::Mutex m_Mutex;
+    std::vector<char> m_Record;     // record being built, guarded by the mutex
+
+    void beginRecord(int type);
+    void putInt(sf::Int32 value);
+    void putString(const std::string &text);
+    void endRecord();
+
+    // statistics
+    std::atomic<long long> m_RecordCount;
+    std::atomic<long long> m_ByteCount;
+    std::atomic<int> m_CompactCount;
+
+public:
+
+    bool isOpen() { return m_FP != NULL;}
+
+    // room state after a change, replay keeps the last one of each room
+    void logRoom(const StoredRoom &troom);
+    void logPlayerRoom(const std::string &username, int room_id);
+    void logAccount(const std::string &username, const std::string &stored, int room_id);
+    void logPassword(const std::string &username, const std::string &stored);
+
+    // hand buffered records to the OS
+    void flush();
+    // start a new file, records so far are covered by the checkpoint being taken
+    bool rotate();
+    // checkpoint is in storage, drop the file rotate moved aside
+    void compact();
+
+    // replay journal files left by an earlier run into storage and remove them
+    // returns number of records replayed, -1 on error (files are kept)
+    static int recover(const std::string &file, Storage *storage);
+
+    void printStats();
+
+    friend class Mud;
+};
+
+#endif // CLASS_JOURNAL
@@ -0,0 +1,68 @@
+#ifndef CLASS_MEMORYSTORAGE
+#define CLASS_MEMORYSTORAGE
+
+#include <atomic>
+#include <map>
+#include "storage.hpp"
+
+// default microseconds every read or write is held up to stand in for a disk (0 = none), -memory-latency overrides
+// the wait is on the calling thread, like a synchronous database call
+#define STORAGE_MEMORY_READ_LATENCY 0
+#define STORAGE_MEMORY_WRITE_LATENCY 0
+
+// accounts and world kept in memory only, nothing survives a restart
+// for measuring the game loop without persistence and for testing storage failures
+class MemoryStorage : public Storage
+{
+private:
+    sf::Mutex m_Mutex;
+    std::unordered_map<std::string, AccountRecord> m_Accounts;
+    std::map<int, StoredRoom> m_Rooms;      // by room id
+    sf::Int64 m_WorldVersion;
+
+    // simulated latency in microseconds
+    sf::Int64 m_ReadLatency;
+    sf::Int64 m_WriteLatency;
+
+    // failure injection, failed reads return false and failed writes are dropped
+    std::atomic<bool> m_FailReads;
+    std::atomic<bool> m_FailWrites;
+
+    // statistics
+    std::atomic<long long> m_ReadCount;
+    std::atomic<long long> m_WriteCount;
+    std::atomic<int> m_ErrorCount;
+    std::atomic<long long> m_LastFailed;    // write mark of the newest failed write
+
+    bool beginRead();
+    bool beginWrite();
+
+public:
+    MemoryStorage();
+
+    std::string getName() { return "memory";}
+
+    void setLatency(sf::Int64 read_us, sf::Int64 write_us);
+    void failReads(bool fail) { m_FailReads = fail;}
+    void failWrites(bool fail) { m_FailWrites = fail;}
+
+    bool openAccounts(bool *created);
+    bool loadAccount(const std::string &username, AccountRecord *record);
+    void addAccount(const std::string &username, const std::string &stored, int room_id);
+    void setPassword(const std::string &username, const std::string &stored);
+    void savePlayerRooms(const std::unordered_map<std::string, int> &rooms);
+
+    bool openWorld(bool *created);
+    sf::Int64 getWorldVersion();
+    bool loadZoneList(std::vector<StoredZone> *zones);
+    bool loadRooms(const std::string &zone, StoredRoomFunc func, void *data);
+    bool findRoomZone(int room_id, std::string *zone);
+    void saveRooms(const std::vector<StoredRoom> &rooms);
+    bool writeSnapshot(const std::string &file, sf::Int64 version, int dir_count) { return false;}
+
+    long long writeMark() { return m_WriteCount;}
+    bool flush(long long mark) { return m_LastFailed <= mark;}
+    void printStats();
+};
+
+#endif // CLASS_MEMORYSTORAGE
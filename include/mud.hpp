@@ -1,18 +1,28 @@
 #ifndef CLASS_MUD
 #define CLASS_MUD
 
+#include <atomic>
+#include <unordered_map>
 #include <vector>
 #include <SFML/Network.hpp>
-#include "sqlite3.h"
 
 #include "client.hpp"
 #include "welcome.hpp"
 #include "account.hpp"
 #include "zone.hpp"
 #include "command.hpp"
+#include "scheduler.hpp"
+#include "credentials.hpp"
+#include "storage.hpp"
+#include "checkpoint.hpp"
+#include "journal.hpp"
 
 #define SERVER_PORT 1212
 #define DB_FILE "mud.db"
+#define MUD_TICK_TIME 100 // milliseconds between server updates
+#define DB_STATS_INTERVAL 600 // seconds between storage statistics reports
+#define LINKDEAD_TIME 300 // seconds a dropped player's session is kept for reconnecting, 0 to log out at once
+#define SOCKET_POOL_MAX 1024 // closed client sockets kept for new connections
 
 class Mud
 {
@@ -24,20 +34,42 @@ private:
 
     // server i/o
     enum SERVER_STATE{SERVER_INIT, SERVER_RUNNING, SERVER_SHUTDOWN};
-    int m_ServerState;
+    std::atomic<int> m_ServerState;
     unsigned short m_Port;
     sf::TcpListener m_Listener;
     sf::SocketSelector m_Selector;
     sf::Thread *m_SendAndReceiveThread;
     void sendAndRecieve();
     void updateSelector();
+    void update();      // periodic server upkeep
     std::vector<Client*> m_Clients;
     sf::Mutex m_ClientMutex;
+    std::vector<sf::TcpSocket*> m_FreeSockets;  // closed sockets for reuse (network thread only)
     bool addClient(Client *tclient);
     bool removeClient(Client *tclient);
+    std::vector<Client*> m_ReleasedClients;    // left the world, removed once no zone events or credential jobs refer to them
+    void removeReleasedClients();
+    void releaseClient(Client *tclient);
+    // connection of client in the game lost, false if its session should end instead
+    bool keepLinkDead(Client *tclient);
+    void expireLinkDead();
+    void handleCredentialResults(std::vector<Client*> *removal_queue);
+    void handleFlowTimers(std::vector<Client*> *removal_queue);
+    // after client ran on the network thread: drop it if disconnected, or hand it to its zone once logged in
+    void checkClient(Client *tclient, std::vector<Client*> *removal_queue);
 
-    // sqlite database
-    sqlite3 *m_DB;
+    // logged in players by lower case name
+    sf::Mutex m_OnlineMutex;
+    std::unordered_map<std::string, Client*> m_OnlinePlayers;
+
+    // accounts and world, backend picked at startup
+    Storage *m_Storage;
+    sf::Clock m_StatsClock;
+
+    // player positions are written in batches
+    sf::Clock m_SaveClock;
+    bool m_LogoutSaves;         // player left since last flush, write without waiting for the interval
+    void queueMovedPlayers();
 
 
 public:
@@ -48,7 +80,19 @@ public:
         return m_Instance;
     }
 
-    void start();
+    void start(const StorageOptions &storage_options = StorageOptions());
+    // stop the server, start returns once the network thread is done (safe from a signal handler)
+    void shutdown() { m_ServerState = SERVER_SHUTDOWN;}
+    // write everything out and free the mud, once start has returned
+    static void destroyInstance()
+    {
+        delete m_Instance;
+        m_Instance = NULL;
+    }
+
+    // client sockets are recycled instead of freed, network thread only
+    sf::TcpSocket *acquireSocket();
+    void releaseSocket(sf::TcpSocket *tsocket);
 
     static int mainGame(Client *tclient);
 
@@ -57,10 +101,31 @@ public:
     bool broadcastToRoomExcluding(int room_id, std::string msg, Client *tclient);
 
     std::vector<std::string> getPlayerNames(int room_id = 0);
+    // append a "<name> is here." line for each other player in room
+    void appendPlayersHere(int room_id, Client *tclient, std::string *text);
+    int getPlayerRoom(std::string username);
+
+    // online player index, kept up to date on login and when clients are removed
+    // false if a player with the same name is already online
+    bool addOnlinePlayer(Client *tclient);
+    void removeOnlinePlayer(Client *tclient);
+    bool isPlayerOnline(std::string username);
+    bool isPlayerLinkDead(std::string username);
+    // hand connection of tclient to the link-dead session of username, tclient is left disconnected
+    // returns false if there is no such session
+    bool reattachSession(Client *tclient, std::string username);
+    // send to player by name, name is set to the player's name if found
+    bool sendToPlayer(std::string username, std::string msg, std::string *name = NULL);
+    // append a line for each online player, returns number of players
+    int appendOnlinePlayers(std::string *text);
 
     // database managers
     AccountManager *m_AccountManager;
     ZoneManager *m_ZoneManager;
     CommandManager *m_CommandManager;
+    ZoneScheduler *m_ZoneScheduler;
+    CredentialPool *m_CredentialPool;
+    Checkpointer *m_Checkpointer;
+    Journal *m_Journal;                 // NULL if not journaling
 };
 #endif // CLASS_MUD
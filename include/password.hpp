@@ -0,0 +1,26 @@
+#ifndef CLASS_PASSWORD
+#define CLASS_PASSWORD
+
+#include <string>
+
+// scrypt cost, memory used per hash is 128 * r * N bytes (16MB)
+#define PASSWORD_SCRYPT_N 16384
+#define PASSWORD_SCRYPT_R 8
+#define PASSWORD_SCRYPT_P 1
+#define PASSWORD_SALT_SIZE 16
+#define PASSWORD_HASH_SIZE 32
+
+// stored password format: scrypt$N$r$p$salt$hash (salt and hash in hex)
+// slow on purpose, do not call from the network thread
+
+// hash password with a new random salt
+std::string hashPassword(const std::string &password);
+// check password against stored hash, plaintext from older databases is also accepted
+bool verifyPassword(const std::string &password, const std::string &stored);
+// stored password should be hashed again (plaintext or older cost settings)
+bool passwordNeedsRehash(const std::string &stored);
+
+// scrypt key derivation (RFC 7914), returns false if parameters are invalid
+bool scrypt(const std::string &password, const std::string &salt, int N, int r, int p, unsigned char *out, int out_size);
+
+#endif // CLASS_PASSWORD
@@ -0,0 +1,83 @@
+#ifndef CLASS_PATH
+#define CLASS_PATH
+
+#include <atomic>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/System.hpp>
+
+// maximum number of routes kept in the route cache
+#define PATH_CACHE_SIZE 1024
+// rooms a search looks at before giving up, each one can load its zone
+#define PATH_MAX_ROOMS 4096
+
+// forward dec
+class ZoneManager;
+
+struct PathCacheEntry
+{
+    unsigned long long key;     // from/to room pair
+    bool found;                 // false if there is no route
+    std::vector<std::string> route;     // exits to take, direction names or named exits
+};
+
+// search scratch space, indexed by room id
+// stamps mark which rooms were visited in the current search so the
+// arrays never need to be cleared between searches
+struct PathSearch
+{
+    unsigned int stamp;
+    std::vector<unsigned int> visited;
+    std::vector<int> parent;            // room we came from
+    std::vector<int> step;              // exit taken from parent, direction index or DIR_COUNT + named exit
+    std::vector<std::string> named_exits;   // named exits taken in this search
+
+    PathSearch()
+    {
+        stamp = 0;
+    }
+};
+
+class PathFinder
+{
+private:
+
+    ZoneManager *m_ZoneManager;
+
+    // searches load zones as they go, so no lock is held while searching
+    // each search takes scratch space of its own from the free list
+    sf::Mutex m_Mutex;                  // guards free list and route cache
+    std::vector<PathSearch*> m_FreeSearches;
+    PathSearch *acquireSearch();
+    void releaseSearch(PathSearch *tsearch);
+    void prepareSearch(PathSearch *tsearch);
+    // rooms can be created while a search runs, so ids past the end grow the arrays first
+    void growSearch(PathSearch *tsearch, int size);
+
+    // false if there is no route within PATH_MAX_ROOMS rooms
+    bool search(PathSearch *tsearch, int from, int to, std::vector<std::string> *route);
+
+    // least recently used route cache (most recent at front)
+    // cached routes belong to a generation, changing any room link starts a new one
+    std::atomic<unsigned int> m_Generation;
+    unsigned int m_CacheGeneration;
+    std::list<PathCacheEntry> m_Cache;
+    std::unordered_map<unsigned long long, std::list<PathCacheEntry>::iterator> m_CacheIndex;
+
+public:
+    PathFinder(ZoneManager *zmgr);
+    ~PathFinder();
+
+    // find route from room to room as a list of exits to take, returns false if no route exists
+    bool findPath(int from, int to, std::vector<std::string> *route);
+    // next exit to take toward destination (for npc movement), empty if none
+    std::string getNextStep(int from, int to);
+
+    // drop all cached routes, must be called whenever room links change
+    // takes no lock, so it can be called with the room mutex held
+    void invalidate();
+};
+
+#endif // CLASS_PATH
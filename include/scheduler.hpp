@@ -0,0 +1,120 @@
+#ifndef CLASS_SCHEDULER
+#define CLASS_SCHEDULER
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/System.hpp>
+
+// run in game client input on zone actors spread over worker threads
+// instead of on the network thread
+#define ZONE_ACTORS 1
+#define ZONE_WORKER_THREADS 4
+// events an actor handles before letting other zones have the worker
+#define ZONE_EVENTS_PER_RUN 64
+
+// forward dec
+class Client;
+class ZoneManager;
+
+enum ZONE_EVENT_TYPE{ZE_ARRIVE, ZE_INPUT, ZE_LEAVE, ZE_ROOM_MESSAGE};
+
+struct ZoneEvent
+{
+    int type;
+    Client *client;             // client event is for (room messages: client to skip)
+    int room;                   // room messages: room to deliver to
+    std::string text;           // room messages: message
+
+    ZoneEvent()
+    {
+        type = ZE_INPUT;
+        client = NULL;
+        room = 0;
+    }
+};
+
+// a zone and the clients in it
+// events for a zone are handled one at a time in the order they were posted,
+// by whichever worker picks the zone up
+struct ZoneActor
+{
+    int zone;                       // zone name id
+
+    sf::Mutex mutex;                // guards mailbox and scheduled
+    std::deque<ZoneEvent> mailbox;
+    bool scheduled;                 // waiting in run queue or running
+
+    std::vector<Client*> occupants; // only used by the worker running the actor
+    sf::Uint64 event_count;
+
+    ZoneActor()
+    {
+        zone = 0;
+        scheduled = false;
+        event_count = 0;
+    }
+};
+
+class ZoneScheduler
+{
+private:
+    static bool m_Initialized;
+    ZoneScheduler(ZoneManager *zmgr);
+    ~ZoneScheduler();
+
+    ZoneManager *m_ZoneManager;
+
+    // actors are created on first use and live as long as the scheduler
+    sf::Mutex m_ActorMutex;
+    std::unordered_map<int, ZoneActor*> m_Actors;  // zone name id -> actor
+    ZoneActor *getActor(int zone);
+
+    // actors with events waiting, idle workers wait on m_RunReady
+    std::mutex m_RunMutex;
+    std::condition_variable m_RunReady;
+    std::deque<ZoneActor*> m_RunQueue;
+    void queueActor(ZoneActor *tactor);
+
+    std::vector<sf::Thread*> m_Workers;
+    std::atomic<bool> m_Running;
+    void run();
+    void runActor(ZoneActor *tactor);
+    void handleEvent(ZoneActor *tactor, ZoneEvent &tevent);
+
+    void post(int zone, const ZoneEvent &tevent);
+    void moveClient(ZoneActor *tactor, Client *tclient, int zone);
+    void removeOccupant(ZoneActor *tactor, Client *tclient);
+    void releaseClient(ZoneActor *tactor, Client *tclient);
+    void deliverRoomMessage(ZoneActor *tactor, int room_id, const std::string &msg, Client *exclude);
+
+    // clients that have left the world, ready to be removed by the network thread
+    sf::Mutex m_ReleaseMutex;
+    std::vector<Client*> m_Released;
+
+public:
+
+    void start();
+    void stop();
+    bool isRunning() { return m_Running;}
+
+    // hand logged in client to the zone of its room
+    bool enterWorld(Client *tclient);
+    // queue line of client input for its zone
+    void postInput(Client *tclient, const std::string &input);
+    // client disconnected, its zone lets go of it
+    void postLeave(Client *tclient);
+    // send message to clients in room, from its zone
+    void postRoomMessage(int room_id, const std::string &msg, Client *exclude = NULL);
+
+    // clients released since last call
+    void takeReleased(std::vector<Client*> *clients);
+
+    friend class Mud;
+};
+
+#endif // CLASS_SCHEDULER
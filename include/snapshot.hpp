@@ -0,0 +1,118 @@
+#ifndef CLASS_SNAPSHOT
+#define CLASS_SNAPSHOT
+
+#include <string>
+#include <SFML/System.hpp>
+#include "sqlite3.h"
+
+#define SNAPSHOT_MAGIC "MUDSNAP"
+#define SNAPSHOT_VERSION 2
+
+// binary world snapshot file layout
+// everything is referenced by byte offsets from the start of the file so the
+// file can be memory mapped and read in place
+struct SnapshotHeader
+{
+    char magic[8];
+    sf::Uint32 version;         // snapshot format version
+    sf::Uint32 dir_count;       // exits stored per room
+    sf::Int64 data_version;     // world version in database when snapshot was written
+    sf::Uint32 room_slots;      // highest room id + 1
+    sf::Uint32 zone_count;
+    sf::Uint64 rooms_offset;    // SnapshotRoom[room_slots]
+    sf::Uint64 exits_offset;    // sf::Int32[room_slots * dir_count]
+    sf::Uint64 special_offset;  // SnapshotExit[special_count], grouped by room
+    sf::Uint32 special_count;
+    sf::Uint64 zones_offset;    // SnapshotZone[zone_count]
+    sf::Uint64 zone_rooms_offset; // sf::Uint32 room ids, grouped by zone
+    sf::Uint64 text_offset;     // text blob
+    sf::Uint64 file_size;
+};
+
+struct SnapshotRoom
+{
+    sf::Uint32 room_id;         // 0 if slot is not used
+    sf::Uint32 zone;            // zone index
+    sf::Uint32 name_offset;     // offsets into text blob
+    sf::Uint32 name_length;
+    sf::Uint32 description_offset;
+    sf::Uint32 description_length;
+    sf::Uint32 special_first;   // index of room's first special exit
+    sf::Uint32 special_count;
+};
+
+// exit with flags or a named exit, plain direction exits are only in the exits table
+struct SnapshotExit
+{
+    sf::Uint32 name_offset;     // direction or exit name
+    sf::Uint32 name_length;
+    sf::Int32 to_room;
+    sf::Uint32 flags;
+};
+
+struct SnapshotZone
+{
+    sf::Uint32 name_offset;
+    sf::Uint32 name_length;
+    sf::Uint32 first_room;      // index into zone room ids
+    sf::Uint32 room_count;
+};
+
+class WorldSnapshot
+{
+private:
+
+    // mapped file
+    const char *m_Data;
+    size_t m_Size;
+#ifdef _WIN32
+    void *m_File;
+    void *m_Mapping;
+#else
+    int m_File;
+#endif
+
+    const SnapshotHeader *m_Header;
+    const SnapshotRoom *m_Rooms;
+    const sf::Int32 *m_Exits;
+    const SnapshotExit *m_SpecialExits;
+    const SnapshotZone *m_Zones;
+    const sf::Uint32 *m_ZoneRooms;
+    const char *m_Text;
+    sf::Uint64 m_TextSize;
+    sf::Uint64 m_ZoneRoomCount;
+
+    bool validate();
+    std::string getText(sf::Uint32 offset, sf::Uint32 length);
+
+public:
+    WorldSnapshot();
+    ~WorldSnapshot();
+
+    // write snapshot of rooms and exits tables to file
+    static bool write(sqlite3 *db, std::string filename, sf::Int64 data_version, int dir_count);
+
+    bool open(std::string filename);
+    void close();
+    bool isOpen() { return m_Data != NULL;}
+
+    sf::Int64 getDataVersion();
+    int getDirCount();
+    int getRoomSlots();
+
+    // zones
+    int getZoneCount();
+    std::string getZoneName(int zone_index);
+    int getZoneRoomCount(int zone_index);
+    int getZoneRoom(int zone_index, int n);
+
+    // rooms
+    bool hasRoom(int room_id);
+    std::string getRoomName(int room_id);
+    std::string getRoomDescription(int room_id);
+    int getRoomExit(int room_id, int dir_index);
+    int getRoomSpecialExitCount(int room_id);
+    bool getRoomSpecialExit(int room_id, int n, std::string *name, int *to_room, int *flags);
+};
+
+#endif // CLASS_SNAPSHOT
@@ -7,5 +7,6 @@
 class Client;
 
 int say(Client *tclient, std::string cmd, std::string args);
+int tell(Client *tclient, std::string cmd, std::string args);
 
 #endif // CLASS_SOCIAL
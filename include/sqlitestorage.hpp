@@ -0,0 +1,49 @@
+#ifndef CLASS_SQLITESTORAGE
+#define CLASS_SQLITESTORAGE
+
+#include "sqlite3.h"
+#include "storage.hpp"
+#include "database.hpp"
+#include "statementcache.hpp"
+
+// accounts and world in an sqlite database
+// writes go through the database writer thread, rooms are read on the reader
+// connections and everything else on the main connection
+class SqliteStorage : public Storage
+{
+private:
+    sqlite3 *m_DB;
+    StatementCache *m_Statements;
+    DatabaseWriter *m_Writer;
+    DatabaseReaders *m_Readers;
+
+    bool _MigrateExits();           // move exits out of the rooms table into the exits table
+
+public:
+    SqliteStorage(const std::string &file);
+    ~SqliteStorage();
+
+    bool isOpen() { return m_DB != NULL && m_Writer && m_Writer->isOpen();}
+
+    std::string getName() { return "sqlite";}
+
+    bool openAccounts(bool *created);
+    bool loadAccount(const std::string &username, AccountRecord *record);
+    void addAccount(const std::string &username, const std::string &stored, int room_id);
+    void setPassword(const std::string &username, const std::string &stored);
+    void savePlayerRooms(const std::unordered_map<std::string, int> &rooms);
+
+    bool openWorld(bool *created);
+    sf::Int64 getWorldVersion();
+    bool loadZoneList(std::vector<StoredZone> *zones);
+    bool loadRooms(const std::string &zone, StoredRoomFunc func, void *data);
+    bool findRoomZone(int room_id, std::string *zone);
+    void saveRooms(const std::vector<StoredRoom> &rooms);
+    bool writeSnapshot(const std::string &file, sf::Int64 version, int dir_count);
+
+    long long writeMark();
+    bool flush(long long mark);
+    void printStats();
+};
+
+#endif // CLASS_SQLITESTORAGE
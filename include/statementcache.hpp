@@ -0,0 +1,64 @@
+#ifndef CLASS_STATEMENTCACHE
+#define CLASS_STATEMENTCACHE
+
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <SFML/System.hpp>
+#include "sqlite3.h"
+
+struct StatementEntry
+{
+    std::string sql;
+    sqlite3_stmt *stmt;         // prepared once, reused
+    bool busy;                  // currently handed out
+
+    // usage statistics
+    int exec_count;
+    sf::Int64 total_time;       // microseconds spent in step, per acquire
+    sf::Int64 max_time;         // microseconds
+};
+
+struct ActiveStatement
+{
+    StatementEntry *entry;
+    bool temporary;             // prepared because cached statement was busy, finalize on release
+    sf::Int64 step_time;        // microseconds spent in step since acquire
+};
+
+// prepared sql statements for one database connection
+// statements are compiled the first time they are used and reused with new
+// parameter bindings afterwards
+class StatementCache
+{
+private:
+    StatementCache(sqlite3 *db);
+    ~StatementCache();
+
+    // one cache per database connection
+    static sf::Mutex m_CacheMutex;
+    static std::map<sqlite3*, StatementCache*> m_Caches;
+
+    sqlite3 *m_DB;
+    sf::Mutex m_Mutex;
+    std::unordered_map<std::string, StatementEntry*> m_Statements;
+    std::unordered_map<sqlite3_stmt*, ActiveStatement> m_Active;
+
+public:
+
+    // get statement cache for database connection
+    static StatementCache *getCache(sqlite3 *db);
+    // finalize all cached statements for connection, must happen before closing it
+    static void closeCache(sqlite3 *db);
+
+    // get prepared statement ready for binding, NULL on error
+    sqlite3_stmt *acquire(const std::string &sql);
+    // sqlite3_step, timed for the statistics
+    int step(sqlite3_stmt *stmt);
+    // reset statement and give it back to the cache
+    void release(sqlite3_stmt *stmt);
+
+    void printStats();
+};
+
+#endif // CLASS_STATEMENTCACHE
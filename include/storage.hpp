@@ -0,0 +1,125 @@
+#ifndef CLASS_STORAGE
+#define CLASS_STORAGE
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/System.hpp>
+
+// where accounts and the world are kept, picked at startup
+enum STORAGE_TYPE{STORAGE_SQLITE, STORAGE_MEMORY};
+#define STORAGE_DEFAULT STORAGE_SQLITE
+
+// storage picked on the command line
+struct StorageOptions
+{
+    int type;
+    // memory storage only, for testing, latency in microseconds (-1 = build default)
+    sf::Int64 read_latency;
+    sf::Int64 write_latency;
+    bool fail_reads;
+    bool fail_writes;
+
+    StorageOptions()
+    {
+        type = STORAGE_DEFAULT;
+        read_latency = -1;
+        write_latency = -1;
+        fail_reads = false;
+        fail_writes = false;
+    }
+};
+
+struct AccountRecord
+{
+    bool exists;                // false for names with no account
+    std::string password;       // stored password
+    int room_id;
+
+    AccountRecord()
+    {
+        exists = false;
+        room_id = 0;
+    }
+};
+
+struct StoredExit
+{
+    std::string dir;            // direction name, or exit name for named exits
+    int to_room;
+    int flags;
+};
+
+struct StoredRoom
+{
+    int room_id;
+    std::string zone;
+    std::string name;
+    std::string description;
+    std::vector<StoredExit> exits;
+
+    StoredRoom()
+    {
+        room_id = 0;
+    }
+};
+
+struct StoredZone
+{
+    std::string name;
+    int max_room_id;
+    int room_count;
+};
+
+// called for each room read, in room id order
+typedef void (*StoredRoomFunc)(void *data, const StoredRoom &troom);
+
+// account and world persistence
+// writes may be queued, reads made after flush() see every write made before it
+// a write that fails is dropped, flush() tells whether any since a write mark did
+// reads can come from any thread
+class Storage
+{
+public:
+    virtual ~Storage() {}
+
+    // name of backend for log output
+    virtual std::string getName() = 0;
+
+    // accounts
+    // create account storage if needed, created is set if there were no accounts before
+    virtual bool openAccounts(bool *created) = 0;
+    // false if storage could not be read, record->exists is false for unknown names
+    virtual bool loadAccount(const std::string &username, AccountRecord *record) = 0;
+    virtual void addAccount(const std::string &username, const std::string &stored, int room_id) = 0;
+    virtual void setPassword(const std::string &username, const std::string &stored) = 0;
+    // player rooms by formatted name, written together
+    virtual void savePlayerRooms(const std::unordered_map<std::string, int> &rooms) = 0;
+
+    // world
+    // create world storage if needed, created is set if there was no world before
+    virtual bool openWorld(bool *created) = 0;
+    // bumped every time rooms are saved
+    virtual sf::Int64 getWorldVersion() = 0;
+    virtual bool loadZoneList(std::vector<StoredZone> *zones) = 0;
+    // rooms of zone, or of every zone if zone is empty
+    // queued writes are not waited for, callers make sure the rooms' writes are in first
+    virtual bool loadRooms(const std::string &zone, StoredRoomFunc func, void *data) = 0;
+    // zone room belongs to, empty if there is no such room
+    virtual bool findRoomZone(int room_id, std::string *zone) = 0;
+    // replace rooms and their exits, all or nothing
+    virtual void saveRooms(const std::vector<StoredRoom> &rooms) = 0;
+    // write world snapshot file, false if not supported
+    virtual bool writeSnapshot(const std::string &file, sf::Int64 version, int dir_count) = 0;
+
+    // number of writes made so far, to pass to flush
+    virtual long long writeMark() = 0;
+    // wait for queued writes, false if a write made after mark failed
+    virtual bool flush(long long mark) = 0;
+    virtual void printStats() = 0;
+};
+
+// NULL if the storage could not be opened, file is only used by backends that keep one
+Storage *createStorage(const StorageOptions &options, const std::string &file);
+
+#endif // CLASS_STORAGE
@@ -0,0 +1,54 @@
+#ifndef CLASS_TEXTSTORE
+#define CLASS_TEXTSTORE
+
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <SFML/System.hpp>
+
+// deduplicating string storage
+// identical strings are stored once and referred to by a small integer id
+// id 0 is always the empty string
+struct TextEntry
+{
+    std::string text;
+    int refs;
+};
+
+class TextStore
+{
+private:
+
+    sf::Mutex m_Mutex;
+
+    // freed ids are reused, so text is copied out under the mutex
+    std::deque<TextEntry> m_Entries;
+    std::vector<int> m_FreeIDs;
+
+    // hash of text -> entry ids with that hash
+    std::unordered_multimap<size_t, int> m_Index;
+
+public:
+    TextStore();
+    ~TextStore();
+
+    // store text (or add a reference to an identical stored text), returns text id
+    int add(const std::string &text);
+    // add another reference to an already stored text id
+    void addRef(int id);
+    // drop a reference to text id, text is freed when no longer referenced
+    void release(int id);
+    // replace reference held in id with new text, returns new text id
+    int replace(int id, const std::string &text);
+
+    // copy of text, a reference could be freed or reused by another thread
+    std::string get(int id);
+    // id of stored text, 0 if not stored (does not add a reference)
+    int find(const std::string &text);
+
+    int getCount();         // number of unique texts stored
+    size_t getTextBytes();  // bytes of unique text stored
+};
+
+#endif // CLASS_TEXTSTORE
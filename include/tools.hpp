@@ -34,5 +34,7 @@ bool makeFolder(std::string directory);
 //static int sqlcallback(void *data, int argc, char **argv, char **azColName);
 int sqlcallback(void *data, int argc, char **argv, char **azColName);
 bool tableExists(sqlite3 *db, std::string table_name);
+bool columnExists(sqlite3 *db, std::string table_name, std::string column_name);
+std::string sqlColumnString(sqlite3_stmt *stmt, int col);
 
 #endif // _TOOLS
@@ -0,0 +1,105 @@
+#ifndef CLASS_WORLDMAP
+#define CLASS_WORLDMAP
+
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+// give rooms map coordinates derived from their exits when zones load
+#define ROOM_COORDINATES 1
+// map radius in rooms when none is given, and the largest allowed
+#define MAP_DEFAULT_RADIUS 3
+#define MAP_MAX_RADIUS 10
+// maximum number of rendered maps kept in the map cache
+#define MAP_CACHE_SIZE 512
+
+// forward dec
+class ZoneManager;
+
+// coordinates are per zone, x grows to the east and y grows to the south
+struct RoomPosition
+{
+    int zone;                   // zone name id, 0 if room has no position
+    int x;
+    int y;
+
+    RoomPosition()
+    {
+        zone = 0;
+        x = 0;
+        y = 0;
+    }
+};
+
+// spatial index of a zone's placed rooms
+struct ZoneGrid
+{
+    std::unordered_map<unsigned long long, int> cells; // packed x,y -> room id
+    int min_x;
+    int max_x;
+    int min_y;
+    int max_y;
+
+    ZoneGrid()
+    {
+        min_x = 0;
+        max_x = 0;
+        min_y = 0;
+        max_y = 0;
+    }
+};
+
+struct MapCacheEntry
+{
+    unsigned long long key;     // room/radius pair
+    int zone;                   // position the map was rendered around
+    int x;
+    int y;
+    int radius;
+    std::string text;
+};
+
+class WorldMap
+{
+private:
+
+    ZoneManager *m_ZoneManager;
+
+    std::vector<RoomPosition> m_Positions;      // indexed by room id
+    std::unordered_map<int, ZoneGrid> m_Grids;  // zone name id -> grid
+
+    static unsigned long long cellKey(int x, int y);
+    bool isPlaced(int room_id);
+    bool placeRoom(int room_id, int zone, int x, int y);
+    int placeFrom(int room_id, int zone, int x, int y, const std::unordered_set<int> &zone_rooms);
+    void newComponentOrigin(int zone, int *x, int *y);
+    int getRoomAt(int zone, int x, int y);
+    std::string render(int room_id, int radius);
+
+    // least recently used rendered maps (most recent at front)
+    std::list<MapCacheEntry> m_Cache;
+    std::unordered_map<unsigned long long, std::list<MapCacheEntry>::iterator> m_CacheIndex;
+    void invalidateNear(int zone, int x, int y);
+
+public:
+    WorldMap(ZoneManager *zmgr);
+    ~WorldMap();
+
+    // work out coordinates for a freshly loaded zone's rooms
+    void layoutZone(int zone, const std::vector<int> &room_ids);
+    // forget coordinates of an unloaded zone's rooms
+    void clearZone(int zone, const std::vector<int> &room_ids);
+    // place newly linked rooms and drop cached maps that showed them
+    void roomsLinked(int room_a, int zone_a, int room_b, int zone_b, int dir_index);
+    // drop cached maps that show room, after its exits were removed or changed
+    void roomChanged(int room_id);
+
+    // returns false if room has no position
+    bool getPosition(int room_id, int *x, int *y);
+    // ascii map centered on room
+    std::string getMap(int room_id, int radius);
+};
+
+#endif // CLASS_WORLDMAP
@@ -1,28 +1,131 @@
 #ifndef CLASS_ZONE
 #define CLASS_ZONE
 
+#include <atomic>
 #include <string>
+#include <unordered_map>
 #include <vector>
 #include <SFML/System.hpp>
-#include "sqlite3.h"
 #include "direction.hpp"
+#include "epoch.hpp"
+#include "path.hpp"
+#include "worldmap.hpp"
+#include "textstore.hpp"
+#include "snapshot.hpp"
+#include "storage.hpp"
+#include "journal.hpp"
 
-struct Room
+// load zones from storage the first time one of their rooms is used
+// instead of loading every room at startup
+#define ZONE_LAZY_LOAD 1
+// seconds a zone may sit unused before its rooms are saved and unloaded (0 = never)
+#define ZONE_IDLE_TIMEOUT 300
+// number of rooms allocated at a time when room storage runs out
+#define ROOM_BLOCK_SIZE 1024
+// keep a binary snapshot of the rooms table to load zones from without sql
+#define WORLD_SNAPSHOT 1
+#define WORLD_SNAPSHOT_FILE "world.snap"
+// keep the rendered name, description and exit line of a room for look
+#define ROOM_LOOK_CACHE 1
+
+// exit flags, stored with the exit in the exits table
+#define EXIT_DOOR       0x01    // exit can be opened and closed
+#define EXIT_CLOSED     0x02    // door is closed, exit can not be used
+#define EXIT_ONE_WAY    0x04    // no exit is expected back
+#define EXIT_HIDDEN     0x08    // not shown in exit lists
+
+// exit that is more than a plain opening in a direction
+// either a direction exit with flags or a named exit (portal) that is not a direction
+struct SpecialExit
 {
-    int room_id;                // room number
-    std::string zone;           // what zone room belongs to
+    int dir;                    // direction index, -1 for named exits
+    std::string name;           // named exits only
+    int to_room;
+    int flags;
+};
 
-    std::string name;           // room name, first line of room description
-    std::string description;    // long room description
+// static part of a room's look output
+struct RoomLook
+{
+    std::string header;         // name, description and blank line
+    std::string exits;          // exit line
+};
+
+// room contents, never changed once published
+// edits publish a changed copy and the old copy is freed when no reader can still see it
+// room text is kept in the zone manager text stores, states only hold text ids
+struct RoomState
+{
+    int name;                   // room name id, first line of room description
+    int description;            // long room description id
 
     // exits - number links to other room numbers
     std::vector<int> exits;
+    // doors, hidden and named exits, empty for most rooms
+    std::vector<SpecialExit> special_exits;
+
+    // rendered on first look, goes away with the state so edits never see a stale one
+    mutable std::atomic<const RoomLook*> look;
+
+    RoomState()
+    {
+        name = 0;
+        description = 0;
+        look.store(NULL, std::memory_order_relaxed);
+    }
+};
+
+struct Room
+{
+    int room_id;                // room number
+    int zone;                   // what zone room belongs to (zone name id)
+
+    std::atomic<const RoomState*> state;    // current contents
+    std::atomic<int> last_access;           // seconds, when room was last used
+
+    bool dirty;                 // changed since last written to storage
+
+    Room()
+    {
+        room_id = 0;
+        zone = 0;
+        state.store(NULL);
+        last_access.store(0);
+        dirty = false;
+    }
+};
+
+// room slots indexed by room id, replaced by a larger copy when it needs to grow
+struct RoomTable
+{
+    std::vector<std::atomic<Room*> > slots;
+
+    RoomTable(int size) : slots(size)
+    {
+        for(int i = 0; i < size; i++) slots[i].store(NULL, std::memory_order_relaxed);
+    }
 };
 
 struct Zone
 {
     std::string name;
-    std::vector<Room*> rooms; // list of pointers to rooms belonging to this zone
+    int name_id;                // interned zone name
+    int room_count;             // rooms in storage, used to size storage on load
+    std::vector<int> rooms;     // ids of rooms belonging to this zone (when loaded)
+    int snapshot_zone;          // zone index in world snapshot, -1 if not in snapshot
+    bool snapshot_stale;        // rooms changed since snapshot was written
+
+    bool loaded;                // rooms are in memory
+    sf::Time last_access;       // when a room in this zone was last used
+
+    Zone()
+    {
+        name_id = 0;
+        room_count = 0;
+        snapshot_zone = -1;
+        snapshot_stale = false;
+        loaded = false;
+    }
 };
 
 class ZoneManager
@@ -30,23 +133,91 @@ class ZoneManager
 private:
     static bool m_Initialized;
 
-    ZoneManager(sqlite3 *db);
+    ZoneManager(Storage *storage);
     ~ZoneManager();
 
-    sqlite3 *m_DB;
+    // zones can be loaded from zone threads
+    Storage *m_Storage;
+    // changed rooms are logged here as they change, NULL if not journaling
+    Journal *m_Journal;
+
+    // save/load rooms in storage
+    bool _LoadZoneList();           // only happens once - on init
+    bool _LoadAllRooms();
+    bool _LoadZone(int zone_index);
+    int _ReadRooms(const std::string &zone, int *error_count);
+    static void readStoredRoom(void *data, const StoredRoom &troom);
+    int _ReadSnapshotRooms(int zone_index, int *error_count);
+    void addLoadedRoom(int zone_index, int room_id, RoomState *state);
+    int _ValidateRooms(const std::vector<int> &room_ids);
+    bool _LoadRoomZone(int room_id);
+    bool _UnloadZone(int zone_index);
+    // hand all changed rooms to storage and wait for it, pause is how long the room mutex was held
+    // false if storage failed, the rooms are dirty again then
+    bool _SaveRooms(int *save_count = NULL, sf::Time *pause = NULL);
+    void _SaveExits(StoredRoom *stored, const RoomState *state);
+    void _StoreRoom(StoredRoom *stored, int room_id, int zone, const RoomState *state);
 
-    // save/load rooms in database
-    bool _LoadRooms();              // only happens once - on init
-    bool _SaveRooms();              // only happens once - on shutdown
+    // write behind - changed rooms are written in batches by the checkpointer
+    std::vector<int> m_DirtyRooms;
+    sf::Mutex m_SaveMutex;              // one save at a time, held from taking the rooms until storage confirms them
+    std::atomic<bool> m_Saving;
+    void markRoomDirty(Room *troom);
 
     // room
+    // room reads take no locks, they run inside an epoch section and see a
+    // consistent room state, edits are made under the room mutex
     sf::Mutex m_RoomMutex;
+    EpochManager m_Epoch;
     int m_NextAvailableRoomID;
-    std::vector<Room> m_Rooms;
+    std::atomic<RoomTable*> m_RoomTable;    // NULL slot if room is not loaded
+    Room *getRoomSlot(int room_id);
+    void setRoomSlot(int room_id, Room *troom);
+    void growRoomTable(int size);
+    Room *getRoom(int room_id);     // get room, loading its zone if needed
+
+    // room state copy on write
+    RoomState *newRoomState(const std::string &name, const std::string &description);
+    RoomState *copyRoomState(const RoomState *state);
+    void publishRoomState(Room *troom, RoomState *state);
+    static void freeRoomState(void *zmgr, void *state);
+    RoomLook *renderRoomLook(const RoomState *state);
+    static const SpecialExit *findSpecialExit(const RoomState *state, int dir_index, const std::string &name = "");
+    static void setSpecialExit(RoomState *state, int dir_index, const std::string &name, int to_room, int flags);
+    void exitsChanged(Room *troom_a, Room *troom_b, int dir_index);
+
+    // room storage, rooms are allocated in blocks and recycled when unloaded
+    std::vector<Room*> m_RoomBlocks;
+    std::vector<Room*> m_FreeRooms;
+    void reserveRooms(int count);
+    Room *allocRoom();
+    void freeRoom(Room *troom);
+    static void recycleRoom(void *zmgr, void *troom);
 
     // zone
     sf::Mutex m_ZoneMutex;
     std::vector<Zone> m_Zones;
+    std::unordered_map<int, int> m_ZoneLookup; // zone name id -> zone index
+    int findZone(std::string zonename);
+    void touchZone(Room *troom);
+    bool zoneIdle(int zone_index, sf::Time now);
+    sf::Clock m_Clock;
+
+    // shared text storage
+    TextStore m_ZoneNames;  // interned zone names
+    TextStore m_RoomText;   // deduplicated room names and descriptions
+
+    // world snapshot, rebuilt from storage when out of date
+    WorldSnapshot m_Snapshot;
+    bool _LoadZoneListFromSnapshot();
+    void _LinkSnapshotZones();
+    bool useSnapshot(int zone_index);
+
+    // route finding between rooms, safe to use from any thread
+    PathFinder *m_PathFinder;
+
+    // room coordinates and ascii maps
+    WorldMap *m_WorldMap;
 
 public:
 
@@ -54,17 +225,45 @@ public:
     std::vector<std::string> getZones();
     Zone *createZone(std::string zonename);
     bool zoneExists(std::string zonename);
+    void update();                      // unload idle zones
 
     // public room functions
     Room *createRoom(std::string zonename, bool save_to_database = true);
     bool linkRooms(int room_a, int room_b, int dir_index);
-    bool saveRoom(int room_id);
+    // add, change or remove (to_room 0) a single exit without touching the room it leads to
+    bool setExit(int room_id, int dir_index, int to_room, int flags = 0);
+    bool setNamedExit(int room_id, std::string name, int to_room, int flags = 0);
+    // open or close door, both sides if the other room has a door back
+    bool setDoorClosed(int room_id, int dir_index, bool closed);
+    bool saveRoom(int room_id);         // queue room to be written on next flush
     bool roomExists(int room_id);
+    void touchRoom(int room_id);        // mark room's zone as in use without loading it
     std::vector<std::string> getExits(int room_id);
+    // append room name/description and exit line of look output
+    bool getRoomLook(int room_id, std::string *header, std::string *exits);
     int getRoomNumInDirection(int room_id, int dir_index);
+    int getExitFlags(int room_id, int dir_index);
+    // room named exit leads to, 0 if there is no such exit
+    int getNamedExit(int room_id, std::string name, int *flags = NULL);
+    // direction and named exits that can be taken now, closed doors are left out
+    bool getOpenExits(int room_id, std::vector<SpecialExit> *exits);
     std::string getRoomName(int room_id);
     std::string getRoomDescription(int room_id);
+    std::string getRoomZone(int room_id);
+    int getRoomZoneID(int room_id);     // zone name id, 0 if room does not exist
+    bool setRoomName(int room_id, std::string name);
+    bool setRoomDescription(int room_id, std::string description);
+    int getRoomCount();
+
+    // routes
+    bool findPath(int from_room, int to_room, std::vector<std::string> *route);
+    std::string getNextStep(int from_room, int to_room);
+
+    // map
+    bool getRoomPosition(int room_id, int *x, int *y);
+    std::string getMap(int room_id, int radius);
 
     friend class Mud;
+    friend class Checkpointer;
 };
 #endif // CLASS_ZONE
@@ -2,11 +2,12 @@
 
 #include <sstream>
 #include "mud.hpp"
+#include "password.hpp"
 #include "tools.hpp"
 
 bool AccountManager::m_Initialized = false;
 
-AccountManager::AccountManager(sqlite3 *db)
+AccountManager::AccountManager(Storage *storage)
 {
     if(m_Initialized)
     {
@@ -15,34 +16,15 @@ AccountManager::AccountManager(sqlite3 *db)
     }
     m_Initialized = true;
 
-    // database reference
-    m_DB = db;
+    m_Storage = storage;
 
-    // create new table if new
-    if(!tableExists(m_DB, "accounts"))
-    {
-        std::cout << "Creating new accounts table in database...\n";
-        std::stringstream ss;
-        char *errormsg = 0;
-        ss << "CREATE TABLE accounts( ";
-        ss << "account_id INTEGER PRIMARY KEY,";
-        ss << "account_name TEXT NOT NULL UNIQUE,";
-        ss << "account_password TEXT NOT NULL,";
-        ss << "current_room INTEGER";
-        ss << ");";
-
-        if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
-        {
-            std::cout << "Error creating accounts table:" << errormsg << std::endl;
-            sqlite3_free(errormsg);
-            return;
-        }
+    bool created = false;
+    if(!m_Storage->openAccounts(&created)) return;
 
-        // create test account
-        if(CREATE_TEST_ACCOUNT)
-        {
-            if(!createAccount("test", "test") ) std::cout << "Error creating test account.\n";
-        }
+    // create test account
+    if(created && CREATE_TEST_ACCOUNT)
+    {
+        if(!createAccount("test", "test") ) std::cout << "Error creating test account.\n";
     }
 }
 
@@ -51,75 +33,111 @@ AccountManager::~AccountManager()
 
 }
 
+// link-dead players are not counted, logging in takes their session back
 bool AccountManager::userLoggedIn(std::string username)
+{
+    Mud *mud = Mud::getInstance();
+    return mud->isPlayerOnline(username) && !mud->isPlayerLinkDead(username);
+}
+
+// returns NULL if storage could not be read
+CachedAccount *AccountManager::findAccount(std::string username)
 {
     username = formatUsername(username);
-    std::vector<std::string> players = Mud::getInstance()->getPlayerNames();
 
-    for(int i = 0; i < int(players.size()); i++)
+    std::unordered_map<std::string, CachedAccount>::iterator it = m_AccountCache.find(username);
+    if(it != m_AccountCache.end())
     {
-        if(username == players[i]) return true;
+        m_AccountLRU.splice(m_AccountLRU.begin(), m_AccountLRU, it->second.lru);
+        return &it->second;
     }
-    return false;
-}
 
-// 0 = successful login, 1 = bad username, 2 = bad password, 3 = already logged in, -1 some error
-int AccountManager::loginClient(Client *tclient, std::string username, std::string password)
-{
-    if(!tclient) return -1;
+    AccountRecord record;
+    if(!m_Storage->loadAccount(username, &record)) return NULL;
 
-    std::stringstream ss;
-    sqlite3_stmt *stmt;
-    int success = -1;
+    // accounts still waiting on a write are kept, the cache grows past its size until they are in
+    if(m_AccountCache.size() >= ACCOUNT_CACHE_SIZE) evictAccount();
 
-    // format username
-    username = formatUsername(username);
+    CachedAccount &account = m_AccountCache[username];
+    account.record = record;
+    account.written_by = 0;
+    m_AccountLRU.push_front(username);
+    account.lru = m_AccountLRU.begin();
+    return &account;
+}
 
-    if(userLoggedIn(username)) return 3;
+bool AccountManager::evictAccount()
+{
+    Checkpointer *checkpointer = Mud::getInstance()->m_Checkpointer;
 
-    // check database
-    ss << "SELECT account_name, account_password, current_room FROM accounts WHERE account_name='" << username << "';";
-    // compile sql statement to binary
-    int rc = sqlite3_prepare_v2(m_DB, ss.str().c_str(), -1, &stmt, NULL);
-    if( rc != SQLITE_OK)
+    for(std::list<std::string>::reverse_iterator it = m_AccountLRU.rbegin(); it != m_AccountLRU.rend(); it++)
     {
-        std::cout << "Error in sql compile:" << sqlite3_errmsg(m_DB) << std::endl;
-        sqlite3_finalize(stmt);
-        return -1;
-    }
-    // execute sql statement
-    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
-    {
-        std::string tuser = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt,0)) );
-        std::string tpass = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt,1)) );
-        int troom = sqlite3_column_int(stmt, 2);
+        CachedAccount &account = m_AccountCache[*it];
+        if(account.written_by > 0 && checkpointer && checkpointer->isWritten(account.written_by)) account.written_by = 0;
+        if(account.written_by) continue;
 
-        if(tuser == username)
-        {
-            if(tpass == password)
-            {
-                tclient->m_Username = username;
-                tclient->m_CurrentRoom = troom;
-                success = 0;
-            }
-            else success = 2;
-        }
-        else success = 1;
+        m_AccountCache.erase(*it);
+        m_AccountLRU.erase(std::next(it).base());
+        return true;
     }
-    if(rc != SQLITE_DONE)
+    return false;
+}
+
+void AccountManager::pinAccount(CachedAccount *account)
+{
+    Checkpointer *checkpointer = Mud::getInstance()->m_Checkpointer;
+    // without a checkpointer nothing says when the write is in, keep it
+    account->written_by = checkpointer ? checkpointer->nextCheckpoint() : -1;
+}
+
+bool AccountManager::getAccount(std::string username, std::string *stored, int *room_id)
+{
+    CachedAccount *account = findAccount(username);
+    if(!account || !account->record.exists) return false;
+
+    *stored = account->record.password;
+    *room_id = account->record.room_id;
+    return true;
+}
+
+bool AccountManager::completeLogin(Client *tclient, const std::string &username, int room_id)
+{
+    tclient->m_Username = username;
+    // another connection got in with the same account while this one was being checked
+    if(!Mud::getInstance()->addOnlinePlayer(tclient))
     {
-        std::cout << "Error in sql:" << sqlite3_errmsg(m_DB) << std::endl;
+        tclient->m_Username = "guest";
+        return false;
     }
-    sqlite3_finalize(stmt);
+    tclient->m_CurrentRoom = room_id;
+    std::cout << tclient->m_Username << " has logged in.\n";
+    return true;
+}
 
-    if(success == 0 ) std::cout << tclient->m_Username << " has logged in.\n";
-    return success;
+void AccountManager::credentialResult(const CredentialJob &tjob)
+{
+    Client *tclient = tjob.client;
+
+    // password was fine, store the new hash whether or not the client stuck around
+    if(tjob.type == CJ_VERIFY && tjob.rehashed) setPassword(tjob.username, tjob.stored);
+
+    if(!tclient || tclient->m_Leaving || !tclient->isConnected()) return;
+    resumeFlowCredentials(tclient, tjob);
 }
 
 bool AccountManager::createAccount(std::string username, std::string password)
 {
-    std::stringstream ss;
-    char *errormsg = 0;
+    std::string stored = hashPassword(password);
+    if(stored.empty())
+    {
+        std::cout << "Unable to create account, error hashing password.\n";
+        return false;
+    }
+    return addAccount(username, stored);
+}
+
+bool AccountManager::addAccount(std::string username, const std::string &stored)
+{
     // valid username?
     if(!stringIsValidUsername(username))
     {
@@ -137,248 +155,198 @@ bool AccountManager::createAccount(std::string username, std::string password)
     // format username (only first letter capitalized)
     username = formatUsername(username);
 
-    // create sqlite command
-    ss << "INSERT INTO ";
-    ss << "accounts(";
-    ss << "account_name,";
-    ss << "account_password,";
-    ss << "current_room) ";
-    ss << "VALUES(";
-    ss << "'" << username << "',";
-    ss << "'" << password << "',";
-    ss << "1";
-    ss << ");";
-
-    if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
-    {
-        std::cout << "Error creating accounts table:" << errormsg << std::endl;
-        sqlite3_free(errormsg);
-        return false;
-    }
+    // add account to storage, journaled after so a checkpoint that drops the record has the account
+    m_Storage->addAccount(username, stored, 1);
+    Journal *journal = Mud::getInstance()->m_Journal;
+    if(journal) journal->logAccount(username, stored, 1);
+
+    // account can be used before the write is committed, usernameTaken cached it as missing
+    CachedAccount *account = findAccount(username);
+    if(!account) return false;
+    account->record.exists = true;
+    account->record.password = stored;
+    account->record.room_id = 1;
+    pinAccount(account);
 
     return true;
 }
 
-bool AccountManager::usernameTaken(std::string username)
+bool AccountManager::setPassword(const std::string &username, const std::string &stored)
 {
-    std::stringstream ss;
-    sqlite3_stmt *stmt;
-    bool found_in_db = false;
+    m_Storage->setPassword(username, stored);
+    Journal *journal = Mud::getInstance()->m_Journal;
+    if(journal) journal->logPassword(username, stored);
 
-    username = formatUsername(username);
+    // cached until the write is in, so the next read sees the new password
+    CachedAccount *account = findAccount(username);
+    if(!account) return false;
+    account->record.password = stored;
+    pinAccount(account);
 
-    // check database
-    ss << "SELECT * FROM accounts WHERE account_name='" << username << "' COLLATE NOCASE;";
-    // compile sql statement to binary
-    int rc = sqlite3_prepare_v2(m_DB, ss.str().c_str(), -1, &stmt, NULL);
-    if( rc != SQLITE_OK)
+    return true;
+}
+
+void AccountManager::queuePlayerSave(const std::string &username, int room_id)
+{
+    m_PendingSaves[username] = room_id;
+
+    // cached record must match what is about to be written
+    std::unordered_map<std::string, CachedAccount>::iterator it = m_AccountCache.find(username);
+    if(it != m_AccountCache.end())
     {
-        std::cout << "Error in sql compile:" << sqlite3_errmsg(m_DB) << std::endl;
-        sqlite3_finalize(stmt);
-        return true;
+        it->second.record.room_id = room_id;
+        it->second.written_by = -1;
     }
-    // execute sql statement
-    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+}
+
+int AccountManager::flushPlayerSaves()
+{
+    if(m_PendingSaves.empty()) return 0;
+
+    // handing over empties the queue, the accounts are pinned after so the checkpoint number covers them
+    std::vector<std::string> names;
+    names.reserve(m_PendingSaves.size());
+    for(std::unordered_map<std::string, int>::iterator it = m_PendingSaves.begin(); it != m_PendingSaves.end(); it++)
+    {
+        names.push_back(it->first);
+    }
+
+    // written with the next checkpoint
+    Checkpointer *checkpointer = Mud::getInstance()->m_Checkpointer;
+    if(checkpointer && checkpointer->isRunning())
     {
-        found_in_db = true;
+        checkpointer->addPlayerRooms(&m_PendingSaves);
     }
-    if(rc != SQLITE_DONE)
+    else m_Storage->savePlayerRooms(m_PendingSaves);
+
+    for(int i = 0; i < int(names.size()); i++)
     {
-        std::cout << "Error in sql:" << sqlite3_errmsg(m_DB) << std::endl;
+        std::unordered_map<std::string, CachedAccount>::iterator it = m_AccountCache.find(names[i]);
+        if(it != m_AccountCache.end()) pinAccount(&it->second);
     }
-    sqlite3_finalize(stmt);
 
-    return found_in_db;
+    m_PendingSaves.clear();
+    return int(names.size());
 }
 
-int AccountManager::loginProcess(Client *tclient)
+bool AccountManager::usernameTaken(std::string username)
 {
-    if(!tclient) return 0;
+    CachedAccount *account = findAccount(username);
 
-    Mud *mud = Mud::getInstance();
+    // treat as taken if storage could not be checked
+    if(!account) return true;
+    return account->record.exists;
+}
 
-    // what step is the user in for logging in?
-    int login_state = tclient->m_IntRegisters[0];
+Flow AccountManager::loginFlow(Client *tclient)
+{
+    Mud *mud = Mud::getInstance();
+    AccountManager *amgr = mud->m_AccountManager;
+    bool logged_in = false;
 
-    // 0 - query - show login prompt
-    if(login_state == 0)
+    while(!logged_in)
     {
         tclient->send("User:\n");
-        tclient->clearStorage();
-        // check login name
-        tclient->m_IntRegisters[0] = 10;
-    }
-    // 10 - check username
-    else if(login_state == 10)
-    {
-        // store username
-        tclient->m_StrRegisters[0] = tclient->m_LastInput;
+        std::string username = co_await flowInput(tclient);
 
-        // if username is not invalid, give feedback and restart
-        if( !AccountManager::stringIsValidUsername(tclient->m_LastInput) )
+        if(!stringIsValidUsername(username))
         {
             tclient->send("Invalid username. Usernames may only contains alpha characters.\n");
-            tclient->m_IntRegisters[0] = 0;
-            tclient->func(tclient);
+            continue;
+        }
+        username = formatUsername(username);
+        if(amgr->userLoggedIn(username))
+        {
+            tclient->send("Already logged in!\n");
+            continue;
         }
-        // else, check if username exists or if its new, or if already logged in
-        else
+
+        // existing account
+        if(amgr->usernameTaken(username))
         {
-            // if username is an existing account
-            if(mud->m_AccountManager->usernameTaken(tclient->m_LastInput))
+            int tries = 0;
+            while(!logged_in)
             {
-                // if this user is already logged in
-                if(mud->m_AccountManager->userLoggedIn(tclient->m_LastInput))
+                if(tries >= LOGIN_PASSWORD_TRIES)
                 {
-                    tclient->send("Already logged in!\n");
-                    tclient->m_IntRegisters[0] = 0;
-                    tclient->func(tclient);
+                    tclient->send("Too many retries.\n");
+                    tclient->disconnect();
+                    co_return;
+                }
+                // slow down password guessing
+                if(tries) co_await flowSleep(tclient, LOGIN_RETRY_DELAY);
+                tries++;
+
+                tclient->send("Password:\n");
+                CredentialJob tjob;
+                tjob.type = CJ_VERIFY;
+                tjob.username = username;
+                tjob.password = co_await flowInput(tclient);
+                if(!amgr->getAccount(username, &tjob.stored, &tjob.room)) break;
+
+                // checked off the network thread
+                tjob = co_await flowCredentials(tclient, tjob);
+                if(!tjob.done)
+                {
+                    tclient->send("Server is busy, please try again.\n");
+                    tries--;
                 }
+                else if(!tjob.success) tclient->send("Incorrect password.  Please try again.\n");
+                // dropped session waiting for this player, carry on with it
+                else if(mud->reattachSession(tclient, username)) co_return;
+                else if(amgr->completeLogin(tclient, username, tjob.room)) logged_in = true;
+                // another connection got in with the same account while this one was being checked
                 else
                 {
-                    tclient->m_IntRegisters[0] = 20;
-                    tclient->func(tclient);
+                    tclient->send("Already logged in!\n");
+                    break;
                 }
             }
-            // this is username doesnt exist, query user if they want to make a new account
-            else
-            {
-                tclient->m_IntRegisters[0] = 50;
-                tclient->func(tclient);
-            }
-        }
-    }
-    // query for password
-    else if(login_state == 20)
-    {
-        // check password retry count
-        if(tclient->m_IntRegisters[1] >= 3)
-        {
-            tclient->send("Too many retries.\n");
-            tclient->disconnect();
-            return 0;
+            continue;
         }
 
-        tclient->send("Password:\n");
-        tclient->m_IntRegisters[0] = 21;
-    }
-    // check entered password
-    else if(login_state == 21 )
-    {
-        // store entered password
-        tclient->m_StrRegisters[1] = tclient->m_LastInput;
-
-        // try to login
-        int results = mud->m_AccountManager->loginClient(tclient, tclient->m_StrRegisters[0], tclient->m_StrRegisters[1]);
-        if(results == 0) tclient->m_IntRegisters[0] = 100;
-        // bad password
-        else if(results == 2)
-        {
-            tclient->send("Incorrect password.  Please try again.\n");
-            tclient->m_IntRegisters[1]++;
-            tclient->m_IntRegisters[0] = 20;
-        }
-        else tclient->m_IntRegisters[0] = 0;
-        tclient->func(tclient);
-    }
-    // query to make new account
-    else if(login_state == 50)
-    {
-        tclient->send("Create new user '" + formatUsername(tclient->m_StrRegisters[0]) + "'?  (y/n)\n");
-        tclient->m_IntRegisters[0] = 54;
-    }
-    // check make new account response
-    else if(login_state == 54)
-    {
-        std::string response = toLower(tclient->m_LastInput);
-        // if player wants to make new account, query for new password
-        if(response == "y" || response == "yes")
-        {
-            tclient->m_IntRegisters[0] = 60;
-            tclient->m_IntRegisters[1] = 0;
-            tclient->func(tclient);
-        }
-        // user didn't want to make a new account, go back to initial login query
-        else
-        {
-            tclient->m_IntRegisters[0] = 0;
-            tclient->func(tclient);
-        }
-    }
-    // query for new password
-    else if(login_state == 60)
-    {
-        tclient->send("Enter new password:\n");
-        tclient->m_IntRegisters[0] = 65;
-    }
-    // store new password, ask to re-enter password
-    else if(login_state == 65)
-    {
-        tclient->m_StrRegisters[1] = tclient->m_LastInput;
-        tclient->send("Re-enter password:\n");
-        tclient->m_IntRegisters[0] = 70;
-    }
-    // check that re-entered password patches first password
-    else if(login_state == 70)
-    {
-        // proceed to create account
-        if(tclient->m_StrRegisters[1] == tclient->m_LastInput)
-        {
-            tclient->m_IntRegisters[0] = 90;
-            tclient->func(tclient);
-        }
-        // passwords did not match, increment tries, then start over
-        // if too many tries, disconnect
-        else
-        {
-            tclient->m_IntRegisters[1]++;
-            if(tclient->m_IntRegisters[1] >= 3) tclient->disconnect();
-        }
-    }
-    // create account and login
-    else if(login_state == 90)
-    {
-        std::string newuser = tclient->m_StrRegisters[0];
-        std::string newpass = tclient->m_StrRegisters[1];
-        bool success = false;
-        // try to create account
-        if(mud->m_AccountManager->createAccount(newuser, newpass) )
+        // query to make new account
+        tclient->send("Create new user '" + username + "'?  (y/n)\n");
+        std::string response = toLower(co_await flowInput(tclient));
+        if(response != "y" && response != "yes") continue;
+
+        std::string password;
+        for(int tries = 0; ; tries++)
         {
-            // try to log into new account
-            if(mud->m_AccountManager->loginClient(tclient, newuser, newpass) == 0)
+            if(tries >= LOGIN_PASSWORD_TRIES)
             {
-                tclient->m_IntRegisters[0] = 100;
-                success = true;
+                tclient->send("Too many retries.\n");
+                tclient->disconnect();
+                co_return;
             }
+            tclient->send("Enter new password:\n");
+            password = co_await flowInput(tclient);
+            tclient->send("Re-enter password:\n");
+            if(co_await flowInput(tclient) == password) break;
+            tclient->send("Passwords do not match.\n");
         }
+
+        // password is hashed off the network thread
+        CredentialJob tjob;
+        tjob.type = CJ_CREATE;
+        tjob.username = username;
+        tjob.password = password;
+        tjob = co_await flowCredentials(tclient, tjob);
+
+        // new accounts start in room 1
+        if(!tjob.done) tclient->send("Server is busy, please try again.\n");
+        else if(tjob.success && amgr->addAccount(username, tjob.stored) && amgr->completeLogin(tclient, username, 1)) logged_in = true;
         // something went very wrong
-        if(!success)
-        {
-            tclient->send("There was an error trying to create new user.\n");
-            tclient->m_IntRegisters[0] = 0;
-        }
-        tclient->func(tclient);
+        else tclient->send("There was an error trying to create new user.\n");
     }
-    // finish login
-    else if(login_state == 100)
-    {
-        // for now (until char creation is implemented, set set current room to 1 if 0)
-        if(tclient->getRoom() == 0) tclient->setRoom(1);
-
-        // do an initial room look upon logging in
-        //tclient->parseCommand("look");
-
-        // clear input storage
-        tclient->clearStorage();
-        tclient->m_LastInput = "";
-        tclient->parseCommand("look");
-        tclient->sendPrompt();
-        tclient->func = Mud::mainGame;
-        //tclient->func(tclient);
-    }
-
 
-    return 0;
+    // finish login
+    // for now (until char creation is implemented, set set current room to 1 if 0)
+    if(tclient->getRoom() == 0) tclient->setRoom(1);
+    tclient->m_LastInput = "";
+    tclient->parseCommand("look");
+    tclient->sendPrompt();
+    tclient->func = Mud::mainGame;
 }
 
 bool AccountManager::stringIsValidUsername(std::string str)
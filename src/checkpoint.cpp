@@ -0,0 +1,212 @@
+#include "checkpoint.hpp"
+
+#include <iostream>
+#include "zone.hpp"
+
+bool Checkpointer::m_Initialized = false;
+
+Checkpointer::Checkpointer(ZoneManager *zonemgr, Storage *storage, Journal *journal)
+{
+    m_ZoneManager = zonemgr;
+    m_Storage = storage;
+    m_Journal = journal;
+    m_Thread = NULL;
+    m_Running = false;
+    m_Requested = 0;
+    m_Completed = 0;
+    m_Started = 0;
+    m_Written = 0;
+    // writes made before, like a journal replay, have to be in before the journal can go
+    m_ConfirmedMark = 0;
+
+    m_CheckpointCount = 0;
+    m_RoomCount = 0;
+    m_PlayerCount = 0;
+    m_TotalTime = 0;
+    m_MaxTime = 0;
+    m_TotalPause = 0;
+    m_MaxPause = 0;
+
+    if(m_Initialized)
+    {
+        std::cout << "Checkpointer already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+}
+
+Checkpointer::~Checkpointer()
+{
+    stop();
+}
+
+void Checkpointer::start()
+{
+    if(m_Running) return;
+    m_Running = true;
+    m_LastCheckpoint = m_Clock.getElapsedTime();
+
+    m_Thread = new sf::Thread(&Checkpointer::run, this);
+    m_Thread->launch();
+    std::cout << "Checkpoint thread started.\n";
+}
+
+void Checkpointer::stop()
+{
+    if(!m_Running) return;
+    m_WakeMutex.lock();
+    m_Running = false;
+    m_WakeMutex.unlock();
+    m_WakeUp.notify_one();
+
+    m_Thread->wait();
+    delete m_Thread;
+    m_Thread = NULL;
+
+    // whatever changed since the last checkpoint
+    checkpoint();
+}
+
+void Checkpointer::request()
+{
+    m_WakeMutex.lock();
+    m_Requested++;
+    m_WakeMutex.unlock();
+    m_WakeUp.notify_one();
+    if(!m_Running) checkpoint();
+}
+
+void Checkpointer::addPlayerRooms(std::unordered_map<std::string, int> *rooms)
+{
+    m_PlayerMutex.lock();
+    // journaled under the player mutex so each record lands in the journal file of the checkpoint that writes it
+    if(m_Journal)
+    {
+        for(std::unordered_map<std::string, int>::iterator it = rooms->begin(); it != rooms->end(); it++)
+        {
+            m_Journal->logPlayerRoom(it->first, it->second);
+        }
+    }
+    if(m_PlayerRooms.empty()) m_PlayerRooms.swap(*rooms);
+    else
+    {
+        // newer positions replace ones not yet written
+        for(std::unordered_map<std::string, int>::iterator it = rooms->begin(); it != rooms->end(); it++)
+        {
+            m_PlayerRooms[it->first] = it->second;
+        }
+        rooms->clear();
+    }
+    m_PlayerMutex.unlock();
+}
+
+void Checkpointer::flush()
+{
+    std::unique_lock<std::mutex> lock(m_WakeMutex);
+    long long target = ++m_Requested;
+    if(!m_Running)
+    {
+        lock.unlock();
+        checkpoint();
+        return;
+    }
+    m_WakeUp.notify_one();
+
+    // stop runs a last checkpoint that covers every request
+    while(m_Completed < target) m_Done.wait(lock);
+}
+
+void Checkpointer::run()
+{
+    std::unique_lock<std::mutex> lock(m_WakeMutex);
+    while(m_Running)
+    {
+        sf::Time waited = m_Clock.getElapsedTime() - m_LastCheckpoint;
+        if(m_Requested > m_Completed || waited >= sf::seconds(CHECKPOINT_INTERVAL))
+        {
+            lock.unlock();
+            checkpoint();
+            lock.lock();
+        }
+        else m_WakeUp.wait_for(lock, std::chrono::microseconds((sf::seconds(CHECKPOINT_INTERVAL) - waited).asMicroseconds()));
+    }
+}
+
+void Checkpointer::checkpoint()
+{
+    std::unordered_map<std::string, int> players;
+    int room_count = 0;
+    sf::Time pause;
+
+    m_CheckpointMutex.lock();
+    sf::Clock checkpoint_clock;
+    long long requested = m_Requested;
+    long long mark = m_Storage->writeMark();
+    long long number = ++m_Started;
+    m_LastCheckpoint = m_Clock.getElapsedTime();
+
+    m_PlayerMutex.lock();
+    players.swap(m_PlayerRooms);
+    // records so far are covered by this checkpoint, rooms changed after this are
+    // journaled again and taken below in their newest state either way
+    if(m_Journal) m_Journal->rotate();
+    m_PlayerMutex.unlock();
+
+    // only taking the changed room states pauses the game, copying them out for storage does not
+    bool written = m_ZoneManager->_SaveRooms(&room_count, &pause);
+    if(!players.empty()) m_Storage->savePlayerRooms(players);
+    // checkpoint is done once storage has it, the journal up to here is no longer needed
+    // a write that failed since the last confirmed checkpoint may only be in the journal
+    if(!m_Storage->flush(m_ConfirmedMark)) written = false;
+    if(written)
+    {
+        if(m_Journal) m_Journal->compact();
+        m_ConfirmedMark = mark;
+    }
+    else
+    {
+        std::cout << "Checkpoint not confirmed by storage, journal kept.\n";
+        // failed rooms are dirty again, players go back unless they moved since
+        m_PlayerMutex.lock();
+        for(std::unordered_map<std::string, int>::iterator it = players.begin(); it != players.end(); it++)
+        {
+            m_PlayerRooms.insert(*it);
+        }
+        m_PlayerMutex.unlock();
+    }
+
+    sf::Int64 checkpoint_time = checkpoint_clock.getElapsedTime().asMicroseconds();
+    sf::Int64 pause_time = pause.asMicroseconds();
+    m_CheckpointCount++;
+    m_RoomCount += room_count;
+    m_PlayerCount += int(players.size());
+    m_TotalTime += checkpoint_time;
+    if(checkpoint_time > m_MaxTime) m_MaxTime = checkpoint_time;
+    m_TotalPause += pause_time;
+    if(pause_time > m_MaxPause) m_MaxPause = pause_time;
+
+    if(written && (room_count || !players.empty()))
+    {
+        std::cout << "Checkpoint wrote " << room_count << " rooms and " << players.size() << " players in " << checkpoint_time / 1000;
+        std::cout << "ms, game paused " << pause_time << "us.\n";
+    }
+
+    if(written) m_Written = number;
+    m_WakeMutex.lock();
+    if(requested > m_Completed) m_Completed = requested;
+    m_WakeMutex.unlock();
+    m_Done.notify_all();
+    m_CheckpointMutex.unlock();
+}
+
+void Checkpointer::printStats()
+{
+    int checkpoint_count = m_CheckpointCount;
+    std::cout << "Checkpoints: " << checkpoint_count << " written with " << m_RoomCount << " rooms and " << m_PlayerCount << " players";
+    if(checkpoint_count)
+    {
+        std::cout << ", " << m_TotalTime / checkpoint_count << "us avg, " << m_MaxTime << "us max per checkpoint";
+        std::cout << ", game paused " << m_TotalPause / checkpoint_count << "us avg, " << m_MaxPause << "us max";
+    }
+    std::cout << ".\n";
+}
@@ -1,8 +1,8 @@
 #include "client.hpp"
 
 #include <iostream> // debug
+#include <utility>
 #include "mud.hpp"
-#include "direction.hpp"
 
 Client::Client(sf::TcpSocket *tsocket)
 {
@@ -11,48 +11,59 @@ Client::Client(sf::TcpSocket *tsocket)
 
     m_Username = "guest";
     m_CurrentRoom = 0;
+    m_Dirty = false;
 
-    // init storage
-    m_StrRegisters.resize(3);
-    m_IntRegisters.resize(3);
-    clearStorage();
-
-    // add general commands to for all clients
-    CommandManager *cmgr = Mud::getInstance()->m_CommandManager;
-    cmgr->addCommandToCommandList("quit", &m_CommandList);
-    cmgr->addCommandToCommandList("help", &m_CommandList);
-    cmgr->addCommandToCommandList("look", &m_CommandList);
-    cmgr->addCommandToCommandList("say", &m_CommandList);
-    // add all directions
-    for(int i = 0; i < DIR_COUNT; i++)
-    {
-        cmgr->addCommandToCommandList(dirs[i][0], &m_CommandList);
-    }
+    m_Zone = 0;
+    m_PendingEvents = 0;
+    m_Leaving = false;
+    m_LinkDead = false;
+    m_Quit = false;
+
+    m_InputRead = 0;
+
+    // general commands for all clients
+    m_CommandList = Mud::getInstance()->m_CommandManager->getPlayerCommands();
 }
 
 Client::~Client()
 {
+    endFlow(this);
     m_Socket->disconnect();
-    delete m_Socket;
+    Mud::getInstance()->releaseSocket(m_Socket);
 }
 
 void Client::disconnect()
 {
+    m_SendMutex.lock();
     m_Socket->disconnect();
     m_Connected = false;
+    m_SendMutex.unlock();
 }
 
-bool Client::setRoom(int room_id)
+void Client::quit()
 {
-    if(!Mud::getInstance()->m_ZoneManager->roomExists(room_id)) return false;
-    m_CurrentRoom = room_id;
-    return true;
+    m_Quit = true;
+    disconnect();
 }
 
-void Client::clearStorage()
+void Client::swapSocket(Client *tclient)
 {
-    for(int i = 0; i < int(m_StrRegisters.size()); i++) m_StrRegisters[i] = std::string();
-    for(int i = 0; i < int(m_IntRegisters.size()); i++) m_IntRegisters[i] = 0;
+    // zones may be sending to either client
+    m_SendMutex.lock();
+    tclient->m_SendMutex.lock();
+    std::swap(m_Socket, tclient->m_Socket);
+    bool connected = m_Connected;
+    m_Connected = bool(tclient->m_Connected);
+    tclient->m_Connected = connected;
+    tclient->m_SendMutex.unlock();
+    m_SendMutex.unlock();
+}
+
+bool Client::setRoom(int room_id)
+{
+    if(!Mud::getInstance()->m_ZoneManager->roomExists(room_id)) return false;
+    if(m_CurrentRoom.exchange(room_id) != room_id) m_Dirty = true;
+    return true;
 }
 
 bool Client::addToSelector(sf::SocketSelector *tselector)
@@ -68,7 +79,7 @@ bool Client::isReady(sf::SocketSelector *tselector)
     return tselector->isReady(*m_Socket);
 }
 
-bool Client::receive()
+bool Client::receive(std::string *input)
 {
     char data[CLIENT_RECEIVE_SIZE];
     size_t received = 0;
@@ -76,25 +87,35 @@ bool Client::receive()
     // terminate received data
     data[received-2] = '\0';
     // store received data as last input
-    m_LastInput = std::string(data);
+    if(input) *input = std::string(data);
+    else m_LastInput = std::string(data);
 
     return m_Connected;
 }
 
 bool Client::parseCommand(std::string str)
 {
-    return Mud::getInstance()->m_CommandManager->parseCommand(this, &m_CommandList, str);
+    return Mud::getInstance()->m_CommandManager->parseCommand(this, m_CommandList, str);
 }
 
 bool Client::showHelp(std::string str)
 {
-    return Mud::getInstance()->m_CommandManager->showHelp(this, &m_CommandList, str);
+    return Mud::getInstance()->m_CommandManager->showHelp(this, m_CommandList, str);
 }
 
 bool Client::send(std::string str)
 {
     if(str.empty()) return false;
+    // zones on different threads may send to the same client
+    m_SendMutex.lock();
+    // link-dead, nothing to send to until reconnected
+    if(!m_Connected)
+    {
+        m_SendMutex.unlock();
+        return false;
+    }
     if(m_Socket->send(str.c_str(), str.size()) == sf::Socket::Status::Disconnected) disconnect();
+    m_SendMutex.unlock();
     return m_Connected;
 }
 
@@ -10,6 +10,8 @@ bool CommandManager::m_Initialized = false;
 
 CommandManager::CommandManager()
 {
+    m_PlayerCommands = NULL;
+
     if(m_Initialized)
     {
         std::cout << "Commands already initialized!\n";
@@ -23,11 +25,36 @@ CommandManager::CommandManager()
     addAlias("l", "look");
     addNewCommand("help", "show command help", commandHelp);
     addNewCommand("say", "say something", say);
+    addNewCommand("tell", "say something to another player", tell);
+    addNewCommand("who", "list players online", commandWho);
+    addNewCommand("travel", "travel to a room number or player", commandTravel);
+    addNewCommand("map", "show map of the area", commandMap);
+    addNewCommand("open", "open a door", commandDoor);
+    addNewCommand("close", "close a door", commandDoor);
+    addNewCommand("enter", "go through a named exit", commandEnter);
     // add directions
     for(int i = 0; i < DIR_COUNT; i++)
     {
-        addNewCommand(dirs[i][0], "move " + dirs[i][0], commandMoveDirection);
-        addAlias(dirs[i][4], dirs[i][0]);
+        addNewCommand(dirs[i].name, std::string("move ") + dirs[i].name, commandMoveDirection);
+        addAlias(dirs[i].abbreviation, dirs[i].name);
+    }
+
+    // general commands for all clients
+    m_PlayerCommands = new CommandList;
+    addCommandToCommandList("quit", m_PlayerCommands);
+    addCommandToCommandList("help", m_PlayerCommands);
+    addCommandToCommandList("look", m_PlayerCommands);
+    addCommandToCommandList("say", m_PlayerCommands);
+    addCommandToCommandList("tell", m_PlayerCommands);
+    addCommandToCommandList("who", m_PlayerCommands);
+    addCommandToCommandList("travel", m_PlayerCommands);
+    addCommandToCommandList("map", m_PlayerCommands);
+    addCommandToCommandList("open", m_PlayerCommands);
+    addCommandToCommandList("close", m_PlayerCommands);
+    addCommandToCommandList("enter", m_PlayerCommands);
+    for(int i = 0; i < DIR_COUNT; i++)
+    {
+        addCommandToCommandList(dirs[i].name, m_PlayerCommands);
     }
 
     std::cout << m_Commands.size() << " commands and " << m_Aliases.size() << " aliases initialized.\n";
@@ -35,7 +62,7 @@ CommandManager::CommandManager()
 
 CommandManager::~CommandManager()
 {
-
+    delete m_PlayerCommands;
 }
 
 bool CommandManager::addNewCommand(std::string cmd, std::string help, int (*func)(Client *tclient, std::string cmd, std::string args))
@@ -101,7 +128,7 @@ bool CommandManager::addCommandToCommandList(std::string cmd, CommandList *cmdli
     Command *tcmd = NULL;
 
     // find command
-    for(int i = 0; int(m_Commands.size()); i++)
+    for(int i = 0; i < int(m_Commands.size()); i++)
     {
         if(m_Commands[i]->cmd == cmd)
         {
@@ -219,7 +246,19 @@ bool CommandManager::parseCommand(Client *tclient, CommandList *tlist, std::stri
 int CommandManager::commandQuit(Client *tclient, std::string cmd, std::string args)
 {
     tclient->send("Goodbye!\n");
-    tclient->disconnect();
+    tclient->quit();
+    return 0;
+}
+
+int CommandManager::commandWho(Client *tclient, std::string cmd, std::string args)
+{
+    std::string text = "Players online:\n";
+    int count = Mud::getInstance()->appendOnlinePlayers(&text);
+
+    std::stringstream ss;
+    ss << count << (count == 1 ? " player" : " players") << " online.\n";
+    text.append(ss.str());
+    tclient->send(text);
     return 0;
 }
 
@@ -230,37 +269,19 @@ int CommandManager::commandLook(Client *tclient, std::string cmd, std::string ar
     {
         int room = tclient->getRoom();
         Mud *mud = Mud::getInstance();
-        std::vector<std::string> room_exits = mud->m_ZoneManager->getExits(room);
-        std::vector<std::string> players = mud->getPlayerNames(room);
-
-        std::stringstream rss;
 
-        // room name/description
-        rss << mud->m_ZoneManager->getRoomName(room) << std::endl;
-        rss << mud->m_ZoneManager->getRoomDescription(room) << std::endl;
-
-        rss << std::endl;
+        // room name/description and exits are rendered once per room, only players are added here
+        std::string text;
+        std::string exits;
+        if(!mud->m_ZoneManager->getRoomLook(room, &text, &exits)) exits = "[ No obvious exits ]\n";
 
         // get players here
-        for(int i = 0; i < int(players.size()); i++)
-        {
-            if(players[i] != tclient->getName()) rss << players[i] << " is here.\n";
-        }
+        mud->appendPlayersHere(room, tclient, &text);
 
         // room exits
-        rss << "[ ";
-        if(!room_exits.empty())
-        {
-            for(int i = 0; i < int(room_exits.size()); i++)
-            {
-                rss << room_exits[i];
-                if(i != int(room_exits.size())-1) rss << " - ";
-            }
-        }
-        else rss << "No obvious exits";
-        rss << " ]\n";
+        text += exits;
 
-        tclient->send(rss.str());
+        tclient->send(text);
     }
     return 0;
 }
@@ -294,17 +315,122 @@ int CommandManager::commandMoveDirection(Client *tclient, std::string cmd, std::
     t_room_id = Mud::getInstance()->m_ZoneManager->getRoomNumInDirection(tclient->getRoom(), dir_index);
     if(!t_room_id)
     {
-        tclient->send("You see no exit " + dirs[dir_index][0] + ".\n");
+        tclient->send(std::string("You see no exit ") + dirs[dir_index].name + ".\n");
+        return 0;
+    }
+    if(Mud::getInstance()->m_ZoneManager->getExitFlags(tclient->getRoom(), dir_index) & EXIT_CLOSED)
+    {
+        tclient->send(std::string("The door ") + dirs[dir_index].name + " is closed.\n");
         return 0;
     }
 
-    // there is a room in that direction, set room and do a room look
-    tclient->setRoom(t_room_id);
+    // there is a room in that direction, move there and do a room look
+    moveClient(tclient, t_room_id, dirs[dir_index].leave_msg, dirs[dirs[dir_index].opposite].arrive_msg);
     tclient->parseCommand("look");
 
     return 0;
 }
 
+int CommandManager::commandTravel(Client *tclient, std::string cmd, std::string args)
+{
+    Mud *mud = Mud::getInstance();
+    int target_room = 0;
+    std::vector<std::string> route;
+
+    if(args.empty())
+    {
+        tclient->send("Travel where?\n");
+        return 0;
+    }
+
+    // target is either a room number or a player name
+    if(isNumber(args)) target_room = atoi(args.c_str());
+    else target_room = mud->getPlayerRoom(args);
+
+    if(!mud->m_ZoneManager->roomExists(target_room))
+    {
+        tclient->send("You don't know how to get there.\n");
+        return 0;
+    }
+    if(target_room == tclient->getRoom())
+    {
+        tclient->send("You are already there.\n");
+        return 0;
+    }
+    if(!mud->m_ZoneManager->findPath(tclient->getRoom(), target_room, &route))
+    {
+        tclient->send("You can't find a way there.\n");
+        return 0;
+    }
+
+    // follow route one room at a time, stop if the way was blocked since the route was found
+    ZoneManager *zmgr = mud->m_ZoneManager;
+    std::stringstream rss;
+    int steps = 0;
+    rss << "You travel";
+    for(int i = 0; i < int(route.size()); i++)
+    {
+        int room = tclient->getRoom();
+        int dir_index = getDirectionIndex(route[i]);
+        int flags = 0;
+        int t_room_id = 0;
+        if(dir_index != -1)
+        {
+            t_room_id = zmgr->getRoomNumInDirection(room, dir_index);
+            flags = zmgr->getExitFlags(room, dir_index);
+        }
+        else t_room_id = zmgr->getNamedExit(room, route[i], &flags);
+        if(!t_room_id || (flags & EXIT_CLOSED)) break;
+
+        bool moved = false;
+        if(dir_index != -1) moved = moveClient(tclient, t_room_id, dirs[dir_index].leave_msg, dirs[dirs[dir_index].opposite].arrive_msg);
+        else moved = moveClient(tclient, t_room_id, "left through the " + route[i], "arrived");
+        if(!moved) break;
+
+        if(steps) rss << ",";
+        rss << " " << route[i];
+        steps++;
+    }
+    rss << ".\n";
+    if(steps) tclient->send(rss.str());
+    if(steps != int(route.size())) tclient->send("Your way is blocked.\n");
+    if(steps) tclient->parseCommand("look");
+
+    return 0;
+}
+
+int CommandManager::commandMap(Client *tclient, std::string cmd, std::string args)
+{
+    ZoneManager *zmgr = Mud::getInstance()->m_ZoneManager;
+    int room = tclient->getRoom();
+    int radius = MAP_DEFAULT_RADIUS;
+    int x = 0;
+    int y = 0;
+
+    if(!args.empty())
+    {
+        if(!isNumber(args))
+        {
+            tclient->send("Usage: map [radius]\n");
+            return 0;
+        }
+        radius = atoi(args.c_str());
+    }
+
+    if(!zmgr->getRoomPosition(room, &x, &y))
+    {
+        tclient->send("You can't make out a map here.\n");
+        return 0;
+    }
+
+    std::stringstream mss;
+    mss << zmgr->getRoomZone(room) << " (" << x << ", " << y << ")\n";
+    mss << zmgr->getMap(room, radius);
+    tclient->send(mss.str());
+
+    return 0;
+}
+
 ////////////////////////////////////////////////////////////////
 // COMMAND LIST
 CommandList::CommandList()
@@ -335,3 +461,74 @@ bool CommandList::hasCommand(std::string cmd)
 
     return false;
 }
+
+// open or close door in a direction
+int CommandManager::commandDoor(Client *tclient, std::string cmd, std::string args)
+{
+    ZoneManager *zmgr = Mud::getInstance()->m_ZoneManager;
+    bool closing = (cmd == "close");
+    int dir_index = getDirectionIndex(args);
+
+    if(dir_index == -1)
+    {
+        tclient->send(capitalize(cmd) + " which direction?\n");
+        return 0;
+    }
+
+    int flags = zmgr->getExitFlags(tclient->getRoom(), dir_index);
+    if(!(flags & EXIT_DOOR) || (flags & EXIT_HIDDEN))
+    {
+        tclient->send(std::string("There is no door ") + dirs[dir_index].name + ".\n");
+        return 0;
+    }
+    if(bool(flags & EXIT_CLOSED) == closing)
+    {
+        tclient->send(std::string("The door ") + dirs[dir_index].name + " is already " + (closing ? "closed" : "open") + ".\n");
+        return 0;
+    }
+
+    zmgr->setDoorClosed(tclient->getRoom(), dir_index, closing);
+    tclient->send("You " + cmd + " the door " + dirs[dir_index].name + ".\n");
+    Mud::getInstance()->broadcastToRoomExcluding(tclient->getRoom(), tclient->getName() + " " + cmd + "s the door " + dirs[dir_index].name + ".\n", tclient);
+    return 0;
+}
+
+// go through exit that is not a direction, like a portal
+int CommandManager::commandEnter(Client *tclient, std::string cmd, std::string args)
+{
+    ZoneManager *zmgr = Mud::getInstance()->m_ZoneManager;
+    int flags = 0;
+
+    if(args.empty())
+    {
+        tclient->send("Enter what?\n");
+        return 0;
+    }
+
+    int t_room_id = zmgr->getNamedExit(tclient->getRoom(), args, &flags);
+    if(!t_room_id)
+    {
+        tclient->send("You see no " + args + " here.\n");
+        return 0;
+    }
+    if(flags & EXIT_CLOSED)
+    {
+        tclient->send("The " + args + " is closed.\n");
+        return 0;
+    }
+
+    moveClient(tclient, t_room_id, "left through the " + args, "arrived");
+    tclient->parseCommand("look");
+    return 0;
+}
+
+bool CommandManager::moveClient(Client *tclient, int to_room, const std::string &leave_msg, const std::string &arrive_msg)
+{
+    Mud *mud = Mud::getInstance();
+    int from_room = tclient->getRoom();
+
+    if(!tclient->setRoom(to_room)) return false;
+    mud->broadcastToRoomExcluding(from_room, tclient->getName() + " " + leave_msg + ".\n", tclient);
+    mud->broadcastToRoomExcluding(to_room, tclient->getName() + " " + arrive_msg + ".\n", tclient);
+    return true;
+}
@@ -0,0 +1,133 @@
+#include "credentials.hpp"
+
+#include <iostream>
+#include "client.hpp"
+#include "password.hpp"
+
+bool CredentialPool::m_Initialized = false;
+
+CredentialPool::CredentialPool()
+{
+    if(m_Initialized)
+    {
+        std::cout << "Credential pool already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+
+    m_Outstanding = 0;
+    m_Running = false;
+}
+
+CredentialPool::~CredentialPool()
+{
+    stop();
+}
+
+void CredentialPool::start()
+{
+    if(m_Running) return;
+    m_Running = true;
+
+    for(int i = 0; i < CREDENTIAL_WORKER_THREADS; i++)
+    {
+        sf::Thread *worker = new sf::Thread(&CredentialPool::run, this);
+        m_Workers.push_back(worker);
+        worker->launch();
+    }
+    std::cout << CREDENTIAL_WORKER_THREADS << " credential worker threads started.\n";
+}
+
+void CredentialPool::stop()
+{
+    if(!m_Running) return;
+
+    // set under the job mutex so a worker can not miss the wake up between checking and waiting
+    m_JobMutex.lock();
+    m_Running = false;
+    m_JobMutex.unlock();
+    m_JobReady.notify_all();
+
+    for(int i = 0; i < int(m_Workers.size()); i++)
+    {
+        m_Workers[i]->wait();
+        delete m_Workers[i];
+    }
+    m_Workers.clear();
+}
+
+void CredentialPool::run()
+{
+    while(true)
+    {
+        CredentialJob tjob;
+        {
+            std::unique_lock<std::mutex> lock(m_JobMutex);
+            while(m_Running && m_Jobs.empty()) m_JobReady.wait(lock);
+            if(!m_Running) break;
+            tjob = m_Jobs.front();
+            m_Jobs.pop_front();
+        }
+
+        if(tjob.type == CJ_VERIFY)
+        {
+            tjob.success = verifyPassword(tjob.password, tjob.stored);
+            // upgrade while the plaintext is at hand
+            if(tjob.success && passwordNeedsRehash(tjob.stored))
+            {
+                std::string rehash = hashPassword(tjob.password);
+                if(!rehash.empty())
+                {
+                    tjob.stored = rehash;
+                    tjob.rehashed = true;
+                }
+            }
+        }
+        else
+        {
+            tjob.stored = hashPassword(tjob.password);
+            tjob.success = !tjob.stored.empty();
+        }
+        // plaintext is not needed past here
+        tjob.password.clear();
+        tjob.done = true;
+
+        m_FinishedMutex.lock();
+        m_Finished.push_back(tjob);
+        m_FinishedMutex.unlock();
+    }
+}
+
+bool CredentialPool::submit(const CredentialJob &tjob)
+{
+    if(!m_Running) return false;
+
+    // outstanding only drops on the network thread, which is the only one submitting
+    if(m_Outstanding >= CREDENTIAL_QUEUE_SIZE) return false;
+    m_Outstanding++;
+
+    // client can not be removed while a job refers to it
+    if(tjob.client) tjob.client->m_PendingEvents++;
+
+    m_JobMutex.lock();
+    m_Jobs.push_back(tjob);
+    m_JobMutex.unlock();
+    m_JobReady.notify_one();
+    return true;
+}
+
+void CredentialPool::takeFinished(std::vector<CredentialJob> *jobs)
+{
+    int first = int(jobs->size());
+
+    m_FinishedMutex.lock();
+    jobs->insert(jobs->end(), m_Finished.begin(), m_Finished.end());
+    m_Finished.clear();
+    m_FinishedMutex.unlock();
+
+    m_Outstanding -= int(jobs->size()) - first;
+    for(int i = first; i < int(jobs->size()); i++)
+    {
+        if((*jobs)[i].client) (*jobs)[i].client->m_PendingEvents--;
+    }
+}
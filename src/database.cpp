@@ -0,0 +1,586 @@
+#include "database.hpp"
+
+#include <cstdio>
+#include <iostream>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// write file (or directory, not on windows) through to disk, false on error
+static bool syncFile(const std::string &file)
+{
+#ifdef _WIN32
+    HANDLE handle = CreateFileA(file.c_str(), GENERIC_WRITE, FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(handle == INVALID_HANDLE_VALUE) return false;
+    bool synced = FlushFileBuffers(handle) != 0;
+    CloseHandle(handle);
+    return synced;
+#else
+    int fd = ::open(file.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    bool synced = fsync(fd) == 0;
+    ::close(fd);
+    return synced;
+#endif
+}
+
+sqlite3 *openDatabase(const std::string &file, bool read_only)
+{
+    sqlite3 *db = NULL;
+    int flags = read_only ? SQLITE_OPEN_READONLY : (SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE);
+
+    if(sqlite3_open_v2(file.c_str(), &db, flags, NULL) != SQLITE_OK)
+    {
+        std::cout << "Error opening database " << file << ":" << sqlite3_errmsg(db) << std::endl;
+        sqlite3_close(db);
+        return NULL;
+    }
+    sqlite3_busy_timeout(db, DB_BUSY_TIMEOUT);
+
+    // journal mode is stored in the database file, so only writable connections set it
+    if(!read_only)
+    {
+        char *errormsg = 0;
+        if(sqlite3_exec(db, "PRAGMA journal_mode=WAL;", NULL, NULL, &errormsg) != SQLITE_OK)
+        {
+            std::cout << "Error setting WAL mode:" << errormsg << std::endl;
+            sqlite3_free(errormsg);
+        }
+    }
+
+    return db;
+}
+
+//////////////////////////////////////////////////////////////////
+// WRITES
+
+void DatabaseStatement::bind(sf::Int64 number)
+{
+    values.push_back(DatabaseValue());
+    values.back().type = DB_VALUE_INT;
+    values.back().number = number;
+}
+
+void DatabaseStatement::bind(const std::string &text)
+{
+    values.push_back(DatabaseValue());
+    values.back().type = DB_VALUE_TEXT;
+    values.back().text = text;
+}
+
+DatabaseStatement *DatabaseWrite::add(const std::string &sql)
+{
+    statements.push_back(DatabaseStatement());
+    statements.back().sql = sql;
+    return &statements.back();
+}
+
+bool DatabaseWriter::m_Initialized = false;
+
+DatabaseWriter::DatabaseWriter(const std::string &file)
+{
+    m_DB = NULL;
+    m_Statements = NULL;
+    m_Thread = NULL;
+    m_Running = false;
+    m_Submitted = 0;
+    m_Committed = 0;
+    m_FlushTarget = 0;
+    m_LastFailed = 0;
+
+    m_GroupCount = 0;
+    m_WriteCount = 0;
+    m_ErrorCount = 0;
+    m_TotalCommitTime = 0;
+    m_MaxCommitTime = 0;
+
+    m_BackupFile = file + DB_BACKUP_SUFFIX;
+    m_BackupDB = NULL;
+    m_Backup = NULL;
+    m_BackupPages = DB_BACKUP_PAGES;
+    m_BackupRequested = false;
+    m_BackupCount = 0;
+    m_BackupErrorCount = 0;
+    m_BackupStepCount = 0;
+    m_MaxBackupStep = 0;
+    m_LastBackupTime = 0;
+    m_LastBackupPageCount = 0;
+
+    if(m_Initialized)
+    {
+        std::cout << "Database writer already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+
+    m_DB = openDatabase(file);
+    if(m_DB) m_Statements = StatementCache::getCache(m_DB);
+}
+
+DatabaseWriter::~DatabaseWriter()
+{
+    stop();
+
+    if(m_DB)
+    {
+        StatementCache::closeCache(m_DB);
+        sqlite3_close(m_DB);
+    }
+}
+
+void DatabaseWriter::start()
+{
+    if(m_Running || !m_DB) return;
+    m_Running = true;
+
+    m_Thread = new sf::Thread(&DatabaseWriter::run, this);
+    m_Thread->launch();
+    std::cout << "Database writer thread started.\n";
+}
+
+void DatabaseWriter::stop()
+{
+    if(!m_Running) return;
+
+    m_QueueMutex.lock();
+    m_Running = false;
+    m_QueueMutex.unlock();
+    m_QueueReady.notify_one();
+
+    // writer empties the queue before it finishes
+    m_Thread->wait();
+    delete m_Thread;
+    m_Thread = NULL;
+}
+
+void DatabaseWriter::submit(const DatabaseWrite &twrite)
+{
+    m_QueueMutex.lock();
+    // no writer thread, write on the calling thread
+    if(!m_Running)
+    {
+        m_QueueMutex.unlock();
+        if(!m_DB) return;
+        std::vector<DatabaseWrite> group(1, twrite);
+        group[0].number = ++m_Submitted;
+        commitGroup(&group);
+        addCommitted(1);
+        return;
+    }
+    m_Queue.push_back(twrite);
+    m_Queue.back().queued = m_Clock.getElapsedTime();
+    m_Queue.back().number = ++m_Submitted;
+    // writer times the group from the first write and wakes early for a full one
+    bool wake = m_Queue.size() == 1 || int(m_Queue.size()) == DB_WRITE_GROUP_SIZE;
+    m_QueueMutex.unlock();
+    if(wake) m_QueueReady.notify_one();
+}
+
+void DatabaseWriter::flush()
+{
+    long long target = m_Submitted;
+    if(m_Committed >= target) return;
+
+    std::unique_lock<std::mutex> lock(m_QueueMutex);
+    // writer commits at once instead of waiting for the group to fill up
+    if(m_FlushTarget < target) m_FlushTarget = target;
+    m_QueueReady.notify_one();
+
+    while(m_Committed < target) m_CommitDone.wait(lock);
+}
+
+void DatabaseWriter::requestBackup()
+{
+    m_QueueMutex.lock();
+    m_BackupRequested = true;
+    m_QueueMutex.unlock();
+    m_QueueReady.notify_one();
+}
+
+// counted under the queue mutex so a flush can not miss the wake up between checking and waiting
+void DatabaseWriter::addCommitted(int count)
+{
+    m_QueueMutex.lock();
+    m_Committed += count;
+    m_QueueMutex.unlock();
+    m_CommitDone.notify_all();
+}
+
+void DatabaseWriter::waitForWork(std::unique_lock<std::mutex> &lock)
+{
+    while(m_Running && !m_Backup && !m_BackupRequested)
+    {
+        if(int(m_Queue.size()) >= DB_WRITE_GROUP_SIZE) return;
+        if(!m_Queue.empty() && m_FlushTarget > m_Committed) return;
+
+        // next thing due, the oldest write's group time or the backup interval
+        bool timed = false;
+        sf::Time wake;
+        if(!m_Queue.empty())
+        {
+            wake = m_Queue.front().queued + sf::milliseconds(DB_WRITE_GROUP_TIME);
+            timed = true;
+        }
+        if(DB_BACKUP_INTERVAL > 0)
+        {
+            sf::Time backup_due = m_LastBackup + sf::seconds(DB_BACKUP_INTERVAL);
+            if(!timed || backup_due < wake) wake = backup_due;
+            timed = true;
+        }
+
+        if(!timed) m_QueueReady.wait(lock);
+        else
+        {
+            sf::Time now = m_Clock.getElapsedTime();
+            if(wake <= now) return;
+            m_QueueReady.wait_for(lock, std::chrono::microseconds((wake - now).asMicroseconds()));
+        }
+    }
+}
+
+void DatabaseWriter::run()
+{
+    std::vector<DatabaseWrite> group;
+
+    while(true)
+    {
+        std::unique_lock<std::mutex> lock(m_QueueMutex);
+        waitForWork(lock);
+        bool running = m_Running;
+        bool ready = false;
+        if(!m_Queue.empty())
+        {
+            ready = !running || int(m_Queue.size()) >= DB_WRITE_GROUP_SIZE || m_FlushTarget > m_Committed
+                    || (m_Clock.getElapsedTime() - m_Queue.front().queued) >= sf::milliseconds(DB_WRITE_GROUP_TIME);
+        }
+        if(ready)
+        {
+            while(!m_Queue.empty() && int(group.size()) < DB_WRITE_GROUP_SIZE)
+            {
+                group.push_back(DatabaseWrite());
+                group.back().statements.swap(m_Queue.front().statements);
+                group.back().number = m_Queue.front().number;
+                m_Queue.pop_front();
+            }
+        }
+        bool queue_empty = m_Queue.empty();
+        lock.unlock();
+
+        if(group.empty())
+        {
+            if(!running && queue_empty) break;
+            stepBackup();
+            continue;
+        }
+
+        commitGroup(&group);
+        addCommitted(int(group.size()));
+        group.clear();
+
+        // a few pages between groups, so writes never wait long behind the backup
+        stepBackup();
+    }
+
+    // not worth holding up shutdown for, the last finished backup is kept
+    if(m_Backup)
+    {
+        std::cout << "Database backup not finished at shutdown, dropped.\n";
+        endBackup(false);
+    }
+}
+
+int DatabaseWriter::commitGroup(std::vector<DatabaseWrite> *group)
+{
+    sf::Clock commit_clock;
+    char *errormsg = 0;
+    int error_count = 0;
+
+    // writes made after stop can run while the writer thread finishes the queue
+    m_WriteMutex.lock();
+
+    // take the write lock up front, readers are not held up by it
+    if(sqlite3_exec(m_DB, "BEGIN IMMEDIATE;", NULL, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error starting write group, " << group->size() << " writes lost:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+        m_ErrorCount += int(group->size());
+        if(group->back().number > m_LastFailed) m_LastFailed = group->back().number;
+        m_WriteMutex.unlock();
+        return int(group->size());
+    }
+
+    long long last_failed = 0;
+    for(int i = 0; i < int(group->size()); i++)
+    {
+        // a write that fails is undone without undoing the rest of the group
+        sqlite3_exec(m_DB, "SAVEPOINT write;", NULL, NULL, NULL);
+        if(!runWrite((*group)[i]))
+        {
+            error_count++;
+            last_failed = (*group)[i].number;
+            sqlite3_exec(m_DB, "ROLLBACK TO write;", NULL, NULL, NULL);
+        }
+        sqlite3_exec(m_DB, "RELEASE write;", NULL, NULL, NULL);
+    }
+
+    if(sqlite3_exec(m_DB, "COMMIT;", NULL, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error committing write group, " << group->size() << " writes lost:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+        sqlite3_exec(m_DB, "ROLLBACK;", NULL, NULL, NULL);
+        error_count = int(group->size());
+        last_failed = group->back().number;
+    }
+    // set before the group counts as committed, so a flush waiting on it sees the failure
+    if(last_failed > m_LastFailed) m_LastFailed = last_failed;
+
+    sf::Int64 commit_time = commit_clock.getElapsedTime().asMicroseconds();
+    m_GroupCount++;
+    m_WriteCount += int(group->size());
+    m_ErrorCount += error_count;
+    m_TotalCommitTime += commit_time;
+    if(commit_time > m_MaxCommitTime) m_MaxCommitTime = commit_time;
+    m_WriteMutex.unlock();
+
+    return error_count;
+}
+
+bool DatabaseWriter::runWrite(const DatabaseWrite &twrite)
+{
+    for(int i = 0; i < int(twrite.statements.size()); i++)
+    {
+        const DatabaseStatement &tstatement = twrite.statements[i];
+        sqlite3_stmt *stmt = m_Statements->acquire(tstatement.sql);
+        if(!stmt) return false;
+
+        for(int j = 0; j < int(tstatement.values.size()); j++)
+        {
+            const DatabaseValue &tvalue = tstatement.values[j];
+            if(tvalue.type == DB_VALUE_INT) sqlite3_bind_int64(stmt, j + 1, tvalue.number);
+            else if(tvalue.type == DB_VALUE_TEXT) sqlite3_bind_text(stmt, j + 1, tvalue.text.c_str(), -1, SQLITE_TRANSIENT);
+            else sqlite3_bind_null(stmt, j + 1);
+        }
+
+        int rc = 0;
+        while((rc = m_Statements->step(stmt)) == SQLITE_ROW);
+        if(rc != SQLITE_DONE)
+        {
+            std::cout << "Error in queued write:" << sqlite3_errmsg(m_DB) << "\n  " << tstatement.sql << std::endl;
+            m_Statements->release(stmt);
+            return false;
+        }
+        m_Statements->release(stmt);
+    }
+
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////
+// BACKUP
+
+// expects to be on the writer thread
+bool DatabaseWriter::beginBackup()
+{
+    std::string temp_file = m_BackupFile + ".tmp";
+    remove(temp_file.c_str());
+
+    if(sqlite3_open_v2(temp_file.c_str(), &m_BackupDB, SQLITE_OPEN_READWRITE | SQLITE_OPEN_CREATE, NULL) != SQLITE_OK)
+    {
+        std::cout << "Error opening database backup " << temp_file << ":" << sqlite3_errmsg(m_BackupDB) << std::endl;
+        sqlite3_close(m_BackupDB);
+        m_BackupDB = NULL;
+        m_BackupErrorCount++;
+        return false;
+    }
+    // the temporary file is thrown away unless the backup finishes, so no journal or sync per step,
+    // it is synced once when done
+    sqlite3_exec(m_BackupDB, "PRAGMA journal_mode=OFF; PRAGMA synchronous=OFF;", NULL, NULL, NULL);
+
+    m_Backup = sqlite3_backup_init(m_BackupDB, "main", m_DB, "main");
+    if(!m_Backup)
+    {
+        std::cout << "Error starting database backup:" << sqlite3_errmsg(m_BackupDB) << std::endl;
+        sqlite3_close(m_BackupDB);
+        m_BackupDB = NULL;
+        remove(temp_file.c_str());
+        m_BackupErrorCount++;
+        return false;
+    }
+
+    m_BackupClock.restart();
+    std::cout << "Database backup to " << m_BackupFile << " started.\n";
+    return true;
+}
+
+// expects to be on the writer thread
+void DatabaseWriter::stepBackup()
+{
+    if(!m_Backup)
+    {
+        bool due = m_BackupRequested;
+        if(DB_BACKUP_INTERVAL > 0 && m_Clock.getElapsedTime() - m_LastBackup >= sf::seconds(DB_BACKUP_INTERVAL)) due = true;
+        if(!due) return;
+
+        // a backup that fails to start waits for the next interval too
+        m_BackupRequested = false;
+        m_LastBackup = m_Clock.getElapsedTime();
+        if(!beginBackup()) return;
+    }
+
+    sf::Clock step_clock;
+    int rc = sqlite3_backup_step(m_Backup, m_BackupPages);
+    sf::Int64 step_time = step_clock.getElapsedTime().asMicroseconds();
+    m_BackupStepCount++;
+    if(step_time > m_MaxBackupStep) m_MaxBackupStep = step_time;
+
+    if(rc == SQLITE_DONE) endBackup(true);
+    // busy or locked, try again next step
+    else if(rc != SQLITE_OK && rc != SQLITE_BUSY && rc != SQLITE_LOCKED)
+    {
+        std::cout << "Error in database backup:" << sqlite3_errstr(rc) << std::endl;
+        endBackup(false);
+    }
+}
+
+// expects to be on the writer thread
+void DatabaseWriter::endBackup(bool done)
+{
+    std::string temp_file = m_BackupFile + ".tmp";
+    int page_count = sqlite3_backup_pagecount(m_Backup);
+    int rc = sqlite3_backup_finish(m_Backup);
+    m_Backup = NULL;
+    sqlite3_close(m_BackupDB);
+    m_BackupDB = NULL;
+
+    if(!done || rc != SQLITE_OK)
+    {
+        if(done) std::cout << "Error finishing database backup:" << sqlite3_errstr(rc) << std::endl;
+        remove(temp_file.c_str());
+        m_BackupErrorCount++;
+        return;
+    }
+
+    // copy was written without syncing, it has to be on disk before it replaces the last backup
+    if(!syncFile(temp_file))
+    {
+        std::cout << "Error syncing database backup " << temp_file << std::endl;
+        remove(temp_file.c_str());
+        m_BackupErrorCount++;
+        return;
+    }
+
+    // only a finished copy replaces the last backup, rename over it is atomic except on windows
+#ifdef _WIN32
+    remove(m_BackupFile.c_str());
+#endif
+    if(rename(temp_file.c_str(), m_BackupFile.c_str()) != 0)
+    {
+        std::cout << "Error moving database backup to " << m_BackupFile << std::endl;
+        m_BackupErrorCount++;
+        return;
+    }
+#ifndef _WIN32
+    // and the rename itself
+    size_t slash = m_BackupFile.find_last_of('/');
+    syncFile(slash == std::string::npos ? "." : m_BackupFile.substr(0, slash + 1));
+#endif
+
+    m_BackupCount++;
+    m_LastBackupTime = m_BackupClock.getElapsedTime().asMilliseconds();
+    m_LastBackupPageCount = page_count;
+    std::cout << "Database backup of " << page_count << " pages finished in " << m_LastBackupTime << "ms.\n";
+}
+
+void DatabaseWriter::printStats()
+{
+    int group_count = m_GroupCount;
+    std::cout << "Database writer: " << m_WriteCount << " writes in " << group_count << " groups, " << m_ErrorCount << " errors";
+    if(group_count) std::cout << ", " << m_TotalCommitTime / group_count << "us avg, " << m_MaxCommitTime << "us max per group";
+    std::cout << ", " << (m_Submitted - m_Committed) << " queued.\n";
+    if(m_BackupCount || m_BackupErrorCount)
+    {
+        std::cout << "Database backup: " << m_BackupCount << " done, " << m_BackupErrorCount << " failed, last " << m_LastBackupPageCount << " pages in ";
+        std::cout << m_LastBackupTime << "ms, " << m_BackupStepCount << " steps, " << m_MaxBackupStep << "us max per step.\n";
+    }
+    if(m_Statements) m_Statements->printStats();
+}
+
+//////////////////////////////////////////////////////////////////
+// READERS
+
+bool DatabaseReaders::m_Initialized = false;
+
+DatabaseReaders::DatabaseReaders(const std::string &file)
+{
+    if(m_Initialized)
+    {
+        std::cout << "Database readers already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+
+    m_File = file;
+    for(int i = 0; i < DB_READ_CONNECTIONS; i++)
+    {
+        sqlite3 *db = openDatabase(m_File, true);
+        if(db) m_Free.push_back(db);
+    }
+}
+
+DatabaseReaders::~DatabaseReaders()
+{
+    m_Mutex.lock();
+    for(int i = 0; i < int(m_Free.size()); i++)
+    {
+        StatementCache::closeCache(m_Free[i]);
+        sqlite3_close(m_Free[i]);
+    }
+    m_Free.clear();
+    m_Mutex.unlock();
+}
+
+sqlite3 *DatabaseReaders::acquire()
+{
+    sqlite3 *db = NULL;
+
+    m_Mutex.lock();
+    if(!m_Free.empty())
+    {
+        db = m_Free.back();
+        m_Free.pop_back();
+    }
+    m_Mutex.unlock();
+    if(db) return db;
+
+    // all in use, open one just for this reader
+    db = openDatabase(m_File, true);
+    if(!db) return NULL;
+    m_Mutex.lock();
+    m_Extra.push_back(db);
+    m_Mutex.unlock();
+    return db;
+}
+
+void DatabaseReaders::release(sqlite3 *db)
+{
+    if(!db) return;
+
+    m_Mutex.lock();
+    for(int i = 0; i < int(m_Extra.size()); i++)
+    {
+        if(m_Extra[i] == db)
+        {
+            m_Extra.erase(m_Extra.begin() + i);
+            m_Mutex.unlock();
+            StatementCache::closeCache(db);
+            sqlite3_close(db);
+            return;
+        }
+    }
+    m_Free.push_back(db);
+    m_Mutex.unlock();
+}
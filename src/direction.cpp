@@ -1,6 +1,24 @@
 #include "direction.hpp"
 
-#include "tools.hpp"
+#include <cstdlib>
+#include <sstream>
+#include <unordered_map>
+
+// names and abbreviations -> direction index, built on first lookup
+static const std::unordered_map<std::string, int> &getDirectionLookup()
+{
+    static const std::unordered_map<std::string, int> lookup = []()
+    {
+        std::unordered_map<std::string, int> table;
+        for(int i = 0; i < DIR_COUNT; i++)
+        {
+            table[dirs[i].name] = i;
+            table[dirs[i].abbreviation] = i;
+        }
+        return table;
+    }();
+    return lookup;
+}
 
 std::vector<std::string> getDirections()
 {
@@ -8,38 +26,47 @@ std::vector<std::string> getDirections()
 
     for(int i = 0; i < DIR_COUNT; i++)
     {
-        dlist.push_back(dirs[i][0]);
+        dlist.push_back(dirs[i].name);
     }
     return dlist;
 }
 
-int getDirectionIndex(std::string dir)
+int getDirectionIndex(const std::string &dir)
 {
-    for(int i = 0; i < DIR_COUNT; i++)
-    {
-        if(dirs[i][0] == dir || dirs[i][4] == dir)
-        {
-            return i;
-        }
-    }
-    return -1;
+    const std::unordered_map<std::string, int> &lookup = getDirectionLookup();
+    std::unordered_map<std::string, int>::const_iterator it = lookup.find(dir);
+    if(it == lookup.end()) return -1;
+    return it->second;
 }
 
-std::string oppositeDir(std::string dir)
+std::string oppositeDirection(const std::string &dir)
 {
-    std::string dir_error = "dir_error";
+    int dir_index = getDirectionIndex(dir);
 
-    dir = capitalize(toLower(dir));
+    // did not find valid direction
+    if(dir_index == -1) return "dir_error";
 
-    // find opposite direction
-    for(int i = 0; i < DIR_COUNT; i++)
+    return dirs[dirs[dir_index].opposite].name;
+}
+
+int parseExits(const std::string &text, std::vector<int> *exits)
+{
+    std::stringstream ss(text);
+    std::string entry;
+    int error_count = 0;
+
+    exits->assign(DIR_COUNT, 0);
+    while(ss >> entry)
     {
-        if( dirs[i][0] == dir)
+        size_t split = entry.find('=');
+        int dir_index = -1;
+        if(split != std::string::npos) dir_index = getDirectionIndex(entry.substr(0, split));
+        if(dir_index == -1)
         {
-            return dirs[i][1];
+            error_count++;
+            continue;
         }
+        (*exits)[dir_index] = atoi(entry.c_str() + split + 1);
     }
-
-    // did not find valid direction
-    return dir_error;
+    return error_count;
 }
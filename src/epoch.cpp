@@ -0,0 +1,145 @@
+#include "epoch.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+namespace
+{
+    // reader slots are handed out per thread and given back when the thread ends
+    sf::Mutex g_SlotMutex;
+    bool g_SlotUsed[EPOCH_MAX_THREADS] = {false};
+
+    struct ThreadSlot
+    {
+        int index;
+
+        ThreadSlot()
+        {
+            index = -1;
+            g_SlotMutex.lock();
+            for(int i = 0; i < EPOCH_MAX_THREADS; i++)
+            {
+                if(g_SlotUsed[i]) continue;
+                g_SlotUsed[i] = true;
+                index = i;
+                break;
+            }
+            g_SlotMutex.unlock();
+
+            // a reader without a slot would not hold off reclaim and could read freed rooms
+            if(index == -1)
+            {
+                std::cout << "Error, more than " << EPOCH_MAX_THREADS << " reader threads!\n";
+                std::abort();
+            }
+        }
+
+        ~ThreadSlot()
+        {
+            g_SlotMutex.lock();
+            g_SlotUsed[index] = false;
+            g_SlotMutex.unlock();
+        }
+    };
+
+    thread_local ThreadSlot t_Slot;
+}
+
+EpochManager::EpochManager()
+{
+    // epoch 0 means not reading, so start at 1
+    m_Epoch.store(1);
+}
+
+EpochManager::~EpochManager()
+{
+    // nothing can be reading once the owner is gone
+    for(int i = 0; i < int(m_Retired.size()); i++)
+    {
+        m_Retired[i].func(m_Retired[i].owner, m_Retired[i].ptr);
+    }
+    m_Retired.clear();
+}
+
+int EpochManager::getThreadSlot()
+{
+    return t_Slot.index;
+}
+
+void EpochManager::enter()
+{
+    EpochSlot &slot = m_Slots[getThreadSlot()];
+    if(slot.depth++ > 0) return;
+
+    // announce epoch before reading any shared pointers
+    slot.epoch.store(m_Epoch.load());
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+void EpochManager::exit()
+{
+    EpochSlot &slot = m_Slots[getThreadSlot()];
+    if(--slot.depth > 0) return;
+
+    slot.epoch.store(0, std::memory_order_release);
+}
+
+void EpochManager::retire(void (*func)(void *owner, void *ptr), void *owner, void *ptr)
+{
+    if(!ptr) return;
+
+    RetiredItem item;
+    item.func = func;
+    item.owner = owner;
+    item.ptr = ptr;
+    item.epoch = m_Epoch.load();
+
+    m_RetireMutex.lock();
+    m_Retired.push_back(item);
+    m_RetireMutex.unlock();
+}
+
+int EpochManager::reclaim()
+{
+    std::vector<RetiredItem> freeable;
+
+    m_RetireMutex.lock();
+    if(m_Retired.empty())
+    {
+        m_RetireMutex.unlock();
+        return 0;
+    }
+
+    // oldest epoch any reader is still in, items retired before it can no longer be seen
+    unsigned long long oldest = m_Epoch.fetch_add(1) + 1;
+    for(int i = 0; i < EPOCH_MAX_THREADS; i++)
+    {
+        unsigned long long epoch = m_Slots[i].epoch.load();
+        if(epoch && epoch < oldest) oldest = epoch;
+    }
+
+    int kept = 0;
+    for(int i = 0; i < int(m_Retired.size()); i++)
+    {
+        if(m_Retired[i].epoch < oldest) freeable.push_back(m_Retired[i]);
+        else m_Retired[kept++] = m_Retired[i];
+    }
+    m_Retired.resize(kept);
+    m_RetireMutex.unlock();
+
+    // free outside of the lock, free functions may take locks of their own
+    for(int i = 0; i < int(freeable.size()); i++)
+    {
+        freeable[i].func(freeable[i].owner, freeable[i].ptr);
+    }
+
+    return int(freeable.size());
+}
+
+int EpochManager::getPendingCount()
+{
+    m_RetireMutex.lock();
+    int count = int(m_Retired.size());
+    m_RetireMutex.unlock();
+    return count;
+}
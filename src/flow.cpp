@@ -0,0 +1,203 @@
+#include "flow.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include "client.hpp"
+#include "mud.hpp"
+
+//////////////////////////////////////////////////////////////////
+// frame pool
+
+static sf::Mutex s_FrameMutex;
+static std::vector<void*> s_FreeFrames;
+
+void *Flow::promise_type::operator new(std::size_t size)
+{
+    if(size > FLOW_FRAME_SIZE) return ::operator new(size);
+
+    void *frame = NULL;
+    s_FrameMutex.lock();
+    if(!s_FreeFrames.empty())
+    {
+        frame = s_FreeFrames.back();
+        s_FreeFrames.pop_back();
+    }
+    s_FrameMutex.unlock();
+
+    // pooled frames are all full size so any of them fits any flow
+    if(!frame) frame = ::operator new(FLOW_FRAME_SIZE);
+    return frame;
+}
+
+void Flow::promise_type::operator delete(void *frame, std::size_t size)
+{
+    if(size > FLOW_FRAME_SIZE)
+    {
+        ::operator delete(frame);
+        return;
+    }
+
+    s_FrameMutex.lock();
+    if(int(s_FreeFrames.size()) < FLOW_FRAME_POOL_MAX)
+    {
+        s_FreeFrames.push_back(frame);
+        frame = NULL;
+    }
+    s_FrameMutex.unlock();
+    if(frame) ::operator delete(frame);
+}
+
+void Flow::promise_type::unhandled_exception()
+{
+    std::cout << "Unhandled exception in flow!\n";
+    std::abort();
+}
+
+//////////////////////////////////////////////////////////////////
+// awaitables
+
+void FlowInput::await_suspend(std::coroutine_handle<> handle)
+{
+    client->m_Flow.wait = FLOW_WAIT_INPUT;
+    client->m_Flow.input = &line;
+}
+
+// sleeping clients, network thread only
+struct FlowTimer
+{
+    Client *client;
+    sf::Time wake;
+};
+static sf::Clock s_TimerClock;
+static std::vector<FlowTimer> s_Timers;
+
+void FlowSleep::await_suspend(std::coroutine_handle<> handle)
+{
+    client->m_Flow.wait = FLOW_WAIT_TIMER;
+
+    FlowTimer ttimer;
+    ttimer.client = client;
+    ttimer.wake = s_TimerClock.getElapsedTime() + sf::milliseconds(milliseconds);
+    s_Timers.push_back(ttimer);
+}
+
+bool FlowCredentials::await_suspend(std::coroutine_handle<> handle)
+{
+    job.client = client;
+    if(!Mud::getInstance()->m_CredentialPool->submit(job)) return false;
+
+    client->m_Flow.wait = FLOW_WAIT_CREDENTIALS;
+    client->m_Flow.job = &job;
+    return true;
+}
+
+FlowInput flowInput(Client *tclient)
+{
+    FlowInput tawait;
+    tawait.client = tclient;
+    return tawait;
+}
+
+FlowSleep flowSleep(Client *tclient, int milliseconds)
+{
+    FlowSleep tawait;
+    tawait.client = tclient;
+    tawait.milliseconds = milliseconds;
+    return tawait;
+}
+
+FlowCredentials flowCredentials(Client *tclient, const CredentialJob &tjob)
+{
+    FlowCredentials tawait;
+    tawait.client = tclient;
+    tawait.job = tjob;
+    return tawait;
+}
+
+//////////////////////////////////////////////////////////////////
+// running flows
+
+// resume flow, destroying it once it has finished
+static void resume(Client *tclient)
+{
+    FlowState &flow = tclient->m_Flow;
+    flow.wait = FLOW_WAIT_NONE;
+    flow.input = NULL;
+    flow.job = NULL;
+
+    flow.handle.resume();
+    if(flow.handle.done())
+    {
+        flow.handle.destroy();
+        flow.handle = std::coroutine_handle<>();
+    }
+}
+
+void startFlow(Client *tclient, Flow flow)
+{
+    endFlow(tclient);
+
+    tclient->m_Flow.handle = flow.m_Handle;
+    tclient->func = runFlow;
+    resume(tclient);
+}
+
+int runFlow(Client *tclient)
+{
+    if(!tclient) return 0;
+
+    // input while the flow is busy with something else is dropped
+    if(!tclient->isConnected() || !tclient->m_Flow.handle || tclient->m_Flow.wait != FLOW_WAIT_INPUT) return 0;
+
+    *tclient->m_Flow.input = tclient->m_LastInput;
+    resume(tclient);
+    return 0;
+}
+
+bool resumeFlowCredentials(Client *tclient, const CredentialJob &tjob)
+{
+    if(!tclient->m_Flow.handle || tclient->m_Flow.wait != FLOW_WAIT_CREDENTIALS) return false;
+
+    *tclient->m_Flow.job = tjob;
+    resume(tclient);
+    return true;
+}
+
+void runFlowTimers(std::vector<Client*> *resumed)
+{
+    if(s_Timers.empty()) return;
+
+    // take expired timers out first, flows resumed may sleep again
+    std::vector<Client*> expired;
+    std::vector<FlowTimer> waiting;
+    sf::Time now = s_TimerClock.getElapsedTime();
+    for(int i = 0; i < int(s_Timers.size()); i++)
+    {
+        if(s_Timers[i].wake > now) waiting.push_back(s_Timers[i]);
+        else expired.push_back(s_Timers[i].client);
+    }
+    s_Timers.swap(waiting);
+
+    for(int i = 0; i < int(expired.size()); i++)
+    {
+        if(!expired[i]->m_Flow.handle || expired[i]->m_Flow.wait != FLOW_WAIT_TIMER) continue;
+        resume(expired[i]);
+        resumed->push_back(expired[i]);
+    }
+}
+
+void endFlow(Client *tclient)
+{
+    for(int i = int(s_Timers.size()) - 1; i >= 0; i--)
+    {
+        if(s_Timers[i].client == tclient) s_Timers.erase(s_Timers.begin() + i);
+    }
+
+    if(tclient->m_Flow.handle)
+    {
+        tclient->m_Flow.handle.destroy();
+        tclient->m_Flow.handle = std::coroutine_handle<>();
+    }
+    tclient->m_Flow.wait = FLOW_WAIT_NONE;
+}
@@ -0,0 +1,409 @@
+#include "journal.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <unordered_map>
+
+namespace
+{
+    // FNV-1a, enough to tell a torn or damaged record from a good one
+    sf::Uint32 recordChecksum(const char *data, size_t size)
+    {
+        sf::Uint32 hash = 2166136261u;
+        for(size_t i = 0; i < size; i++)
+        {
+            hash ^= static_cast<unsigned char>(data[i]);
+            hash *= 16777619u;
+        }
+        return hash;
+    }
+
+    bool readFile(const std::string &file, std::vector<char> *data)
+    {
+        FILE *fp = fopen(file.c_str(), "rb");
+        if(!fp) return false;
+
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        fseek(fp, 0, SEEK_SET);
+        if(size > 0)
+        {
+            data->resize(size);
+            data->resize(fread(&(*data)[0], 1, size, fp));
+        }
+        fclose(fp);
+        return true;
+    }
+
+    // payload of one record
+    struct RecordReader
+    {
+        const char *pos;
+        const char *end;
+
+        bool getInt(sf::Int32 *value)
+        {
+            if(end - pos < 4) return false;
+            memcpy(value, pos, 4);
+            pos += 4;
+            return true;
+        }
+
+        bool getString(std::string *text)
+        {
+            sf::Int32 length = 0;
+            if(!getInt(&length) || length < 0 || end - pos < length) return false;
+            text->assign(pos, length);
+            pos += length;
+            return true;
+        }
+    };
+
+    struct RecoveredAccount
+    {
+        bool created;
+        bool password_changed;
+        std::string stored;
+        int room_id;
+    };
+
+    // last state of everything in the journal
+    struct Recovered
+    {
+        std::map<int, StoredRoom> rooms;
+        std::unordered_map<std::string, int> players;
+        std::unordered_map<std::string, RecoveredAccount> accounts;
+        std::vector<std::string> account_order;     // accounts are created in journal order
+    };
+
+    bool replayRecord(int type, RecordReader *reader, Recovered *recovered)
+    {
+        std::string username;
+        sf::Int32 room_id = 0;
+
+        if(type == JOURNAL_ROOM)
+        {
+            StoredRoom troom;
+            sf::Int32 exit_count = 0;
+            if(!reader->getInt(&room_id) || !reader->getString(&troom.zone) || !reader->getString(&troom.name)
+               || !reader->getString(&troom.description) || !reader->getInt(&exit_count) || exit_count < 0) return false;
+            troom.room_id = room_id;
+            troom.exits.resize(exit_count);
+            for(int i = 0; i < exit_count; i++)
+            {
+                StoredExit &texit = troom.exits[i];
+                sf::Int32 to_room = 0;
+                sf::Int32 flags = 0;
+                if(!reader->getString(&texit.dir) || !reader->getInt(&to_room) || !reader->getInt(&flags)) return false;
+                texit.to_room = to_room;
+                texit.flags = flags;
+            }
+            StoredRoom &stored = recovered->rooms[troom.room_id];
+            stored.room_id = troom.room_id;
+            stored.zone.swap(troom.zone);
+            stored.name.swap(troom.name);
+            stored.description.swap(troom.description);
+            stored.exits.swap(troom.exits);
+        }
+        else if(type == JOURNAL_PLAYER_ROOM)
+        {
+            if(!reader->getString(&username) || !reader->getInt(&room_id)) return false;
+            recovered->players[username] = room_id;
+        }
+        else if(type == JOURNAL_ACCOUNT || type == JOURNAL_PASSWORD)
+        {
+            std::string stored;
+            if(!reader->getString(&username) || !reader->getString(&stored)) return false;
+            if(type == JOURNAL_ACCOUNT && !reader->getInt(&room_id)) return false;
+
+            std::unordered_map<std::string, RecoveredAccount>::iterator it = recovered->accounts.find(username);
+            if(it == recovered->accounts.end())
+            {
+                it = recovered->accounts.insert(std::make_pair(username, RecoveredAccount())).first;
+                it->second.created = false;
+                it->second.password_changed = false;
+                it->second.room_id = 0;
+                recovered->account_order.push_back(username);
+            }
+            it->second.stored = stored;
+            if(type == JOURNAL_ACCOUNT)
+            {
+                it->second.created = true;
+                it->second.room_id = room_id;
+            }
+            else it->second.password_changed = true;
+        }
+        else return false;
+
+        return true;
+    }
+}
+
+bool Journal::m_Initialized = false;
+
+Journal::Journal(const std::string &file)
+{
+    m_FP = NULL;
+    m_RecordCount = 0;
+    m_ByteCount = 0;
+    m_CompactCount = 0;
+
+    if(m_Initialized)
+    {
+        std::cout << "Journal already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+
+    m_File = file;
+    m_FP = fopen(m_File.c_str(), "ab");
+    if(!m_FP)
+    {
+        std::cout << "Error opening journal " << m_File << std::endl;
+        return;
+    }
+    setvbuf(m_FP, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
+}
+
+Journal::~Journal()
+{
+    if(m_FP) fclose(m_FP);
+}
+
+//////////////////////////////////////////////////////////////////
+// WRITING
+
+// expects mutex to be locked
+void Journal::beginRecord(int type)
+{
+    m_Record.clear();
+    m_Record.resize(4, 0);
+    m_Record.push_back(char(type));
+}
+
+void Journal::putInt(sf::Int32 value)
+{
+    const char *bytes = reinterpret_cast<const char*>(&value);
+    m_Record.insert(m_Record.end(), bytes, bytes + 4);
+}
+
+void Journal::putString(const std::string &text)
+{
+    putInt(sf::Int32(text.size()));
+    m_Record.insert(m_Record.end(), text.begin(), text.end());
+}
+
+void Journal::endRecord()
+{
+    sf::Uint32 size = sf::Uint32(m_Record.size() - 5);
+    memcpy(&m_Record[0], &size, 4);
+    sf::Uint32 checksum = recordChecksum(&m_Record[4], m_Record.size() - 4);
+    const char *bytes = reinterpret_cast<const char*>(&checksum);
+    m_Record.insert(m_Record.end(), bytes, bytes + 4);
+
+    if(m_FP) fwrite(&m_Record[0], 1, m_Record.size(), m_FP);
+    m_RecordCount++;
+    m_ByteCount += int(m_Record.size());
+}
+
+void Journal::logRoom(const StoredRoom &troom)
+{
+    m_Mutex.lock();
+    beginRecord(JOURNAL_ROOM);
+    putInt(troom.room_id);
+    putString(troom.zone);
+    putString(troom.name);
+    putString(troom.description);
+    putInt(sf::Int32(troom.exits.size()));
+    for(int i = 0; i < int(troom.exits.size()); i++)
+    {
+        putString(troom.exits[i].dir);
+        putInt(troom.exits[i].to_room);
+        putInt(troom.exits[i].flags);
+    }
+    endRecord();
+    m_Mutex.unlock();
+}
+
+void Journal::logPlayerRoom(const std::string &username, int room_id)
+{
+    m_Mutex.lock();
+    beginRecord(JOURNAL_PLAYER_ROOM);
+    putString(username);
+    putInt(room_id);
+    endRecord();
+    m_Mutex.unlock();
+}
+
+void Journal::logAccount(const std::string &username, const std::string &stored, int room_id)
+{
+    m_Mutex.lock();
+    beginRecord(JOURNAL_ACCOUNT);
+    putString(username);
+    putString(stored);
+    putInt(room_id);
+    endRecord();
+    m_Mutex.unlock();
+}
+
+void Journal::logPassword(const std::string &username, const std::string &stored)
+{
+    m_Mutex.lock();
+    beginRecord(JOURNAL_PASSWORD);
+    putString(username);
+    putString(stored);
+    endRecord();
+    m_Mutex.unlock();
+}
+
+void Journal::flush()
+{
+    m_Mutex.lock();
+    if(m_FP) fflush(m_FP);
+    m_Mutex.unlock();
+}
+
+bool Journal::rotate()
+{
+    std::string old_file = m_File + ".old";
+
+    m_Mutex.lock();
+    if(!m_FP)
+    {
+        m_Mutex.unlock();
+        return false;
+    }
+
+    // a file left over from a checkpoint that did not finish is still needed, keep adding to it
+    fclose(m_FP);
+    FILE *old_fp = fopen(old_file.c_str(), "rb");
+    if(old_fp)
+    {
+        fclose(old_fp);
+        std::vector<char> data;
+        old_fp = fopen(old_file.c_str(), "ab");
+        if(readFile(m_File, &data) && old_fp && !data.empty()) fwrite(&data[0], 1, data.size(), old_fp);
+        if(old_fp) fclose(old_fp);
+        remove(m_File.c_str());
+    }
+    else if(rename(m_File.c_str(), old_file.c_str()) != 0)
+    {
+        std::cout << "Error moving journal " << m_File << " aside.\n";
+    }
+
+    m_FP = fopen(m_File.c_str(), "ab");
+    if(m_FP) setvbuf(m_FP, NULL, _IOFBF, JOURNAL_BUFFER_SIZE);
+    else std::cout << "Error opening journal " << m_File << std::endl;
+    m_Mutex.unlock();
+    return m_FP != NULL;
+}
+
+void Journal::compact()
+{
+    std::string old_file = m_File + ".old";
+    remove(old_file.c_str());
+    m_CompactCount++;
+}
+
+void Journal::printStats()
+{
+    std::cout << "Journal: " << m_RecordCount << " records, " << m_ByteCount << " bytes written, " << m_CompactCount << " compactions.\n";
+}
+
+//////////////////////////////////////////////////////////////////
+// RECOVERY
+
+int Journal::recover(const std::string &file, Storage *storage)
+{
+    sf::Clock recover_clock;
+    std::string files[2] = {file + ".old", file};
+    Recovered recovered;
+    int record_count = 0;
+    int error_count = 0;
+    bool found = false;
+
+    // older file first, later records replace earlier ones
+    for(int i = 0; i < 2; i++)
+    {
+        std::vector<char> data;
+        if(!readFile(files[i], &data)) continue;
+        found = true;
+
+        size_t pos = 0;
+        while(pos < data.size())
+        {
+            // torn or damaged record, nothing after it can be trusted
+            sf::Uint32 size = 0;
+            if(data.size() - pos < 9) break;
+            memcpy(&size, &data[pos], 4);
+            if(data.size() - pos - 9 < size) break;
+            const char *body = &data[pos + 4];
+            sf::Uint32 checksum = 0;
+            memcpy(&checksum, body + 1 + size, 4);
+            if(checksum != recordChecksum(body, size + 1)) break;
+
+            RecordReader reader;
+            reader.pos = body + 1;
+            reader.end = body + 1 + size;
+            if(!replayRecord(body[0], &reader, &recovered)) error_count++;
+            record_count++;
+            pos += 9 + size;
+        }
+        if(pos < data.size())
+        {
+            std::cout << "Journal " << files[i] << " ends in a damaged record, " << data.size() - pos << " bytes skipped.\n";
+        }
+    }
+    if(!found) return 0;
+
+    bool created = false;
+    if(!storage->openAccounts(&created) || !storage->openWorld(&created))
+    {
+        std::cout << "Error opening storage for journal replay.\n";
+        return -1;
+    }
+
+    // accounts first so player rooms have an account to go to
+    long long mark = storage->writeMark();
+    for(int i = 0; i < int(recovered.account_order.size()); i++)
+    {
+        const std::string &username = recovered.account_order[i];
+        const RecoveredAccount &taccount = recovered.accounts[username];
+        AccountRecord record;
+        if(!storage->loadAccount(username, &record))
+        {
+            error_count++;
+            continue;
+        }
+        if(taccount.created && !record.exists) storage->addAccount(username, taccount.stored, taccount.room_id);
+        else if(taccount.password_changed || taccount.created) storage->setPassword(username, taccount.stored);
+    }
+    if(!recovered.players.empty()) storage->savePlayerRooms(recovered.players);
+
+    std::vector<StoredRoom> rooms;
+    rooms.reserve(recovered.rooms.size());
+    for(std::map<int, StoredRoom>::iterator it = recovered.rooms.begin(); it != recovered.rooms.end(); it++)
+    {
+        rooms.push_back(StoredRoom());
+        rooms.back().room_id = it->second.room_id;
+        rooms.back().zone.swap(it->second.zone);
+        rooms.back().name.swap(it->second.name);
+        rooms.back().description.swap(it->second.description);
+        rooms.back().exits.swap(it->second.exits);
+    }
+    if(!rooms.empty()) storage->saveRooms(rooms);
+    if(!storage->flush(mark))
+    {
+        std::cout << "Error writing journal replay to storage, journal kept.\n";
+        return -1;
+    }
+
+    // everything is in storage now
+    remove(files[0].c_str());
+    remove(files[1].c_str());
+
+    std::cout << "Journal replayed " << record_count << " records (" << rooms.size() << " rooms, " << recovered.players.size() << " players, ";
+    std::cout << recovered.accounts.size() << " accounts) in " << recover_clock.getElapsedTime().asMilliseconds() << "ms with " << error_count << " errors.\n";
+    return record_count;
+}
@@ -1,10 +1,49 @@
+#include <csignal>
 #include <cstdlib>
+#include <cstring>
+#include <iostream>
 #include "mud.hpp"
 
+// ctrl-c or kill stops the server the normal way so everything is written out
+static void handleSignal(int sig)
+{
+    Mud::getInstance()->shutdown();
+}
+
 int main(int argc, char *argv[])
 {
+    // -memory keeps accounts and world in memory only
+    // -memory-latency <us> holds every memory read and write up, -memory-fail-reads/-writes makes them fail
+    StorageOptions storage_options;
+    for(int i = 1; i < argc; i++)
+    {
+        if(!strcmp(argv[i], "-memory")) storage_options.type = STORAGE_MEMORY;
+        else if(!strcmp(argv[i], "-sqlite")) storage_options.type = STORAGE_SQLITE;
+        else if(!strcmp(argv[i], "-memory-latency") && i + 1 < argc)
+        {
+            storage_options.read_latency = atoi(argv[++i]);
+            storage_options.write_latency = storage_options.read_latency;
+        }
+        else if(!strcmp(argv[i], "-memory-fail-reads")) storage_options.fail_reads = true;
+        else if(!strcmp(argv[i], "-memory-fail-writes")) storage_options.fail_writes = true;
+        else
+        {
+            std::cout << "Unknown option " << argv[i] << std::endl;
+            return 1;
+        }
+    }
+    if(storage_options.type != STORAGE_MEMORY &&
+       (storage_options.read_latency >= 0 || storage_options.fail_reads || storage_options.fail_writes))
+    {
+        std::cout << "-memory-latency and -memory-fail options need -memory\n";
+        return 1;
+    }
+
     Mud *mud = Mud::getInstance();
-    mud->start();
+    signal(SIGINT, handleSignal);
+    signal(SIGTERM, handleSignal);
+    mud->start(storage_options);
 
+    Mud::destroyInstance();
     return 0;
 }
@@ -0,0 +1,202 @@
+#include "memorystorage.hpp"
+
+#include <iostream>
+
+MemoryStorage::MemoryStorage()
+{
+    m_WorldVersion = 1;
+    m_ReadLatency = STORAGE_MEMORY_READ_LATENCY;
+    m_WriteLatency = STORAGE_MEMORY_WRITE_LATENCY;
+    m_FailReads = false;
+    m_FailWrites = false;
+    m_ReadCount = 0;
+    m_WriteCount = 0;
+    m_ErrorCount = 0;
+    m_LastFailed = 0;
+}
+
+void MemoryStorage::setLatency(sf::Int64 read_us, sf::Int64 write_us)
+{
+    m_ReadLatency = read_us;
+    m_WriteLatency = write_us;
+}
+
+// false if the read is to fail
+bool MemoryStorage::beginRead()
+{
+    m_ReadCount++;
+    if(m_ReadLatency > 0) sf::sleep(sf::microseconds(m_ReadLatency));
+    if(!m_FailReads) return true;
+    m_ErrorCount++;
+    return false;
+}
+
+// false if the write is to be dropped
+bool MemoryStorage::beginWrite()
+{
+    long long number = ++m_WriteCount;
+    if(m_WriteLatency > 0) sf::sleep(sf::microseconds(m_WriteLatency));
+    if(!m_FailWrites) return true;
+    std::cout << "Memory storage write failed (injected).\n";
+    m_ErrorCount++;
+    long long last_failed = m_LastFailed;
+    while(last_failed < number && !m_LastFailed.compare_exchange_weak(last_failed, number));
+    return false;
+}
+
+//////////////////////////////////////////////////////////////////
+// ACCOUNTS
+
+bool MemoryStorage::openAccounts(bool *created)
+{
+    m_Mutex.lock();
+    *created = m_Accounts.empty();
+    m_Mutex.unlock();
+    return true;
+}
+
+bool MemoryStorage::loadAccount(const std::string &username, AccountRecord *record)
+{
+    *record = AccountRecord();
+    if(!beginRead()) return false;
+
+    m_Mutex.lock();
+    std::unordered_map<std::string, AccountRecord>::iterator it = m_Accounts.find(username);
+    if(it != m_Accounts.end()) *record = it->second;
+    m_Mutex.unlock();
+    return true;
+}
+
+void MemoryStorage::addAccount(const std::string &username, const std::string &stored, int room_id)
+{
+    if(!beginWrite()) return;
+
+    m_Mutex.lock();
+    // account names are unique
+    if(m_Accounts.find(username) == m_Accounts.end())
+    {
+        AccountRecord &record = m_Accounts[username];
+        record.exists = true;
+        record.password = stored;
+        record.room_id = room_id;
+    }
+    m_Mutex.unlock();
+}
+
+void MemoryStorage::setPassword(const std::string &username, const std::string &stored)
+{
+    if(!beginWrite()) return;
+
+    m_Mutex.lock();
+    std::unordered_map<std::string, AccountRecord>::iterator it = m_Accounts.find(username);
+    if(it != m_Accounts.end()) it->second.password = stored;
+    m_Mutex.unlock();
+}
+
+void MemoryStorage::savePlayerRooms(const std::unordered_map<std::string, int> &rooms)
+{
+    if(!beginWrite()) return;
+
+    m_Mutex.lock();
+    for(std::unordered_map<std::string, int>::const_iterator it = rooms.begin(); it != rooms.end(); it++)
+    {
+        std::unordered_map<std::string, AccountRecord>::iterator ait = m_Accounts.find(it->first);
+        if(ait != m_Accounts.end()) ait->second.room_id = it->second;
+    }
+    m_Mutex.unlock();
+}
+
+//////////////////////////////////////////////////////////////////
+// WORLD
+
+bool MemoryStorage::openWorld(bool *created)
+{
+    m_Mutex.lock();
+    *created = m_Rooms.empty();
+    m_Mutex.unlock();
+    return true;
+}
+
+sf::Int64 MemoryStorage::getWorldVersion()
+{
+    m_Mutex.lock();
+    sf::Int64 version = m_WorldVersion;
+    m_Mutex.unlock();
+    return version;
+}
+
+bool MemoryStorage::loadZoneList(std::vector<StoredZone> *zones)
+{
+    if(!beginRead()) return false;
+
+    std::unordered_map<std::string, int> zone_lookup;
+    m_Mutex.lock();
+    for(std::map<int, StoredRoom>::iterator it = m_Rooms.begin(); it != m_Rooms.end(); it++)
+    {
+        std::unordered_map<std::string, int>::iterator zit = zone_lookup.find(it->second.zone);
+        if(zit == zone_lookup.end())
+        {
+            zit = zone_lookup.insert(std::make_pair(it->second.zone, int(zones->size()))).first;
+            zones->push_back(StoredZone());
+            zones->back().name = it->second.zone;
+            zones->back().max_room_id = 0;
+            zones->back().room_count = 0;
+        }
+        // rooms are in id order, the last one seen is the highest
+        StoredZone &tzone = (*zones)[zit->second];
+        tzone.max_room_id = it->first;
+        tzone.room_count++;
+    }
+    m_Mutex.unlock();
+    return true;
+}
+
+bool MemoryStorage::loadRooms(const std::string &zone, StoredRoomFunc func, void *data)
+{
+    if(!beginRead()) return false;
+
+    // copy out first so func is not called with the storage mutex held
+    std::vector<StoredRoom> rooms;
+    m_Mutex.lock();
+    for(std::map<int, StoredRoom>::iterator it = m_Rooms.begin(); it != m_Rooms.end(); it++)
+    {
+        if(zone.empty() || it->second.zone == zone) rooms.push_back(it->second);
+    }
+    m_Mutex.unlock();
+
+    for(int i = 0; i < int(rooms.size()); i++) func(data, rooms[i]);
+    return true;
+}
+
+bool MemoryStorage::findRoomZone(int room_id, std::string *zone)
+{
+    zone->clear();
+    if(!beginRead()) return false;
+
+    m_Mutex.lock();
+    std::map<int, StoredRoom>::iterator it = m_Rooms.find(room_id);
+    if(it != m_Rooms.end()) *zone = it->second.zone;
+    m_Mutex.unlock();
+    return true;
+}
+
+void MemoryStorage::saveRooms(const std::vector<StoredRoom> &rooms)
+{
+    if(!beginWrite()) return;
+
+    m_Mutex.lock();
+    for(int i = 0; i < int(rooms.size()); i++) m_Rooms[rooms[i].room_id] = rooms[i];
+    m_WorldVersion++;
+    m_Mutex.unlock();
+}
+
+void MemoryStorage::printStats()
+{
+    m_Mutex.lock();
+    int account_count = int(m_Accounts.size());
+    int room_count = int(m_Rooms.size());
+    m_Mutex.unlock();
+
+    std::cout << "Memory storage: " << account_count << " accounts, " << room_count << " rooms, ";
+    std::cout << m_ReadCount << " reads, " << m_WriteCount << " writes, " << m_ErrorCount << " errors.\n";
+}
@@ -1,53 +1,124 @@
 #include "mud.hpp"
 
 #include <iostream>
+#include "tools.hpp"
 
 Mud *Mud::m_Instance = NULL;
 
 Mud::Mud()
 {
-
+    m_ServerState = SERVER_INIT;
+    m_SendAndReceiveThread = NULL;
+    m_Storage = NULL;
+    m_LogoutSaves = false;
+    m_AccountManager = NULL;
+    m_ZoneManager = NULL;
+    m_CommandManager = NULL;
+    m_ZoneScheduler = NULL;
+    m_CredentialPool = NULL;
+    m_Checkpointer = NULL;
+    m_Journal = NULL;
 }
 
+// start may have given up part way, only what it got to is torn down
 Mud::~Mud()
 {
-    // close database connection
-    sqlite3_close(m_DB);
+    // nothing changes rooms or accounts past here
+    if(m_CredentialPool) m_CredentialPool->stop();
+    if(m_ZoneScheduler) m_ZoneScheduler->stop();
+
+    // write player positions and rooms before storage goes away
+    if(m_AccountManager)
+    {
+        queueMovedPlayers();
+        m_AccountManager->flushPlayerSaves();
+    }
+    if(m_Checkpointer)
+    {
+        m_Checkpointer->stop();
+        m_Checkpointer->printStats();
+    }
+    if(m_Journal) m_Journal->printStats();
+    delete m_Journal;
+
+    for(int i = 0; i < int(m_FreeSockets.size()); i++) delete m_FreeSockets[i];
+
+    // writes what is still queued
+    if(m_Storage)
+    {
+        m_Storage->flush(0);
+        m_Storage->printStats();
+        delete m_Storage;
+    }
 }
 
-void Mud::start()
+void Mud::start(const StorageOptions &storage_options)
 {
     static bool started = false;
     if(started) return;
     started = true;
     std::cout << "Starting mud...\n";
-    m_ServerState = SERVER_INIT;
 
-    // open connection to sqlite database
-    if(sqlite3_open(std::string(DB_FILE).c_str(), &m_DB))
+    // open account and world storage
+    m_Storage = createStorage(storage_options, DB_FILE);
+    if(!m_Storage)
     {
-        std::cout << "Error opening DB:" << DB_FILE << ", exiting...\n";
+        std::cout << "Error opening storage:" << DB_FILE << ", exiting...\n";
         return;
     }
+    std::cout << "Using " << m_Storage->getName() << " storage.\n";
+
+    // bring storage up to date with what a previous run journaled but did not checkpoint,
+    // memory storage starts empty every time so there is nothing to journal for
+    if(JOURNAL && storage_options.type != STORAGE_MEMORY)
+    {
+        if(Journal::recover(JOURNAL_FILE, m_Storage) < 0)
+        {
+            std::cout << "Error replaying journal " << JOURNAL_FILE << ", exiting...\n";
+            return;
+        }
+        m_Journal = new Journal(JOURNAL_FILE);
+    }
 
     // initialize account manager
     std::cout << "Initializing account manager...\n";
-    m_AccountManager = new AccountManager(m_DB);
+    m_AccountManager = new AccountManager(m_Storage);
 
     // initialize zone/room manager
     std::cout << "Initializing zone manager...\n";
-    m_ZoneManager = new ZoneManager(m_DB);
+    m_ZoneManager = new ZoneManager(m_Storage);
+    m_ZoneManager->m_Journal = m_Journal;
+
+    // write changed rooms and player positions in the background
+    std::cout << "Starting checkpointer...\n";
+    m_Checkpointer = new Checkpointer(m_ZoneManager, m_Storage, m_Journal);
+    m_Checkpointer->start();
 
     // initialize command/manager
     std::cout << "Initializing command manager...\n";
     m_CommandManager = new CommandManager();
 
+    // start zone workers
+    m_ZoneScheduler = new ZoneScheduler(m_ZoneManager);
+    if(ZONE_ACTORS)
+    {
+        std::cout << "Starting zone scheduler...\n";
+        m_ZoneScheduler->start();
+    }
+
+    // start password hashing workers
+    std::cout << "Starting credential pool...\n";
+    m_CredentialPool = new CredentialPool();
+    m_CredentialPool->start();
+
     // start send and receive thread
     m_SendAndReceiveThread = new sf::Thread(Mud::sendAndRecieve, this);
     m_SendAndReceiveThread->launch();
 
-    // wait for server shutdown
-    while(m_ServerState != SERVER_SHUTDOWN);
+    // network thread runs until server shutdown
+    m_SendAndReceiveThread->wait();
+    delete m_SendAndReceiveThread;
+    m_SendAndReceiveThread = NULL;
 
     std::cout << "Shutting down...\n";
 }
@@ -64,17 +135,37 @@ void Mud::sendAndRecieve()
     // list of clients ready to be removed in the event of error/disconnect
     std::vector<Client*> m_ClientRemovalQueue;
 
+    // time since last server update
+    sf::Clock tick_clock;
+
     // send and receive data until server shutdown
     while(m_ServerState != SERVER_SHUTDOWN)
     {
-        // wait for data
-        if(m_Selector.wait())
+        // clients whose zones have let go of them
+        removeReleasedClients();
+
+        // periodic upkeep
+        if(tick_clock.getElapsedTime() >= sf::milliseconds(MUD_TICK_TIME))
+        {
+            tick_clock.restart();
+            update();
+        }
+
+        // logins waiting on their password check, or on a timer
+        handleCredentialResults(&m_ClientRemovalQueue);
+        handleFlowTimers(&m_ClientRemovalQueue);
+
+        // wait for data, time out so updates keep happening when nobody is talking
+        // and sooner while password checks are out so logins are not held up
+        sf::Time wait_time = sf::milliseconds(MUD_TICK_TIME);
+        if(m_CredentialPool->hasOutstanding()) wait_time = sf::milliseconds(CREDENTIAL_POLL_TIME);
+        if(m_Selector.wait(wait_time))
         {
             // incoming connection?
             if(m_Selector.isReady(m_Listener))
             {
                 // create and accept new connection
-                sf::TcpSocket *newsocket = new sf::TcpSocket;
+                sf::TcpSocket *newsocket = acquireSocket();
                 m_Listener.accept(*newsocket);
 
                 // create client from accepted connection and add to client list
@@ -91,8 +182,7 @@ void Mud::sendAndRecieve()
                 newclient->func = welcome;
                 newclient->func(newclient);
                 // show login screen
-                newclient->func = AccountManager::loginProcess;
-                newclient->func(newclient);
+                startFlow(newclient, AccountManager::loginFlow(newclient));
 
             }
             // check for clients that are ready to send
@@ -101,28 +191,207 @@ void Mud::sendAndRecieve()
                 m_ClientMutex.lock();
                 for(int i = 0; i < int(m_Clients.size()); i++)
                 {
-                    // receive client data
-                    if(m_Clients[i]->isReady(&m_Selector))
+                    // clients in the world have their input run by their zone
+                    if(m_Clients[i]->getZone())
+                    {
+                        if(m_Clients[i]->m_Leaving || m_Clients[i]->m_LinkDead || !m_Clients[i]->isReady(&m_Selector)) continue;
+
+                        std::string input;
+                        m_Clients[i]->receive(&input);
+                        if(m_Clients[i]->isConnected()) m_ZoneScheduler->postInput(m_Clients[i], input);
+                        else if(!keepLinkDead(m_Clients[i]))
+                        {
+                            m_Clients[i]->m_Leaving = true;
+                            m_ZoneScheduler->postLeave(m_Clients[i]);
+                        }
+                    }
+                    // receive client data, clients that quit in the world are let go by their zone
+                    else if(!m_Clients[i]->m_Leaving && !m_Clients[i]->m_LinkDead && !m_Clients[i]->hasQuit() && m_Clients[i]->isReady(&m_Selector))
                     {
                         m_Clients[i]->receive();
                         // after receiving input from client, give feedback
                         m_Clients[i]->func(m_Clients[i]);
-                        if(!m_Clients[i]->isConnected()) m_ClientRemovalQueue.push_back(m_Clients[i]);
+                        checkClient(m_Clients[i], &m_ClientRemovalQueue);
                     }
                 }
                 m_ClientMutex.unlock();
             }
 
-            // clean up any clients that need to be removed
-            while(!m_ClientRemovalQueue.empty())
+        }
+
+        // clean up any clients that need to be removed
+        while(!m_ClientRemovalQueue.empty())
+        {
+            Client *tclient = m_ClientRemovalQueue.back();
+            m_ClientRemovalQueue.pop_back();
+            releaseClient(tclient);
+        }
+    }
+}
+
+void Mud::handleCredentialResults(std::vector<Client*> *removal_queue)
+{
+    std::vector<CredentialJob> jobs;
+    m_CredentialPool->takeFinished(&jobs);
+
+    for(int i = 0; i < int(jobs.size()); i++)
+    {
+        Client *tclient = jobs[i].client;
+        m_AccountManager->credentialResult(jobs[i]);
+        if(tclient && !tclient->m_Leaving) checkClient(tclient, removal_queue);
+    }
+}
+
+void Mud::handleFlowTimers(std::vector<Client*> *removal_queue)
+{
+    std::vector<Client*> resumed;
+    runFlowTimers(&resumed);
+    for(int i = 0; i < int(resumed.size()); i++) checkClient(resumed[i], removal_queue);
+}
+
+void Mud::checkClient(Client *tclient, std::vector<Client*> *removal_queue)
+{
+    if(!tclient->isConnected())
+    {
+        if(!keepLinkDead(tclient)) removal_queue->push_back(tclient);
+    }
+    // logged in, hand client over to its zone
+    else if(m_ZoneScheduler->isRunning() && tclient->func == Mud::mainGame) m_ZoneScheduler->enterWorld(tclient);
+}
+
+void Mud::update()
+{
+    // keep zones with players in them from being unloaded
+    m_ClientMutex.lock();
+    for(int i = 0; i < int(m_Clients.size()); i++)
+    {
+        if(m_Clients[i]->getRoom()) m_ZoneManager->touchRoom(m_Clients[i]->getRoom());
+    }
+    m_ClientMutex.unlock();
+
+    // unload idle zones
+    m_ZoneManager->update();
+
+    // sessions dropped too long ago
+    expireLinkDead();
+
+    // write position of players that moved, players leaving are written on the next update
+    // journaling makes handing positions over cheap, so with a journal every update does it
+    bool save_time = m_Journal || m_SaveClock.getElapsedTime() >= sf::seconds(PLAYER_SAVE_INTERVAL);
+    if(save_time)
+    {
+        m_SaveClock.restart();
+        queueMovedPlayers();
+    }
+    if((save_time || m_LogoutSaves) && m_AccountManager->hasPendingSaves())
+    {
+        m_AccountManager->flushPlayerSaves();
+    }
+    if(m_LogoutSaves) m_Checkpointer->request();
+    m_LogoutSaves = false;
+
+    // changes journaled since the last update go to the OS
+    if(m_Journal) m_Journal->flush();
+
+    // report storage usage
+    if(m_StatsClock.getElapsedTime() >= sf::seconds(DB_STATS_INTERVAL))
+    {
+        m_StatsClock.restart();
+        m_Storage->printStats();
+        m_Checkpointer->printStats();
+        if(m_Journal) m_Journal->printStats();
+    }
+}
+
+void Mud::queueMovedPlayers()
+{
+    std::vector<std::pair<std::string, int> > moved;
+
+    m_OnlineMutex.lock();
+    for(std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.begin(); it != m_OnlinePlayers.end(); it++)
+    {
+        Client *tclient = it->second;
+        if(tclient->m_Dirty.exchange(false)) moved.push_back(std::make_pair(tclient->getName(), tclient->getRoom()));
+    }
+    m_OnlineMutex.unlock();
+
+    for(int i = 0; i < int(moved.size()); i++) m_AccountManager->queuePlayerSave(moved[i].first, moved[i].second);
+}
+
+void Mud::removeReleasedClients()
+{
+    m_ZoneScheduler->takeReleased(&m_ReleasedClients);
+
+    // zone events may still be on their way to the client
+    for(int i = int(m_ReleasedClients.size()) - 1; i >= 0; i--)
+    {
+        if(m_ReleasedClients[i]->m_PendingEvents) continue;
+        removeClient(m_ReleasedClients[i]);
+        m_ReleasedClients.erase(m_ReleasedClients.begin() + i);
+    }
+}
+
+// players in the game keep their place for a while in case they come back
+bool Mud::keepLinkDead(Client *tclient)
+{
+    if(LINKDEAD_TIME <= 0 || tclient->hasQuit() || tclient->func != Mud::mainGame) return false;
+
+    tclient->m_LinkDead = true;
+    tclient->m_LinkDeadClock.restart();
+    std::cout << tclient->getName() << " has gone link-dead.\n";
+    broadcastToRoomExcluding(tclient->getRoom(), tclient->getName() + " has lost their link.\n", tclient);
+    updateSelector();
+    return true;
+}
+
+void Mud::expireLinkDead()
+{
+    std::vector<Client*> expired;
+
+    m_ClientMutex.lock();
+    for(int i = 0; i < int(m_Clients.size()); i++)
+    {
+        Client *tclient = m_Clients[i];
+        if(tclient->m_Leaving) continue;
+
+        // connections zones found dead while sending, clients that quit are let go by their zone
+        if(!tclient->m_LinkDead && tclient->getZone() && !tclient->isConnected() && !tclient->hasQuit())
+        {
+            if(!keepLinkDead(tclient))
             {
-                Client *tclient = m_ClientRemovalQueue.back();
-                m_ClientRemovalQueue.pop_back();
-                removeClient(tclient);
+                tclient->m_Leaving = true;
+                m_ZoneScheduler->postLeave(tclient);
             }
-
+        }
+        else if(tclient->m_LinkDead && tclient->m_LinkDeadClock.getElapsedTime() >= sf::seconds(LINKDEAD_TIME))
+        {
+            std::cout << tclient->getName() << " link-dead session expired.\n";
+            tclient->m_LinkDead = false;
+            // zones only let go of link-dead clients when told to
+            if(tclient->getZone())
+            {
+                tclient->m_Leaving = true;
+                m_ZoneScheduler->postLeave(tclient);
+            }
+            else expired.push_back(tclient);
         }
     }
+    m_ClientMutex.unlock();
+
+    for(int i = 0; i < int(expired.size()); i++) releaseClient(expired[i]);
+}
+
+// remove client now, or once nothing refers to it
+void Mud::releaseClient(Client *tclient)
+{
+    if(!tclient->m_PendingEvents)
+    {
+        removeClient(tclient);
+        return;
+    }
+    tclient->m_Leaving = true;
+    m_ReleasedClients.push_back(tclient);
+    updateSelector();
 }
 
 // adds a new client to be managed by server
@@ -170,6 +439,7 @@ bool Mud::removeClient(Client *tclient)
     // delete client
     if(client_found)
     {
+        removeOnlinePlayer(tclient);
         delete tclient;
         std::cout << "Client disconnected.\n";
     }
@@ -180,6 +450,26 @@ bool Mud::removeClient(Client *tclient)
     return client_found;
 }
 
+sf::TcpSocket *Mud::acquireSocket()
+{
+    if(m_FreeSockets.empty()) return new sf::TcpSocket;
+    sf::TcpSocket *tsocket = m_FreeSockets.back();
+    m_FreeSockets.pop_back();
+    return tsocket;
+}
+
+void Mud::releaseSocket(sf::TcpSocket *tsocket)
+{
+    if(!tsocket) return;
+    if(int(m_FreeSockets.size()) >= SOCKET_POOL_MAX)
+    {
+        delete tsocket;
+        return;
+    }
+    // disconnected sockets are left ready to accept into again
+    m_FreeSockets.push_back(tsocket);
+}
+
 void Mud::updateSelector()
 {
     m_Selector.clear();
@@ -189,6 +479,7 @@ void Mud::updateSelector()
     m_ClientMutex.lock();
     for(int i = 0; i < int(m_Clients.size()); i++)
     {
+        if(m_Clients[i]->m_Leaving) continue;
         if(!m_Clients[i]->addToSelector(&m_Selector))
         {
             std::cout << "Error updating selector when adding client!!\n";
@@ -211,6 +502,12 @@ bool Mud::broadcast(std::string msg)
 
 bool Mud::broadcastToRoom(int room_id, std::string msg)
 {
+    // deliver through the room's zone so it arrives in order with the zone's own events
+    if(m_ZoneScheduler->isRunning() && m_ZoneManager->roomExists(room_id))
+    {
+        m_ZoneScheduler->postRoomMessage(room_id, msg);
+        return true;
+    }
     if(m_ZoneManager->roomExists(room_id))
     {
         m_ClientMutex.lock();
@@ -228,6 +525,11 @@ bool Mud::broadcastToRoom(int room_id, std::string msg)
 bool Mud::broadcastToRoomExcluding(int room_id, std::string msg, Client *tclient)
 {
     if(!tclient) return false;
+    if(m_ZoneScheduler->isRunning() && m_ZoneManager->roomExists(room_id))
+    {
+        m_ZoneScheduler->postRoomMessage(room_id, msg, tclient);
+        return true;
+    }
     if(m_ZoneManager->roomExists(room_id))
     {
         m_ClientMutex.lock();
@@ -245,7 +547,7 @@ bool Mud::broadcastToRoomExcluding(int room_id, std::string msg, Client *tclient
 std::vector<std::string> Mud::getPlayerNames(int room_id)
 {
     std::vector<std::string> players;
-    if(m_ZoneManager->roomExists(!room_id) && room_id) return players;
+    if(room_id && !m_ZoneManager->roomExists(room_id)) return players;
 
     m_ClientMutex.lock();
     for(int i = 0; i < int(m_Clients.size()); i++)
@@ -256,9 +558,148 @@ std::vector<std::string> Mud::getPlayerNames(int room_id)
         }
         else players.push_back(m_Clients[i]->getName());
     }
+    m_ClientMutex.unlock();
     return players;
 }
 
+void Mud::appendPlayersHere(int room_id, Client *tclient, std::string *text)
+{
+    m_ClientMutex.lock();
+    for(int i = 0; i < int(m_Clients.size()); i++)
+    {
+        if(m_Clients[i] != tclient && m_Clients[i]->getRoom() == room_id)
+        {
+            text->append(m_Clients[i]->getName());
+            text->append(" is here.\n");
+        }
+    }
+    m_ClientMutex.unlock();
+}
+
+// returns room id of logged in player, 0 if not found
+int Mud::getPlayerRoom(std::string username)
+{
+    int room_id = 0;
+
+    m_OnlineMutex.lock();
+    std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.find(toLower(username));
+    if(it != m_OnlinePlayers.end()) room_id = it->second->getRoom();
+    m_OnlineMutex.unlock();
+    return room_id;
+}
+
+bool Mud::addOnlinePlayer(Client *tclient)
+{
+    bool added = false;
+
+    m_OnlineMutex.lock();
+    std::string key = toLower(tclient->getName());
+    if(!m_OnlinePlayers.count(key))
+    {
+        m_OnlinePlayers[key] = tclient;
+        added = true;
+    }
+    m_OnlineMutex.unlock();
+    return added;
+}
+
+void Mud::removeOnlinePlayer(Client *tclient)
+{
+    bool removed = false;
+
+    m_OnlineMutex.lock();
+    std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.find(toLower(tclient->getName()));
+    // only the entry for this client, not another login under the same name
+    if(it != m_OnlinePlayers.end() && it->second == tclient)
+    {
+        m_OnlinePlayers.erase(it);
+        removed = true;
+    }
+    m_OnlineMutex.unlock();
+
+    // final save of where the player left off
+    if(removed && tclient->m_Dirty.exchange(false))
+    {
+        m_AccountManager->queuePlayerSave(tclient->getName(), tclient->getRoom());
+        m_LogoutSaves = true;
+    }
+}
+
+bool Mud::isPlayerOnline(std::string username)
+{
+    m_OnlineMutex.lock();
+    bool online = m_OnlinePlayers.count(toLower(username)) != 0;
+    m_OnlineMutex.unlock();
+    return online;
+}
+
+bool Mud::isPlayerLinkDead(std::string username)
+{
+    m_OnlineMutex.lock();
+    std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.find(toLower(username));
+    bool linkdead = it != m_OnlinePlayers.end() && it->second->m_LinkDead;
+    m_OnlineMutex.unlock();
+    return linkdead;
+}
+
+bool Mud::reattachSession(Client *tclient, std::string username)
+{
+    Client *session = NULL;
+
+    m_OnlineMutex.lock();
+    std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.find(toLower(username));
+    if(it != m_OnlinePlayers.end() && it->second->m_LinkDead && !it->second->m_Leaving) session = it->second;
+    m_OnlineMutex.unlock();
+    if(!session) return false;
+
+    // session carries on with the new connection, login client is removed with the dead one
+    session->swapSocket(tclient);
+    session->m_LinkDead = false;
+    updateSelector();
+    std::cout << session->getName() << " has reconnected.\n";
+
+    session->send("Reconnected.\n");
+    broadcastToRoomExcluding(session->getRoom(), session->getName() + " has reconnected.\n", session);
+    // look around through the zone so it runs in order with the session's other input
+    if(session->getZone()) m_ZoneScheduler->postInput(session, "look");
+    else
+    {
+        session->parseCommand("look");
+        session->sendPrompt();
+    }
+    return true;
+}
+
+bool Mud::sendToPlayer(std::string username, std::string msg, std::string *name)
+{
+    bool found = false;
+
+    // sent under the lock so the client can not be removed part way through
+    m_OnlineMutex.lock();
+    std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.find(toLower(username));
+    if(it != m_OnlinePlayers.end())
+    {
+        if(name) *name = it->second->getName();
+        it->second->send(msg);
+        found = true;
+    }
+    m_OnlineMutex.unlock();
+    return found;
+}
+
+int Mud::appendOnlinePlayers(std::string *text)
+{
+    m_OnlineMutex.lock();
+    int count = int(m_OnlinePlayers.size());
+    for(std::unordered_map<std::string, Client*>::iterator it = m_OnlinePlayers.begin(); it != m_OnlinePlayers.end(); it++)
+    {
+        text->append(it->second->getName());
+        text->append("\n");
+    }
+    m_OnlineMutex.unlock();
+    return count;
+}
+
 int Mud::mainGame(Client *tclient)
 {
     if(!tclient) return 0;
@@ -0,0 +1,387 @@
+#include "password.hpp"
+
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <sstream>
+#include <vector>
+#include <SFML/System.hpp>
+
+//////////////////////////////////////////////////////////////////
+// SHA-256
+
+struct Sha256
+{
+    sf::Uint32 state[8];
+    sf::Uint64 length;          // bytes hashed
+    unsigned char buffer[64];
+    int buffer_size;
+};
+
+static const sf::Uint32 sha256_k[64] =
+    {
+        0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+        0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+        0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+        0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+        0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+        0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+        0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+        0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+    };
+
+static inline sf::Uint32 rotr(sf::Uint32 x, int n) { return (x >> n) | (x << (32 - n));}
+static inline sf::Uint32 rotl(sf::Uint32 x, int n) { return (x << n) | (x >> (32 - n));}
+
+static void sha256Init(Sha256 *ctx)
+{
+    static const sf::Uint32 initial[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(ctx->state, initial, sizeof(initial));
+    ctx->length = 0;
+    ctx->buffer_size = 0;
+}
+
+static void sha256Block(Sha256 *ctx, const unsigned char *block)
+{
+    sf::Uint32 w[64];
+    for(int i = 0; i < 16; i++)
+    {
+        w[i] = (sf::Uint32(block[i*4]) << 24) | (sf::Uint32(block[i*4+1]) << 16) | (sf::Uint32(block[i*4+2]) << 8) | sf::Uint32(block[i*4+3]);
+    }
+    for(int i = 16; i < 64; i++)
+    {
+        sf::Uint32 s0 = rotr(w[i-15], 7) ^ rotr(w[i-15], 18) ^ (w[i-15] >> 3);
+        sf::Uint32 s1 = rotr(w[i-2], 17) ^ rotr(w[i-2], 19) ^ (w[i-2] >> 10);
+        w[i] = w[i-16] + s0 + w[i-7] + s1;
+    }
+
+    sf::Uint32 a = ctx->state[0], b = ctx->state[1], c = ctx->state[2], d = ctx->state[3];
+    sf::Uint32 e = ctx->state[4], f = ctx->state[5], g = ctx->state[6], h = ctx->state[7];
+    for(int i = 0; i < 64; i++)
+    {
+        sf::Uint32 t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+        sf::Uint32 t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+        h = g;
+        g = f;
+        f = e;
+        e = d + t1;
+        d = c;
+        c = b;
+        b = a;
+        a = t1 + t2;
+    }
+    ctx->state[0] += a; ctx->state[1] += b; ctx->state[2] += c; ctx->state[3] += d;
+    ctx->state[4] += e; ctx->state[5] += f; ctx->state[6] += g; ctx->state[7] += h;
+}
+
+static void sha256Update(Sha256 *ctx, const unsigned char *data, size_t size)
+{
+    ctx->length += size;
+    while(size)
+    {
+        size_t take = 64 - ctx->buffer_size;
+        if(take > size) take = size;
+        memcpy(ctx->buffer + ctx->buffer_size, data, take);
+        ctx->buffer_size += int(take);
+        data += take;
+        size -= take;
+        if(ctx->buffer_size == 64)
+        {
+            sha256Block(ctx, ctx->buffer);
+            ctx->buffer_size = 0;
+        }
+    }
+}
+
+static void sha256Final(Sha256 *ctx, unsigned char *digest)
+{
+    sf::Uint64 bits = ctx->length * 8;
+    unsigned char pad = 0x80;
+    sha256Update(ctx, &pad, 1);
+    pad = 0;
+    while(ctx->buffer_size != 56) sha256Update(ctx, &pad, 1);
+    unsigned char length[8];
+    for(int i = 0; i < 8; i++) length[i] = (unsigned char)(bits >> (56 - i * 8));
+    sha256Update(ctx, length, 8);
+
+    for(int i = 0; i < 8; i++)
+    {
+        digest[i*4] = (unsigned char)(ctx->state[i] >> 24);
+        digest[i*4+1] = (unsigned char)(ctx->state[i] >> 16);
+        digest[i*4+2] = (unsigned char)(ctx->state[i] >> 8);
+        digest[i*4+3] = (unsigned char)(ctx->state[i]);
+    }
+}
+
+//////////////////////////////////////////////////////////////////
+// HMAC-SHA256 / PBKDF2
+
+struct HmacSha256
+{
+    Sha256 inner;
+    Sha256 outer;
+};
+
+static void hmacInit(HmacSha256 *ctx, const unsigned char *key, size_t key_size)
+{
+    unsigned char key_block[64];
+    memset(key_block, 0, sizeof(key_block));
+    if(key_size > 64)
+    {
+        Sha256 key_hash;
+        sha256Init(&key_hash);
+        sha256Update(&key_hash, key, key_size);
+        sha256Final(&key_hash, key_block);
+    }
+    else if(key_size) memcpy(key_block, key, key_size);
+
+    unsigned char pad[64];
+    for(int i = 0; i < 64; i++) pad[i] = key_block[i] ^ 0x36;
+    sha256Init(&ctx->inner);
+    sha256Update(&ctx->inner, pad, 64);
+    for(int i = 0; i < 64; i++) pad[i] = key_block[i] ^ 0x5c;
+    sha256Init(&ctx->outer);
+    sha256Update(&ctx->outer, pad, 64);
+}
+
+static void hmacFinal(HmacSha256 *ctx, unsigned char *mac)
+{
+    unsigned char inner_digest[32];
+    sha256Final(&ctx->inner, inner_digest);
+    sha256Update(&ctx->outer, inner_digest, 32);
+    sha256Final(&ctx->outer, mac);
+}
+
+static void pbkdf2Sha256(const unsigned char *password, size_t password_size, const unsigned char *salt, size_t salt_size,
+                         int iterations, unsigned char *out, size_t out_size)
+{
+    // key is the same for every block, only hash it once
+    HmacSha256 keyed;
+    hmacInit(&keyed, password, password_size);
+
+    for(sf::Uint32 block = 1; out_size; block++)
+    {
+        unsigned char counter[4] = {(unsigned char)(block >> 24), (unsigned char)(block >> 16), (unsigned char)(block >> 8), (unsigned char)block};
+        unsigned char u[32];
+        unsigned char t[32];
+
+        HmacSha256 ctx = keyed;
+        sha256Update(&ctx.inner, salt, salt_size);
+        sha256Update(&ctx.inner, counter, 4);
+        hmacFinal(&ctx, u);
+        memcpy(t, u, 32);
+        for(int i = 1; i < iterations; i++)
+        {
+            ctx = keyed;
+            sha256Update(&ctx.inner, u, 32);
+            hmacFinal(&ctx, u);
+            for(int n = 0; n < 32; n++) t[n] ^= u[n];
+        }
+
+        size_t take = out_size < 32 ? out_size : 32;
+        memcpy(out, t, take);
+        out += take;
+        out_size -= take;
+    }
+}
+
+//////////////////////////////////////////////////////////////////
+// scrypt
+
+static void salsa208(sf::Uint32 *b)
+{
+    sf::Uint32 x[16];
+    memcpy(x, b, sizeof(x));
+    for(int i = 0; i < 8; i += 2)
+    {
+        x[ 4] ^= rotl(x[ 0]+x[12], 7);  x[ 8] ^= rotl(x[ 4]+x[ 0], 9);
+        x[12] ^= rotl(x[ 8]+x[ 4],13);  x[ 0] ^= rotl(x[12]+x[ 8],18);
+        x[ 9] ^= rotl(x[ 5]+x[ 1], 7);  x[13] ^= rotl(x[ 9]+x[ 5], 9);
+        x[ 1] ^= rotl(x[13]+x[ 9],13);  x[ 5] ^= rotl(x[ 1]+x[13],18);
+        x[14] ^= rotl(x[10]+x[ 6], 7);  x[ 2] ^= rotl(x[14]+x[10], 9);
+        x[ 6] ^= rotl(x[ 2]+x[14],13);  x[10] ^= rotl(x[ 6]+x[ 2],18);
+        x[ 3] ^= rotl(x[15]+x[11], 7);  x[ 7] ^= rotl(x[ 3]+x[15], 9);
+        x[11] ^= rotl(x[ 7]+x[ 3],13);  x[15] ^= rotl(x[11]+x[ 7],18);
+        x[ 1] ^= rotl(x[ 0]+x[ 3], 7);  x[ 2] ^= rotl(x[ 1]+x[ 0], 9);
+        x[ 3] ^= rotl(x[ 2]+x[ 1],13);  x[ 0] ^= rotl(x[ 3]+x[ 2],18);
+        x[ 6] ^= rotl(x[ 5]+x[ 4], 7);  x[ 7] ^= rotl(x[ 6]+x[ 5], 9);
+        x[ 4] ^= rotl(x[ 7]+x[ 6],13);  x[ 5] ^= rotl(x[ 4]+x[ 7],18);
+        x[11] ^= rotl(x[10]+x[ 9], 7);  x[ 8] ^= rotl(x[11]+x[10], 9);
+        x[ 9] ^= rotl(x[ 8]+x[11],13);  x[10] ^= rotl(x[ 9]+x[ 8],18);
+        x[12] ^= rotl(x[15]+x[14], 7);  x[13] ^= rotl(x[12]+x[15], 9);
+        x[14] ^= rotl(x[13]+x[12],13);  x[15] ^= rotl(x[14]+x[13],18);
+    }
+    for(int i = 0; i < 16; i++) b[i] += x[i];
+}
+
+// b is 2 * r 64 byte blocks, y is scratch of the same size
+static void blockMix(sf::Uint32 *b, sf::Uint32 *y, int r)
+{
+    sf::Uint32 x[16];
+    memcpy(x, &b[(2 * r - 1) * 16], 64);
+
+    for(int i = 0; i < 2 * r; i++)
+    {
+        for(int n = 0; n < 16; n++) x[n] ^= b[i * 16 + n];
+        salsa208(x);
+        // even blocks go to the first half of the output, odd blocks to the second
+        memcpy(&y[((i & 1) * r + i / 2) * 16], x, 64);
+    }
+    memcpy(b, y, 128 * r);
+}
+
+static void roMix(unsigned char *block, int r, int N, sf::Uint32 *v, sf::Uint32 *x, sf::Uint32 *y)
+{
+    int words = 32 * r;
+
+    for(int i = 0; i < words; i++)
+    {
+        const unsigned char *p = &block[i * 4];
+        x[i] = sf::Uint32(p[0]) | (sf::Uint32(p[1]) << 8) | (sf::Uint32(p[2]) << 16) | (sf::Uint32(p[3]) << 24);
+    }
+
+    for(int i = 0; i < N; i++)
+    {
+        memcpy(&v[size_t(i) * words], x, words * 4);
+        blockMix(x, y, r);
+    }
+    for(int i = 0; i < N; i++)
+    {
+        sf::Uint32 j = x[(2 * r - 1) * 16] & sf::Uint32(N - 1);
+        const sf::Uint32 *vj = &v[size_t(j) * words];
+        for(int n = 0; n < words; n++) x[n] ^= vj[n];
+        blockMix(x, y, r);
+    }
+
+    for(int i = 0; i < words; i++)
+    {
+        unsigned char *p = &block[i * 4];
+        p[0] = (unsigned char)x[i];
+        p[1] = (unsigned char)(x[i] >> 8);
+        p[2] = (unsigned char)(x[i] >> 16);
+        p[3] = (unsigned char)(x[i] >> 24);
+    }
+}
+
+bool scrypt(const std::string &password, const std::string &salt, int N, int r, int p, unsigned char *out, int out_size)
+{
+    // N must be a power of two greater than 1
+    if(N < 2 || (N & (N - 1)) || r < 1 || p < 1 || out_size < 1) return false;
+    if(sf::Uint64(r) * p >= (1 << 30) || N > (1 << 24) / r) return false;
+
+    const unsigned char *pass = reinterpret_cast<const unsigned char*>(password.data());
+    std::vector<unsigned char> blocks(size_t(128) * r * p);
+    pbkdf2Sha256(pass, password.size(), reinterpret_cast<const unsigned char*>(salt.data()), salt.size(), 1, &blocks[0], blocks.size());
+
+    std::vector<sf::Uint32> v(size_t(32) * r * N);
+    std::vector<sf::Uint32> x(32 * r);
+    std::vector<sf::Uint32> y(32 * r);
+    for(int i = 0; i < p; i++)
+    {
+        roMix(&blocks[size_t(128) * r * i], r, N, &v[0], &x[0], &y[0]);
+    }
+
+    pbkdf2Sha256(pass, password.size(), &blocks[0], blocks.size(), 1, out, out_size);
+    return true;
+}
+
+//////////////////////////////////////////////////////////////////
+// stored passwords
+
+static std::string toHex(const unsigned char *data, int size)
+{
+    static const char digits[] = "0123456789abcdef";
+    std::string hex;
+    for(int i = 0; i < size; i++)
+    {
+        hex.push_back(digits[data[i] >> 4]);
+        hex.push_back(digits[data[i] & 0x0f]);
+    }
+    return hex;
+}
+
+static bool fromHex(const std::string &hex, std::string *data)
+{
+    if(hex.size() % 2) return false;
+    data->clear();
+    for(int i = 0; i < int(hex.size()); i += 2)
+    {
+        int value = 0;
+        for(int n = 0; n < 2; n++)
+        {
+            char ch = hex[i + n];
+            value <<= 4;
+            if(ch >= '0' && ch <= '9') value |= ch - '0';
+            else if(ch >= 'a' && ch <= 'f') value |= ch - 'a' + 10;
+            else return false;
+        }
+        data->push_back(char(value));
+    }
+    return true;
+}
+
+// compare without stopping at the first difference
+static bool constantTimeEquals(const std::string &a, const std::string &b)
+{
+    unsigned char diff = (a.size() != b.size());
+    for(size_t i = 0; i < a.size() && i < b.size(); i++) diff |= a[i] ^ b[i];
+    return diff == 0;
+}
+
+struct StoredPassword
+{
+    int N, r, p;
+    std::string salt;
+    std::string hash;
+};
+
+static bool parseStoredPassword(const std::string &stored, StoredPassword *parsed)
+{
+    std::vector<std::string> fields;
+    std::stringstream ss(stored);
+    std::string field;
+    while(std::getline(ss, field, '$')) fields.push_back(field);
+
+    if(fields.size() != 6 || fields[0] != "scrypt") return false;
+    parsed->N = atoi(fields[1].c_str());
+    parsed->r = atoi(fields[2].c_str());
+    parsed->p = atoi(fields[3].c_str());
+    if(!fromHex(fields[4], &parsed->salt) || !fromHex(fields[5], &parsed->hash) || parsed->hash.empty()) return false;
+    return true;
+}
+
+std::string hashPassword(const std::string &password)
+{
+    unsigned char salt[PASSWORD_SALT_SIZE];
+    std::random_device random;
+    for(int i = 0; i < PASSWORD_SALT_SIZE; i++) salt[i] = (unsigned char)random();
+
+    unsigned char hash[PASSWORD_HASH_SIZE];
+    std::string salt_str(reinterpret_cast<const char*>(salt), PASSWORD_SALT_SIZE);
+    if(!scrypt(password, salt_str, PASSWORD_SCRYPT_N, PASSWORD_SCRYPT_R, PASSWORD_SCRYPT_P, hash, PASSWORD_HASH_SIZE)) return "";
+
+    std::stringstream ss;
+    ss << "scrypt$" << PASSWORD_SCRYPT_N << "$" << PASSWORD_SCRYPT_R << "$" << PASSWORD_SCRYPT_P << "$";
+    ss << toHex(salt, PASSWORD_SALT_SIZE) << "$" << toHex(hash, PASSWORD_HASH_SIZE);
+    return ss.str();
+}
+
+bool verifyPassword(const std::string &password, const std::string &stored)
+{
+    StoredPassword parsed;
+
+    // passwords saved before hashing was added
+    if(stored.compare(0, 7, "scrypt$") != 0) return constantTimeEquals(password, stored);
+
+    if(!parseStoredPassword(stored, &parsed)) return false;
+    std::vector<unsigned char> hash(parsed.hash.size());
+    if(!scrypt(password, parsed.salt, parsed.N, parsed.r, parsed.p, &hash[0], int(hash.size()))) return false;
+    return constantTimeEquals(std::string(reinterpret_cast<const char*>(&hash[0]), hash.size()), parsed.hash);
+}
+
+bool passwordNeedsRehash(const std::string &stored)
+{
+    StoredPassword parsed;
+    if(!parseStoredPassword(stored, &parsed)) return true;
+    return parsed.N != PASSWORD_SCRYPT_N || parsed.r != PASSWORD_SCRYPT_R || parsed.p != PASSWORD_SCRYPT_P;
+}
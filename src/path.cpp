@@ -0,0 +1,205 @@
+#include "path.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include "zone.hpp"
+#include "direction.hpp"
+
+PathFinder::PathFinder(ZoneManager *zmgr)
+{
+    m_ZoneManager = zmgr;
+    m_Generation = 0;
+    m_CacheGeneration = 0;
+}
+
+PathFinder::~PathFinder()
+{
+    for(int i = 0; i < int(m_FreeSearches.size()); i++) delete m_FreeSearches[i];
+}
+
+PathSearch *PathFinder::acquireSearch()
+{
+    PathSearch *tsearch = NULL;
+
+    m_Mutex.lock();
+    if(!m_FreeSearches.empty())
+    {
+        tsearch = m_FreeSearches.back();
+        m_FreeSearches.pop_back();
+    }
+    m_Mutex.unlock();
+
+    // every search space in use, another one is kept for later searches
+    if(!tsearch) tsearch = new PathSearch;
+    return tsearch;
+}
+
+void PathFinder::releaseSearch(PathSearch *tsearch)
+{
+    m_Mutex.lock();
+    m_FreeSearches.push_back(tsearch);
+    m_Mutex.unlock();
+}
+
+void PathFinder::growSearch(PathSearch *tsearch, int size)
+{
+    if(int(tsearch->visited.size()) >= size) return;
+
+    tsearch->visited.resize(size, 0);
+    tsearch->parent.resize(size, 0);
+    tsearch->step.resize(size, -1);
+}
+
+void PathFinder::prepareSearch(PathSearch *tsearch)
+{
+    // grow scratch space if rooms were added since the last search
+    growSearch(tsearch, m_ZoneManager->getRoomCount());
+
+    // new stamp for this search, clear everything if the stamp wrapped around
+    tsearch->stamp++;
+    if(tsearch->stamp == 0)
+    {
+        for(int i = 0; i < int(tsearch->visited.size()); i++) tsearch->visited[i] = 0;
+        tsearch->stamp = 1;
+    }
+    tsearch->named_exits.clear();
+}
+
+bool PathFinder::findPath(int from, int to, std::vector<std::string> *route)
+{
+    if(!route) return false;
+    route->clear();
+
+    if(!m_ZoneManager->roomExists(from) || !m_ZoneManager->roomExists(to)) return false;
+    if(from == to) return true;
+
+    unsigned long long key = (static_cast<unsigned long long>(from) << 32) | static_cast<unsigned int>(to);
+
+    // check route cache, move hit to front
+    m_Mutex.lock();
+    unsigned int generation = m_Generation;
+    if(m_CacheGeneration != generation)
+    {
+        m_Cache.clear();
+        m_CacheIndex.clear();
+        m_CacheGeneration = generation;
+    }
+    std::unordered_map<unsigned long long, std::list<PathCacheEntry>::iterator>::iterator cit = m_CacheIndex.find(key);
+    if(cit != m_CacheIndex.end())
+    {
+        m_Cache.splice(m_Cache.begin(), m_Cache, cit->second);
+        *route = cit->second->route;
+        bool found = cit->second->found;
+        m_Mutex.unlock();
+        return found;
+    }
+    m_Mutex.unlock();
+
+    PathSearch *tsearch = acquireSearch();
+    bool found = search(tsearch, from, to, route);
+    releaseSearch(tsearch);
+
+    // links changed during the search, the route may already be out of date
+    m_Mutex.lock();
+    if(m_Generation != generation || m_CacheGeneration != generation || m_CacheIndex.count(key))
+    {
+        m_Mutex.unlock();
+        return found;
+    }
+
+    // store result in cache, dropping the least recently used route if full
+    m_Cache.push_front(PathCacheEntry());
+    m_Cache.front().key = key;
+    m_Cache.front().found = found;
+    m_Cache.front().route = *route;
+    m_CacheIndex[key] = m_Cache.begin();
+    if(int(m_Cache.size()) > PATH_CACHE_SIZE)
+    {
+        m_CacheIndex.erase(m_Cache.back().key);
+        m_Cache.pop_back();
+    }
+    m_Mutex.unlock();
+
+    return found;
+}
+
+std::string PathFinder::getNextStep(int from, int to)
+{
+    std::vector<std::string> route;
+    if(!findPath(from, to, &route) || route.empty()) return "";
+    return route[0];
+}
+
+void PathFinder::invalidate()
+{
+    // cache is dropped by the next search to see the new generation
+    m_Generation++;
+}
+
+// breadth first search following every exit that can be taken
+// one way and named exits have no exit back, so the search only runs forward from the start
+bool PathFinder::search(PathSearch *tsearch, int from, int to, std::vector<std::string> *route)
+{
+    std::vector<int> frontier;
+    std::vector<int> next;
+    std::vector<SpecialExit> exits;
+    bool found = false;
+    int room_count = 1;
+
+    prepareSearch(tsearch);
+    growSearch(tsearch, std::max(from, to) + 1);
+
+    tsearch->visited[from] = tsearch->stamp;
+    tsearch->parent[from] = 0;
+    frontier.push_back(from);
+
+    while(!frontier.empty() && !found)
+    {
+        for(int i = 0; i < int(frontier.size()) && !found; i++)
+        {
+            int room = frontier[i];
+            if(!m_ZoneManager->getOpenExits(room, &exits)) continue;
+
+            for(int n = 0; n < int(exits.size()); n++)
+            {
+                int troom = exits[n].to_room;
+                if(troom <= 0) continue;
+                growSearch(tsearch, troom + 1);
+                if(tsearch->visited[troom] == tsearch->stamp) continue;
+
+                // far away or unreachable, stop before loading the rest of the world
+                if(++room_count > PATH_MAX_ROOMS) return false;
+
+                tsearch->visited[troom] = tsearch->stamp;
+                tsearch->parent[troom] = room;
+                if(exits[n].dir != -1) tsearch->step[troom] = exits[n].dir;
+                else
+                {
+                    tsearch->step[troom] = DIR_COUNT + int(tsearch->named_exits.size());
+                    tsearch->named_exits.push_back(exits[n].name);
+                }
+
+                if(troom == to)
+                {
+                    found = true;
+                    break;
+                }
+                next.push_back(troom);
+            }
+        }
+        frontier.swap(next);
+        next.clear();
+    }
+    if(!found) return false;
+
+    // walk back from destination to start
+    for(int room = to; room != from; room = tsearch->parent[room])
+    {
+        int step = tsearch->step[room];
+        if(step < DIR_COUNT) route->push_back(dirs[step].name);
+        else route->push_back(tsearch->named_exits[step - DIR_COUNT]);
+    }
+    std::reverse(route->begin(), route->end());
+
+    return true;
+}
@@ -0,0 +1,346 @@
+#include "scheduler.hpp"
+
+#include <iostream>
+#include "client.hpp"
+#include "zone.hpp"
+
+bool ZoneScheduler::m_Initialized = false;
+
+// actor the calling worker is running, if any
+static thread_local ZoneActor *t_CurrentActor = NULL;
+
+ZoneScheduler::ZoneScheduler(ZoneManager *zmgr)
+{
+    if(m_Initialized)
+    {
+        std::cout << "Zone scheduler already initialized!\n";
+        return;
+    }
+    m_Initialized = true;
+
+    m_ZoneManager = zmgr;
+    m_Running = false;
+}
+
+ZoneScheduler::~ZoneScheduler()
+{
+    stop();
+    for(std::unordered_map<int, ZoneActor*>::iterator it = m_Actors.begin(); it != m_Actors.end(); it++)
+    {
+        delete it->second;
+    }
+}
+
+void ZoneScheduler::start()
+{
+    if(m_Running) return;
+    m_Running = true;
+
+    for(int i = 0; i < ZONE_WORKER_THREADS; i++)
+    {
+        sf::Thread *worker = new sf::Thread(&ZoneScheduler::run, this);
+        m_Workers.push_back(worker);
+        worker->launch();
+    }
+    std::cout << ZONE_WORKER_THREADS << " zone worker threads started.\n";
+}
+
+void ZoneScheduler::stop()
+{
+    if(!m_Running) return;
+
+    // set under the run mutex so a worker can not miss the wake up between checking and waiting
+    m_RunMutex.lock();
+    m_Running = false;
+    m_RunMutex.unlock();
+    m_RunReady.notify_all();
+
+    for(int i = 0; i < int(m_Workers.size()); i++)
+    {
+        m_Workers[i]->wait();
+        delete m_Workers[i];
+    }
+    m_Workers.clear();
+}
+
+ZoneActor *ZoneScheduler::getActor(int zone)
+{
+    ZoneActor *tactor = NULL;
+
+    m_ActorMutex.lock();
+    std::unordered_map<int, ZoneActor*>::iterator it = m_Actors.find(zone);
+    if(it != m_Actors.end()) tactor = it->second;
+    else
+    {
+        tactor = new ZoneActor;
+        tactor->zone = zone;
+        m_Actors[zone] = tactor;
+    }
+    m_ActorMutex.unlock();
+
+    return tactor;
+}
+
+// worker loop, takes the next zone with events waiting and runs it
+void ZoneScheduler::run()
+{
+    while(true)
+    {
+        ZoneActor *tactor = NULL;
+        {
+            std::unique_lock<std::mutex> lock(m_RunMutex);
+            while(m_Running && m_RunQueue.empty()) m_RunReady.wait(lock);
+            if(!m_Running) break;
+            tactor = m_RunQueue.front();
+            m_RunQueue.pop_front();
+        }
+        runActor(tactor);
+    }
+}
+
+// expects actor mutex to be locked
+void ZoneScheduler::queueActor(ZoneActor *tactor)
+{
+    m_RunMutex.lock();
+    m_RunQueue.push_back(tactor);
+    m_RunMutex.unlock();
+    m_RunReady.notify_one();
+}
+
+void ZoneScheduler::runActor(ZoneActor *tactor)
+{
+    t_CurrentActor = tactor;
+    for(int i = 0; i < ZONE_EVENTS_PER_RUN; i++)
+    {
+        tactor->mutex.lock();
+        if(tactor->mailbox.empty())
+        {
+            tactor->mutex.unlock();
+            break;
+        }
+        ZoneEvent tevent = tactor->mailbox.front();
+        tactor->mailbox.pop_front();
+        tactor->mutex.unlock();
+
+        handleEvent(tactor, tevent);
+        tactor->event_count++;
+    }
+    t_CurrentActor = NULL;
+
+    // go to the back of the run queue if there is more to do
+    tactor->mutex.lock();
+    if(tactor->mailbox.empty()) tactor->scheduled = false;
+    else
+    {
+        queueActor(tactor);
+    }
+    tactor->mutex.unlock();
+}
+
+void ZoneScheduler::handleEvent(ZoneActor *tactor, ZoneEvent &tevent)
+{
+    Client *tclient = tevent.client;
+    int owner = 0;
+
+    switch(tevent.type)
+    {
+    case ZE_ARRIVE:
+        tactor->occupants.push_back(tclient);
+        break;
+
+    case ZE_INPUT:
+        // client moved on to another zone before this got here, pass it along
+        owner = tclient->m_Zone;
+        if(owner != tactor->zone)
+        {
+            if(owner) post(owner, tevent);
+            break;
+        }
+
+        // input lines are queued on the client so they run in order whichever zone gets them
+        {
+            std::string input;
+            bool has_input = false;
+            tclient->m_InputMutex.lock();
+            if(tclient->m_InputRead < int(tclient->m_InputQueue.size()))
+            {
+                input.swap(tclient->m_InputQueue[tclient->m_InputRead++]);
+                // all read, start over at the front without giving back the space
+                if(tclient->m_InputRead == int(tclient->m_InputQueue.size()))
+                {
+                    tclient->m_InputQueue.clear();
+                    tclient->m_InputRead = 0;
+                }
+                has_input = true;
+            }
+            tclient->m_InputMutex.unlock();
+
+            if(has_input)
+            {
+                tclient->m_LastInput = input;
+                tclient->func(tclient);
+            }
+        }
+
+        // client quit, or walked into another zone
+        // dropped connections stay in the zone, the network thread decides if they go link-dead
+        if(tclient->hasQuit()) releaseClient(tactor, tclient);
+        else
+        {
+            int zone = m_ZoneManager->getRoomZoneID(tclient->getRoom());
+            if(zone && zone != tactor->zone) moveClient(tactor, tclient, zone);
+        }
+        break;
+
+    case ZE_LEAVE:
+        owner = tclient->m_Zone;
+        if(owner != tactor->zone)
+        {
+            if(owner) post(owner, tevent);
+            break;
+        }
+        releaseClient(tactor, tclient);
+        break;
+
+    case ZE_ROOM_MESSAGE:
+        deliverRoomMessage(tactor, tevent.room, tevent.text, tevent.client);
+        return;
+    }
+
+    // event no longer refers to client
+    tclient->m_PendingEvents--;
+}
+
+// queue event for zone, scheduling the zone if it was idle
+void ZoneScheduler::post(int zone, const ZoneEvent &tevent)
+{
+    ZoneActor *tactor = getActor(zone);
+
+    // clients can not be removed while events still refer to them
+    if(tevent.type != ZE_ROOM_MESSAGE) tevent.client->m_PendingEvents++;
+
+    tactor->mutex.lock();
+    tactor->mailbox.push_back(tevent);
+    if(!tactor->scheduled)
+    {
+        tactor->scheduled = true;
+        queueActor(tactor);
+    }
+    tactor->mutex.unlock();
+}
+
+// hand client over to another zone, runs on the worker of the zone giving up the client
+void ZoneScheduler::moveClient(ZoneActor *tactor, Client *tclient, int zone)
+{
+    removeOccupant(tactor, tclient);
+
+    // arrival is queued before the new zone is published so events for the
+    // client can only reach the new zone after it
+    ZoneEvent tevent;
+    tevent.type = ZE_ARRIVE;
+    tevent.client = tclient;
+    post(zone, tevent);
+    tclient->m_Zone = zone;
+}
+
+void ZoneScheduler::removeOccupant(ZoneActor *tactor, Client *tclient)
+{
+    for(int i = 0; i < int(tactor->occupants.size()); i++)
+    {
+        if(tactor->occupants[i] == tclient)
+        {
+            tactor->occupants.erase(tactor->occupants.begin() + i);
+            return;
+        }
+    }
+}
+
+void ZoneScheduler::releaseClient(ZoneActor *tactor, Client *tclient)
+{
+    removeOccupant(tactor, tclient);
+    tclient->m_Zone = 0;
+
+    m_ReleaseMutex.lock();
+    m_Released.push_back(tclient);
+    m_ReleaseMutex.unlock();
+}
+
+void ZoneScheduler::deliverRoomMessage(ZoneActor *tactor, int room_id, const std::string &msg, Client *exclude)
+{
+    for(int i = 0; i < int(tactor->occupants.size()); i++)
+    {
+        if(tactor->occupants[i] != exclude && tactor->occupants[i]->getRoom() == room_id)
+        {
+            tactor->occupants[i]->send(msg);
+        }
+    }
+}
+
+bool ZoneScheduler::enterWorld(Client *tclient)
+{
+    if(!tclient || tclient->m_Zone) return false;
+
+    int zone = m_ZoneManager->getRoomZoneID(tclient->getRoom());
+    if(!zone) return false;
+
+    ZoneEvent tevent;
+    tevent.type = ZE_ARRIVE;
+    tevent.client = tclient;
+    post(zone, tevent);
+    tclient->m_Zone = zone;
+    return true;
+}
+
+void ZoneScheduler::postInput(Client *tclient, const std::string &input)
+{
+    int zone = tclient->m_Zone;
+    if(!zone) return;
+
+    tclient->m_InputMutex.lock();
+    tclient->m_InputQueue.push_back(input);
+    tclient->m_InputMutex.unlock();
+
+    ZoneEvent tevent;
+    tevent.type = ZE_INPUT;
+    tevent.client = tclient;
+    post(zone, tevent);
+}
+
+void ZoneScheduler::postLeave(Client *tclient)
+{
+    int zone = tclient->m_Zone;
+    if(!zone) return;
+
+    ZoneEvent tevent;
+    tevent.type = ZE_LEAVE;
+    tevent.client = tclient;
+    post(zone, tevent);
+}
+
+void ZoneScheduler::postRoomMessage(int room_id, const std::string &msg, Client *exclude)
+{
+    int zone = m_ZoneManager->getRoomZoneID(room_id);
+    if(!zone) return;
+
+    // sent from inside the zone, deliver now rather than behind events already queued
+    if(t_CurrentActor && t_CurrentActor->zone == zone)
+    {
+        deliverRoomMessage(t_CurrentActor, room_id, msg, exclude);
+        return;
+    }
+
+    ZoneEvent tevent;
+    tevent.type = ZE_ROOM_MESSAGE;
+    tevent.client = exclude;
+    tevent.room = room_id;
+    tevent.text = msg;
+    post(zone, tevent);
+}
+
+void ZoneScheduler::takeReleased(std::vector<Client*> *clients)
+{
+    m_ReleaseMutex.lock();
+    clients->insert(clients->end(), m_Released.begin(), m_Released.end());
+    m_Released.clear();
+    m_ReleaseMutex.unlock();
+}
@@ -0,0 +1,434 @@
+#include "snapshot.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <unordered_map>
+#include <vector>
+#include "direction.hpp"
+#include "statementcache.hpp"
+#include "tools.hpp"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+WorldSnapshot::WorldSnapshot()
+{
+    m_Data = NULL;
+    m_Size = 0;
+#ifdef _WIN32
+    m_File = NULL;
+    m_Mapping = NULL;
+#else
+    m_File = -1;
+#endif
+    m_Header = NULL;
+    m_Rooms = NULL;
+    m_Exits = NULL;
+    m_SpecialExits = NULL;
+    m_Zones = NULL;
+    m_ZoneRooms = NULL;
+    m_Text = NULL;
+    m_TextSize = 0;
+    m_ZoneRoomCount = 0;
+}
+
+WorldSnapshot::~WorldSnapshot()
+{
+    close();
+}
+
+// add text to blob, identical texts are only stored once
+static sf::Uint32 addSnapshotText(std::string *blob, std::unordered_map<std::string, sf::Uint32> *offsets, const std::string &text)
+{
+    std::unordered_map<std::string, sf::Uint32>::iterator it = offsets->find(text);
+    if(it != offsets->end()) return it->second;
+
+    sf::Uint32 offset = sf::Uint32(blob->size());
+    blob->append(text);
+    (*offsets)[text] = offset;
+    return offset;
+}
+
+// store exit from join row, rows without an exit are ignored
+static void addSnapshotExit(sqlite3_stmt *stmt, int dir_count, SnapshotRoom *troom, std::vector<sf::Int32> *exits,
+                            std::vector<SnapshotExit> *special_exits, std::string *blob, std::unordered_map<std::string, sf::Uint32> *offsets)
+{
+    if(sqlite3_column_type(stmt, 4) == SQLITE_NULL) return;
+
+    std::string dir = sqlColumnString(stmt, 4);
+    int to_room = sqlite3_column_int(stmt, 5);
+    int flags = sqlite3_column_int(stmt, 6);
+    int dir_index = getDirectionIndex(dir);
+
+    if(dir_index != -1 && dir_index < dir_count) (*exits)[troom->room_id * dir_count + dir_index] = to_room;
+    if(dir_index == -1 || flags)
+    {
+        SnapshotExit texit;
+        texit.name_offset = addSnapshotText(blob, offsets, dir);
+        texit.name_length = sf::Uint32(dir.size());
+        texit.to_room = to_room;
+        texit.flags = flags;
+        special_exits->push_back(texit);
+        troom->special_count++;
+    }
+}
+
+bool WorldSnapshot::write(sqlite3 *db, std::string filename, sf::Int64 data_version, int dir_count)
+{
+    sf::Clock write_clock;
+    std::vector<SnapshotRoom> rooms;
+    std::vector<sf::Int32> exits;
+    std::vector<SnapshotExit> special_exits;
+    std::vector<SnapshotZone> zones;
+    std::vector< std::vector<sf::Uint32> > zone_room_lists;
+    std::unordered_map<std::string, int> zone_lookup;
+    std::string text;
+    std::unordered_map<std::string, sf::Uint32> text_offsets;
+
+    // read every room, followed by a row for each of its exits
+    StatementCache *cache = StatementCache::getCache(db);
+    sqlite3_stmt *stmt = cache->acquire("SELECT room_id, zone, name, description, dir, to_room, flags FROM rooms"
+                                        " LEFT JOIN exits ON from_room = room_id ORDER BY room_id;");
+    if(!stmt) return false;
+    int rc = 0;
+    int row_room_id = 0;
+    while((rc = cache->step(stmt)) == SQLITE_ROW)
+    {
+        int room_id = sqlite3_column_int(stmt, 0);
+        if(room_id <= 0) continue;
+
+        // exit row of room already read
+        if(room_id == row_room_id)
+        {
+            addSnapshotExit(stmt, dir_count, &rooms[room_id], &exits, &special_exits, &text, &text_offsets);
+            continue;
+        }
+        row_room_id = room_id;
+
+        if(room_id >= int(rooms.size()))
+        {
+            rooms.resize(room_id + 1);
+            exits.resize((room_id + 1) * dir_count, 0);
+        }
+
+        // find or add zone
+        std::string zone_name = sqlColumnString(stmt, 1);
+        int zone_index = 0;
+        std::unordered_map<std::string, int>::iterator zit = zone_lookup.find(zone_name);
+        if(zit == zone_lookup.end())
+        {
+            zone_index = int(zones.size());
+            zone_lookup[zone_name] = zone_index;
+            zones.push_back(SnapshotZone());
+            zones.back().name_offset = addSnapshotText(&text, &text_offsets, zone_name);
+            zones.back().name_length = sf::Uint32(zone_name.size());
+            zone_room_lists.push_back(std::vector<sf::Uint32>());
+        }
+        else zone_index = zit->second;
+
+        SnapshotRoom *troom = &rooms[room_id];
+        std::string name = sqlColumnString(stmt, 2);
+        std::string description = sqlColumnString(stmt, 3);
+        troom->room_id = room_id;
+        troom->zone = zone_index;
+        troom->name_offset = addSnapshotText(&text, &text_offsets, name);
+        troom->name_length = sf::Uint32(name.size());
+        troom->description_offset = addSnapshotText(&text, &text_offsets, description);
+        troom->description_length = sf::Uint32(description.size());
+        troom->special_first = sf::Uint32(special_exits.size());
+        troom->special_count = 0;
+        addSnapshotExit(stmt, dir_count, troom, &exits, &special_exits, &text, &text_offsets);
+        zone_room_lists[zone_index].push_back(room_id);
+    }
+    if(rc != SQLITE_DONE)
+    {
+        std::cout << "Error in sql during world snapshot:" << sqlite3_errmsg(db) << std::endl;
+        cache->release(stmt);
+        return false;
+    }
+    cache->release(stmt);
+
+    if(rooms.empty())
+    {
+        rooms.resize(1);
+        exits.resize(dir_count, 0);
+    }
+
+    // flatten zone room lists
+    std::vector<sf::Uint32> zone_rooms;
+    for(int i = 0; i < int(zones.size()); i++)
+    {
+        zones[i].first_room = sf::Uint32(zone_rooms.size());
+        zones[i].room_count = sf::Uint32(zone_room_lists[i].size());
+        zone_rooms.insert(zone_rooms.end(), zone_room_lists[i].begin(), zone_room_lists[i].end());
+    }
+
+    // lay out file
+    SnapshotHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+    header.version = SNAPSHOT_VERSION;
+    header.dir_count = dir_count;
+    header.data_version = data_version;
+    header.room_slots = sf::Uint32(rooms.size());
+    header.zone_count = sf::Uint32(zones.size());
+    header.rooms_offset = sizeof(SnapshotHeader);
+    header.exits_offset = header.rooms_offset + rooms.size() * sizeof(SnapshotRoom);
+    header.special_offset = header.exits_offset + exits.size() * sizeof(sf::Int32);
+    header.special_count = sf::Uint32(special_exits.size());
+    header.zones_offset = header.special_offset + special_exits.size() * sizeof(SnapshotExit);
+    header.zone_rooms_offset = header.zones_offset + zones.size() * sizeof(SnapshotZone);
+    header.text_offset = header.zone_rooms_offset + zone_rooms.size() * sizeof(sf::Uint32);
+    header.file_size = header.text_offset + text.size();
+
+    // write to temporary file and swap in when complete
+    std::string tmp_filename = filename + ".tmp";
+    FILE *ofile = fopen(tmp_filename.c_str(), "wb");
+    if(!ofile)
+    {
+        std::cout << "Error opening world snapshot file:" << tmp_filename << std::endl;
+        return false;
+    }
+    bool write_ok = true;
+    write_ok = write_ok && fwrite(&header, sizeof(header), 1, ofile) == 1;
+    write_ok = write_ok && fwrite(&rooms[0], sizeof(SnapshotRoom), rooms.size(), ofile) == rooms.size();
+    write_ok = write_ok && fwrite(&exits[0], sizeof(sf::Int32), exits.size(), ofile) == exits.size();
+    if(!special_exits.empty()) write_ok = write_ok && fwrite(&special_exits[0], sizeof(SnapshotExit), special_exits.size(), ofile) == special_exits.size();
+    if(!zones.empty()) write_ok = write_ok && fwrite(&zones[0], sizeof(SnapshotZone), zones.size(), ofile) == zones.size();
+    if(!zone_rooms.empty()) write_ok = write_ok && fwrite(&zone_rooms[0], sizeof(sf::Uint32), zone_rooms.size(), ofile) == zone_rooms.size();
+    if(!text.empty()) write_ok = write_ok && fwrite(text.data(), 1, text.size(), ofile) == text.size();
+    write_ok = (fclose(ofile) == 0) && write_ok;
+    if(!write_ok)
+    {
+        std::cout << "Error writing world snapshot file:" << tmp_filename << std::endl;
+        remove(tmp_filename.c_str());
+        return false;
+    }
+
+    remove(filename.c_str());
+    if(rename(tmp_filename.c_str(), filename.c_str()) != 0)
+    {
+        std::cout << "Error replacing world snapshot file:" << filename << std::endl;
+        return false;
+    }
+
+    std::cout << "World snapshot written with " << zone_rooms.size() << " rooms in " << write_clock.getElapsedTime().asMilliseconds() << "ms.\n";
+    return true;
+}
+
+bool WorldSnapshot::open(std::string filename)
+{
+    close();
+
+#ifdef _WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if(file == INVALID_HANDLE_VALUE) return false;
+    LARGE_INTEGER file_size;
+    if(!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if(!mapping)
+    {
+        CloseHandle(file);
+        return false;
+    }
+    const char *data = static_cast<const char*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+    if(!data)
+    {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        return false;
+    }
+    m_File = file;
+    m_Mapping = mapping;
+    m_Size = size_t(file_size.QuadPart);
+#else
+    int file = ::open(filename.c_str(), O_RDONLY);
+    if(file < 0) return false;
+    struct stat st;
+    if(fstat(file, &st) != 0 || st.st_size == 0)
+    {
+        ::close(file);
+        return false;
+    }
+    void *data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, file, 0);
+    if(data == MAP_FAILED)
+    {
+        ::close(file);
+        return false;
+    }
+    m_File = file;
+    m_Size = size_t(st.st_size);
+#endif
+    m_Data = static_cast<const char*>(data);
+
+    if(!validate())
+    {
+        std::cout << "World snapshot " << filename << " is invalid, ignoring.\n";
+        close();
+        return false;
+    }
+    return true;
+}
+
+void WorldSnapshot::close()
+{
+    if(!m_Data) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(m_Data);
+    CloseHandle(m_Mapping);
+    CloseHandle(m_File);
+    m_Mapping = NULL;
+    m_File = NULL;
+#else
+    munmap(const_cast<char*>(m_Data), m_Size);
+    ::close(m_File);
+    m_File = -1;
+#endif
+
+    m_Data = NULL;
+    m_Size = 0;
+    m_Header = NULL;
+    m_Rooms = NULL;
+    m_Exits = NULL;
+    m_SpecialExits = NULL;
+    m_Zones = NULL;
+    m_ZoneRooms = NULL;
+    m_Text = NULL;
+    m_TextSize = 0;
+    m_ZoneRoomCount = 0;
+}
+
+// make sure every table in the file is where the header says it is
+bool WorldSnapshot::validate()
+{
+    if(m_Size < sizeof(SnapshotHeader)) return false;
+
+    const SnapshotHeader *header = reinterpret_cast<const SnapshotHeader*>(m_Data);
+    if(memcmp(header->magic, SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) return false;
+    if(header->version != SNAPSHOT_VERSION) return false;
+    if(header->file_size != m_Size) return false;
+
+    if(header->rooms_offset + sf::Uint64(header->room_slots) * sizeof(SnapshotRoom) > header->exits_offset) return false;
+    if(header->exits_offset + sf::Uint64(header->room_slots) * header->dir_count * sizeof(sf::Int32) > header->special_offset) return false;
+    if(header->special_offset + sf::Uint64(header->special_count) * sizeof(SnapshotExit) > header->zones_offset) return false;
+    if(header->zones_offset + sf::Uint64(header->zone_count) * sizeof(SnapshotZone) > header->zone_rooms_offset) return false;
+    if(header->zone_rooms_offset > header->text_offset) return false;
+    if(header->text_offset > header->file_size) return false;
+
+    m_Header = header;
+    m_Rooms = reinterpret_cast<const SnapshotRoom*>(m_Data + header->rooms_offset);
+    m_Exits = reinterpret_cast<const sf::Int32*>(m_Data + header->exits_offset);
+    m_SpecialExits = reinterpret_cast<const SnapshotExit*>(m_Data + header->special_offset);
+    m_Zones = reinterpret_cast<const SnapshotZone*>(m_Data + header->zones_offset);
+    m_ZoneRooms = reinterpret_cast<const sf::Uint32*>(m_Data + header->zone_rooms_offset);
+    m_Text = m_Data + header->text_offset;
+    m_TextSize = header->file_size - header->text_offset;
+    m_ZoneRoomCount = (header->text_offset - header->zone_rooms_offset) / sizeof(sf::Uint32);
+    return true;
+}
+
+// text from blob, empty if out of bounds
+std::string WorldSnapshot::getText(sf::Uint32 offset, sf::Uint32 length)
+{
+    if(sf::Uint64(offset) + length > m_TextSize) return "";
+    return std::string(m_Text + offset, length);
+}
+
+sf::Int64 WorldSnapshot::getDataVersion()
+{
+    if(!m_Header) return -1;
+    return m_Header->data_version;
+}
+
+int WorldSnapshot::getDirCount()
+{
+    if(!m_Header) return 0;
+    return int(m_Header->dir_count);
+}
+
+int WorldSnapshot::getRoomSlots()
+{
+    if(!m_Header) return 0;
+    return int(m_Header->room_slots);
+}
+
+int WorldSnapshot::getZoneCount()
+{
+    if(!m_Header) return 0;
+    return int(m_Header->zone_count);
+}
+
+std::string WorldSnapshot::getZoneName(int zone_index)
+{
+    if(zone_index < 0 || zone_index >= getZoneCount()) return "";
+    return getText(m_Zones[zone_index].name_offset, m_Zones[zone_index].name_length);
+}
+
+int WorldSnapshot::getZoneRoomCount(int zone_index)
+{
+    if(zone_index < 0 || zone_index >= getZoneCount()) return 0;
+    return int(m_Zones[zone_index].room_count);
+}
+
+int WorldSnapshot::getZoneRoom(int zone_index, int n)
+{
+    if(n < 0 || n >= getZoneRoomCount(zone_index)) return 0;
+    sf::Uint64 index = sf::Uint64(m_Zones[zone_index].first_room) + n;
+    if(index >= m_ZoneRoomCount) return 0;
+    return int(m_ZoneRooms[index]);
+}
+
+bool WorldSnapshot::hasRoom(int room_id)
+{
+    if(room_id <= 0 || room_id >= getRoomSlots()) return false;
+    return m_Rooms[room_id].room_id != 0;
+}
+
+std::string WorldSnapshot::getRoomName(int room_id)
+{
+    if(!hasRoom(room_id)) return "";
+    return getText(m_Rooms[room_id].name_offset, m_Rooms[room_id].name_length);
+}
+
+std::string WorldSnapshot::getRoomDescription(int room_id)
+{
+    if(!hasRoom(room_id)) return "";
+    return getText(m_Rooms[room_id].description_offset, m_Rooms[room_id].description_length);
+}
+
+int WorldSnapshot::getRoomExit(int room_id, int dir_index)
+{
+    if(!hasRoom(room_id) || dir_index < 0 || dir_index >= getDirCount()) return 0;
+    return m_Exits[room_id * getDirCount() + dir_index];
+}
+
+int WorldSnapshot::getRoomSpecialExitCount(int room_id)
+{
+    if(!hasRoom(room_id)) return 0;
+    return int(m_Rooms[room_id].special_count);
+}
+
+bool WorldSnapshot::getRoomSpecialExit(int room_id, int n, std::string *name, int *to_room, int *flags)
+{
+    if(n < 0 || n >= getRoomSpecialExitCount(room_id)) return false;
+    sf::Uint64 index = sf::Uint64(m_Rooms[room_id].special_first) + n;
+    if(index >= m_Header->special_count) return false;
+
+    const SnapshotExit *texit = &m_SpecialExits[index];
+    *name = getText(texit->name_offset, texit->name_length);
+    *to_room = texit->to_room;
+    *flags = int(texit->flags);
+    return true;
+}
@@ -1,6 +1,7 @@
 #include "social.hpp"
 #include <sstream>
 #include "mud.hpp"
+#include "tools.hpp"
 
 int say(Client *tclient, std::string cmd, std::string args)
 {
@@ -19,3 +20,33 @@ int say(Client *tclient, std::string cmd, std::string args)
     Mud::getInstance()->broadcastToRoomExcluding(tclient->getRoom(), rss.str(), tclient);
     return 0;
 }
+
+int tell(Client *tclient, std::string cmd, std::string args)
+{
+    if(!tclient) return 0;
+
+    // tell <name> <message>
+    size_t split = args.find(' ');
+    if(args.empty() || split == std::string::npos || split + 1 >= args.size())
+    {
+        tclient->send("Tell who what?\n");
+        return 0;
+    }
+    std::string target = args.substr(0, split);
+    std::string msg = args.substr(split + 1);
+
+    if(toLower(target) == toLower(tclient->getName()))
+    {
+        tclient->send("You mutter to yourself.\n");
+        return 0;
+    }
+
+    std::string name;
+    if(!Mud::getInstance()->sendToPlayer(target, tclient->getName() + " tells you \"" + msg + "\"\n", &name))
+    {
+        tclient->send("Nobody by that name is here.\n");
+        return 0;
+    }
+    tclient->send("You tell " + name + " \"" + msg + "\"\n");
+    return 0;
+}
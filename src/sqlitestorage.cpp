@@ -0,0 +1,464 @@
+#include "sqlitestorage.hpp"
+
+#include <iostream>
+#include <sstream>
+#include "direction.hpp"
+#include "snapshot.hpp"
+#include "tools.hpp"
+
+SqliteStorage::SqliteStorage(const std::string &file)
+{
+    m_Statements = NULL;
+    m_Writer = NULL;
+    m_Readers = NULL;
+
+    m_DB = openDatabase(file);
+    if(!m_DB) return;
+    m_Statements = StatementCache::getCache(m_DB);
+
+    // writes go through the writer thread, other threads read on connections of their own
+    m_Writer = new DatabaseWriter(file);
+    if(!m_Writer->isOpen()) return;
+    m_Writer->start();
+    m_Readers = new DatabaseReaders(file);
+}
+
+SqliteStorage::~SqliteStorage()
+{
+    // commits what is still queued
+    if(m_Writer) m_Writer->stop();
+    delete m_Writer;
+    delete m_Readers;
+
+    if(m_DB)
+    {
+        StatementCache::closeCache(m_DB);
+        sqlite3_close(m_DB);
+    }
+}
+
+//////////////////////////////////////////////////////////////////
+// ACCOUNTS
+
+bool SqliteStorage::openAccounts(bool *created)
+{
+    *created = false;
+    if(tableExists(m_DB, "accounts")) return true;
+
+    std::cout << "Creating new accounts table in database...\n";
+    std::stringstream ss;
+    char *errormsg = 0;
+    ss << "CREATE TABLE accounts( ";
+    ss << "account_id INTEGER PRIMARY KEY,";
+    ss << "account_name TEXT NOT NULL UNIQUE,";
+    ss << "account_password TEXT NOT NULL,";
+    ss << "current_room INTEGER";
+    ss << ");";
+
+    if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error creating accounts table:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+        return false;
+    }
+
+    *created = true;
+    return true;
+}
+
+bool SqliteStorage::loadAccount(const std::string &username, AccountRecord *record)
+{
+    *record = AccountRecord();
+
+    // names are stored formatted, an exact match can use the unique index
+    sqlite3_stmt *stmt = m_Statements->acquire("SELECT account_password, current_room FROM accounts WHERE account_name = ?;");
+    if(!stmt) return false;
+    sqlite3_bind_text(stmt, 1, username.c_str(), -1, SQLITE_TRANSIENT);
+    int rc = m_Statements->step(stmt);
+    if(rc == SQLITE_ROW)
+    {
+        record->exists = true;
+        record->password = sqlColumnString(stmt, 0);
+        record->room_id = sqlite3_column_int(stmt, 1);
+    }
+    m_Statements->release(stmt);
+    if(rc != SQLITE_ROW && rc != SQLITE_DONE)
+    {
+        std::cout << "Error in sql:" << sqlite3_errmsg(m_DB) << std::endl;
+        return false;
+    }
+
+    return true;
+}
+
+void SqliteStorage::addAccount(const std::string &username, const std::string &stored, int room_id)
+{
+    DatabaseWrite twrite;
+    DatabaseStatement *insert = twrite.add("INSERT INTO accounts(account_name, account_password, current_room) VALUES(?, ?, ?);");
+    insert->bind(username);
+    insert->bind(stored);
+    insert->bind(room_id);
+    m_Writer->submit(twrite);
+}
+
+void SqliteStorage::setPassword(const std::string &username, const std::string &stored)
+{
+    DatabaseWrite twrite;
+    DatabaseStatement *update = twrite.add("UPDATE accounts SET account_password = ? WHERE account_name = ?;");
+    update->bind(stored);
+    update->bind(username);
+    m_Writer->submit(twrite);
+}
+
+void SqliteStorage::savePlayerRooms(const std::unordered_map<std::string, int> &rooms)
+{
+    DatabaseWrite twrite;
+    for(std::unordered_map<std::string, int>::const_iterator it = rooms.begin(); it != rooms.end(); it++)
+    {
+        DatabaseStatement *update = twrite.add("UPDATE accounts SET current_room = ? WHERE account_name = ?;");
+        update->bind(it->second);
+        update->bind(it->first);
+    }
+    m_Writer->submit(twrite);
+}
+
+//////////////////////////////////////////////////////////////////
+// WORLD
+
+bool SqliteStorage::openWorld(bool *created)
+{
+    char *errormsg = 0;
+    *created = false;
+
+    // world version is bumped every time rooms are written, snapshots record the version they were made from
+    if(sqlite3_exec(m_DB, "CREATE TABLE IF NOT EXISTS world_meta(key TEXT PRIMARY KEY, value INTEGER);"
+                          "INSERT OR IGNORE INTO world_meta(key, value) VALUES('version', 1);", sqlcallback, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error creating world_meta table:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+    }
+
+    // create new table if new
+    if(!tableExists(m_DB, "rooms"))
+    {
+        std::cout << "Creating new rooms table in database...\n";
+        std::stringstream ss;
+        // note : if this changes, update load and save functions
+        ss << "CREATE TABLE rooms( ";
+        ss << "room_id INTEGER PRIMARY KEY,";
+        ss << "zone TEXT NOT NULL,";
+        ss << "name TEXT NOT NULL,";
+        ss << "description INTEGER";
+        ss << ");";
+        ss << "CREATE INDEX rooms_zone ON rooms(zone);";
+        // exits by direction name (or exit name for named exits), kept in room order
+        ss << "CREATE TABLE exits( ";
+        ss << "from_room INTEGER NOT NULL,";
+        ss << "dir TEXT NOT NULL,";
+        ss << "to_room INTEGER NOT NULL,";
+        ss << "flags INTEGER NOT NULL DEFAULT 0,";
+        ss << "PRIMARY KEY(from_room, dir)";
+        ss << ") WITHOUT ROWID;";
+
+        if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
+        {
+            std::cout << "Error creating rooms table:" << errormsg << std::endl;
+            sqlite3_free(errormsg);
+            return false;
+        }
+
+        *created = true;
+        return true;
+    }
+
+    // older databases do not have the zone index that zone loading relies on
+    if(sqlite3_exec(m_DB, "CREATE INDEX IF NOT EXISTS rooms_zone ON rooms(zone);", sqlcallback, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error creating rooms zone index:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+    }
+
+    // older databases keep exits in the rooms table
+    if(!tableExists(m_DB, "exits"))
+    {
+        std::cout << "Moving room exits to exits table...\n";
+        if(!_MigrateExits()) std::cout << "Error, failed to move room exits!\n";
+    }
+
+    return true;
+}
+
+bool SqliteStorage::_MigrateExits()
+{
+    std::stringstream ss;
+    char *errormsg = 0;
+    int error_count = 0;
+
+    // exits were either kept as text in the rooms table or in a column for each direction
+    bool exit_text = columnExists(m_DB, "rooms", "exits");
+    std::vector<int> columns;
+    ss << "SELECT room_id";
+    if(exit_text) ss << ",exits";
+    else
+    {
+        for(int i = 0; i < DIR_COUNT; i++)
+        {
+            if(!columnExists(m_DB, "rooms", std::string("exit_") + dirs[i].name)) continue;
+            ss << ",exit_" << dirs[i].name;
+            columns.push_back(i);
+        }
+    }
+    ss << " FROM rooms;";
+
+    if(sqlite3_exec(m_DB, "BEGIN;"
+                          "CREATE TABLE exits(from_room INTEGER NOT NULL, dir TEXT NOT NULL, to_room INTEGER NOT NULL,"
+                          " flags INTEGER NOT NULL DEFAULT 0, PRIMARY KEY(from_room, dir)) WITHOUT ROWID;", sqlcallback, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error creating exits table:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+        sqlite3_exec(m_DB, "ROLLBACK;", sqlcallback, NULL, NULL);
+        return false;
+    }
+
+    sqlite3_stmt *stmt = m_Statements->acquire(ss.str());
+    sqlite3_stmt *insert_stmt = m_Statements->acquire("INSERT INTO exits(from_room, dir, to_room) VALUES(?,?,?);");
+    if(!stmt || !insert_stmt)
+    {
+        m_Statements->release(stmt);
+        m_Statements->release(insert_stmt);
+        sqlite3_exec(m_DB, "ROLLBACK;", sqlcallback, NULL, NULL);
+        return false;
+    }
+
+    std::vector<int> exits(DIR_COUNT, 0);
+    int rc = 0;
+    int exit_count = 0;
+    while((rc = m_Statements->step(stmt)) == SQLITE_ROW)
+    {
+        int room_id = sqlite3_column_int(stmt, 0);
+        if(exit_text) error_count += parseExits(sqlColumnString(stmt, 1), &exits);
+        for(int i = 0; i < int(columns.size()); i++)
+        {
+            exits[columns[i]] = sqlite3_column_int(stmt, 1 + i);
+        }
+
+        for(int i = 0; i < DIR_COUNT; i++)
+        {
+            if(!exits[i]) continue;
+            sqlite3_bind_int(insert_stmt, 1, room_id);
+            sqlite3_bind_text(insert_stmt, 2, dirs[i].name, -1, SQLITE_STATIC);
+            sqlite3_bind_int(insert_stmt, 3, exits[i]);
+            if(m_Statements->step(insert_stmt) != SQLITE_DONE) error_count++;
+            sqlite3_reset(insert_stmt);
+            exit_count++;
+        }
+    }
+    if(rc != SQLITE_DONE) error_count++;
+    m_Statements->release(stmt);
+    m_Statements->release(insert_stmt);
+
+    // old columns are left in place, nothing reads them any more
+    if(error_count)
+    {
+        std::cout << "Error moving room exits:" << sqlite3_errmsg(m_DB) << std::endl;
+        sqlite3_exec(m_DB, "ROLLBACK;", sqlcallback, NULL, NULL);
+        return false;
+    }
+    if(sqlite3_exec(m_DB, "UPDATE world_meta SET value = value + 1 WHERE key = 'version';"
+                          "COMMIT;", sqlcallback, NULL, &errormsg) != SQLITE_OK)
+    {
+        std::cout << "Error committing room exits:" << errormsg << std::endl;
+        sqlite3_free(errormsg);
+        sqlite3_exec(m_DB, "ROLLBACK;", sqlcallback, NULL, NULL);
+        return false;
+    }
+    std::cout << exit_count << " exits moved to exits table.\n";
+    return true;
+}
+
+sf::Int64 SqliteStorage::getWorldVersion()
+{
+    sf::Int64 version = 0;
+
+    sqlite3_stmt *stmt = m_Statements->acquire("SELECT value FROM world_meta WHERE key = 'version';");
+    if(!stmt) return 0;
+    if(m_Statements->step(stmt) == SQLITE_ROW) version = sqlite3_column_int64(stmt, 0);
+    m_Statements->release(stmt);
+
+    return version;
+}
+
+bool SqliteStorage::loadZoneList(std::vector<StoredZone> *zones)
+{
+    // get each zone, how many rooms it has and the highest room id used in it
+    sqlite3_stmt *stmt = m_Statements->acquire("SELECT zone, MAX(room_id), COUNT(*) FROM rooms GROUP BY zone;");
+    if(!stmt) return false;
+    int rc = 0;
+    while((rc = m_Statements->step(stmt)) == SQLITE_ROW)
+    {
+        StoredZone tzone;
+        tzone.name = sqlColumnString(stmt, 0);
+        tzone.max_room_id = sqlite3_column_int(stmt, 1);
+        tzone.room_count = sqlite3_column_int(stmt, 2);
+        zones->push_back(tzone);
+    }
+    if(rc != SQLITE_DONE)
+    {
+        std::cout << "Error in sql during load zones:" << sqlite3_errmsg(m_DB) << std::endl;
+    }
+    m_Statements->release(stmt);
+
+    return rc == SQLITE_DONE;
+}
+
+// zones are only unloaded once their rooms are committed, so a zone being loaded has no
+// writes queued and this never waits on the writer (it runs under the room mutex)
+bool SqliteStorage::loadRooms(const std::string &zone, StoredRoomFunc func, void *data)
+{
+    sqlite3 *reader = m_Readers->acquire();
+    StatementCache *cache = StatementCache::getCache(reader);
+    sqlite3_stmt *stmt = NULL;
+    // all rooms are read in storage order, rooms of a zone are usually created together
+    // each room comes with its exits, one row per exit
+    if(!cache);
+    else if(zone.empty()) stmt = cache->acquire("SELECT room_id, zone, name, description, dir, to_room, flags FROM rooms"
+                                                " LEFT JOIN exits ON from_room = room_id ORDER BY room_id;");
+    else
+    {
+        stmt = cache->acquire("SELECT room_id, zone, name, description, dir, to_room, flags FROM rooms"
+                              " LEFT JOIN exits ON from_room = room_id WHERE zone = ? ORDER BY room_id;");
+        if(stmt) sqlite3_bind_text(stmt, 1, zone.c_str(), -1, SQLITE_TRANSIENT);
+    }
+    if(!stmt)
+    {
+        m_Readers->release(reader);
+        return false;
+    }
+
+    // a room is handed over once the rows of the next room start
+    StoredRoom troom;
+    bool has_room = false;
+    int rc = 0;
+    while((rc = cache->step(stmt)) == SQLITE_ROW)
+    {
+        int room_id = sqlite3_column_int(stmt, 0);
+        if(!has_room || room_id != troom.room_id)
+        {
+            if(has_room) func(data, troom);
+            has_room = true;
+            troom.room_id = room_id;
+            troom.zone = sqlColumnString(stmt, 1);
+            troom.name = sqlColumnString(stmt, 2);
+            troom.description = sqlColumnString(stmt, 3);
+            troom.exits.clear();
+        }
+
+        // no exits
+        if(sqlite3_column_type(stmt, 4) == SQLITE_NULL) continue;
+
+        StoredExit texit;
+        texit.dir = sqlColumnString(stmt, 4);
+        texit.to_room = sqlite3_column_int(stmt, 5);
+        texit.flags = sqlite3_column_int(stmt, 6);
+        troom.exits.push_back(texit);
+    }
+    if(has_room) func(data, troom);
+    if(rc != SQLITE_DONE)
+    {
+        std::cout << "Error in sql during load rooms:" << sqlite3_errmsg(reader) << std::endl;
+    }
+    cache->release(stmt);
+    m_Readers->release(reader);
+
+    return rc == SQLITE_DONE;
+}
+
+bool SqliteStorage::findRoomZone(int room_id, std::string *zone)
+{
+    zone->clear();
+
+    sqlite3 *reader = m_Readers->acquire();
+    StatementCache *cache = StatementCache::getCache(reader);
+    sqlite3_stmt *stmt = NULL;
+    if(cache) stmt = cache->acquire("SELECT zone FROM rooms WHERE room_id = ?;");
+    if(!stmt)
+    {
+        m_Readers->release(reader);
+        return false;
+    }
+    sqlite3_bind_int(stmt, 1, room_id);
+    int rc = 0;
+    while((rc = cache->step(stmt)) == SQLITE_ROW)
+    {
+        *zone = sqlColumnString(stmt, 0);
+    }
+    if(rc != SQLITE_DONE)
+    {
+        std::cout << "Error in sql during room zone lookup:" << sqlite3_errmsg(reader) << std::endl;
+    }
+    cache->release(stmt);
+    m_Readers->release(reader);
+
+    return rc == SQLITE_DONE;
+}
+
+void SqliteStorage::saveRooms(const std::vector<StoredRoom> &rooms)
+{
+    std::stringstream ss;
+    DatabaseWrite twrite;
+
+    // insert room, or update it if it is already in the database
+    ss << "INSERT INTO rooms(room_id,zone,name,description) VALUES(?,?,?,?)";
+    ss << " ON CONFLICT(room_id) DO UPDATE SET ";
+    ss << "zone = excluded.zone,";
+    ss << "name = excluded.name,";
+    ss << "description = excluded.description;";
+
+    for(int i = 0; i < int(rooms.size()); i++)
+    {
+        const StoredRoom &troom = rooms[i];
+        DatabaseStatement *upsert = twrite.add(ss.str());
+        upsert->bind(troom.room_id);
+        upsert->bind(troom.zone);
+        upsert->bind(troom.name);
+        upsert->bind(troom.description);
+
+        // replace room's rows in exits table
+        twrite.add("DELETE FROM exits WHERE from_room = ?;")->bind(troom.room_id);
+        for(int n = 0; n < int(troom.exits.size()); n++)
+        {
+            DatabaseStatement *insert = twrite.add("INSERT INTO exits(from_room, dir, to_room, flags) VALUES(?,?,?,?);");
+            insert->bind(troom.room_id);
+            insert->bind(troom.exits[n].dir);
+            insert->bind(troom.exits[n].to_room);
+            insert->bind(troom.exits[n].flags);
+        }
+    }
+
+    // bump world version so snapshots made before this save are seen as out of date
+    twrite.add("UPDATE world_meta SET value = value + 1 WHERE key = 'version';");
+    m_Writer->submit(twrite);
+}
+
+bool SqliteStorage::writeSnapshot(const std::string &file, sf::Int64 version, int dir_count)
+{
+    m_Writer->flush();
+    return WorldSnapshot::write(m_DB, file, version, dir_count);
+}
+
+long long SqliteStorage::writeMark()
+{
+    return m_Writer->writeMark();
+}
+
+bool SqliteStorage::flush(long long mark)
+{
+    m_Writer->flush();
+    return !m_Writer->failedSince(mark);
+}
+
+void SqliteStorage::printStats()
+{
+    m_Statements->printStats();
+    m_Writer->printStats();
+}
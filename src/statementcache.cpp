@@ -0,0 +1,171 @@
+#include "statementcache.hpp"
+
+#include <iostream>
+
+sf::Mutex StatementCache::m_CacheMutex;
+std::map<sqlite3*, StatementCache*> StatementCache::m_Caches;
+
+StatementCache::StatementCache(sqlite3 *db)
+{
+    m_DB = db;
+}
+
+StatementCache::~StatementCache()
+{
+    m_Mutex.lock();
+    for(std::unordered_map<std::string, StatementEntry*>::iterator it = m_Statements.begin(); it != m_Statements.end(); it++)
+    {
+        sqlite3_finalize(it->second->stmt);
+        delete it->second;
+    }
+    m_Statements.clear();
+    m_Mutex.unlock();
+}
+
+StatementCache *StatementCache::getCache(sqlite3 *db)
+{
+    if(!db) return NULL;
+
+    StatementCache *tcache = NULL;
+    m_CacheMutex.lock();
+    std::map<sqlite3*, StatementCache*>::iterator it = m_Caches.find(db);
+    if(it != m_Caches.end()) tcache = it->second;
+    else
+    {
+        tcache = new StatementCache(db);
+        m_Caches[db] = tcache;
+    }
+    m_CacheMutex.unlock();
+
+    return tcache;
+}
+
+void StatementCache::closeCache(sqlite3 *db)
+{
+    m_CacheMutex.lock();
+    std::map<sqlite3*, StatementCache*>::iterator it = m_Caches.find(db);
+    if(it != m_Caches.end())
+    {
+        delete it->second;
+        m_Caches.erase(it);
+    }
+    m_CacheMutex.unlock();
+}
+
+sqlite3_stmt *StatementCache::acquire(const std::string &sql)
+{
+    sqlite3_stmt *stmt = NULL;
+    StatementEntry *entry = NULL;
+    bool temporary = false;
+
+    m_Mutex.lock();
+
+    // compile statement first time it is seen
+    std::unordered_map<std::string, StatementEntry*>::iterator it = m_Statements.find(sql);
+    if(it == m_Statements.end())
+    {
+        if(sqlite3_prepare_v2(m_DB, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+        {
+            std::cout << "Error in sql compile:" << sqlite3_errmsg(m_DB) << "\n  " << sql << std::endl;
+            sqlite3_finalize(stmt);
+            m_Mutex.unlock();
+            return NULL;
+        }
+        entry = new StatementEntry;
+        entry->sql = sql;
+        entry->stmt = stmt;
+        entry->busy = false;
+        entry->exec_count = 0;
+        entry->total_time = 0;
+        entry->max_time = 0;
+        m_Statements[sql] = entry;
+    }
+    else entry = it->second;
+
+    // statement already in use (nested or another thread), use a one off copy
+    if(entry->busy)
+    {
+        if(sqlite3_prepare_v2(m_DB, sql.c_str(), -1, &stmt, NULL) != SQLITE_OK)
+        {
+            std::cout << "Error in sql compile:" << sqlite3_errmsg(m_DB) << "\n  " << sql << std::endl;
+            sqlite3_finalize(stmt);
+            m_Mutex.unlock();
+            return NULL;
+        }
+        temporary = true;
+    }
+    else
+    {
+        stmt = entry->stmt;
+        entry->busy = true;
+    }
+
+    ActiveStatement &active = m_Active[stmt];
+    active.entry = entry;
+    active.temporary = temporary;
+    active.step_time = 0;
+
+    m_Mutex.unlock();
+    return stmt;
+}
+
+int StatementCache::step(sqlite3_stmt *stmt)
+{
+    sf::Clock timer;
+    int rc = sqlite3_step(stmt);
+    sf::Int64 elapsed = timer.getElapsedTime().asMicroseconds();
+
+    m_Mutex.lock();
+    std::unordered_map<sqlite3_stmt*, ActiveStatement>::iterator it = m_Active.find(stmt);
+    if(it != m_Active.end()) it->second.step_time += elapsed;
+    m_Mutex.unlock();
+
+    return rc;
+}
+
+void StatementCache::release(sqlite3_stmt *stmt)
+{
+    if(!stmt) return;
+
+    m_Mutex.lock();
+    std::unordered_map<sqlite3_stmt*, ActiveStatement>::iterator it = m_Active.find(stmt);
+    if(it == m_Active.end())
+    {
+        std::cout << "Error releasing sql statement, statement was not acquired from cache!\n";
+        m_Mutex.unlock();
+        return;
+    }
+
+    // record statistics, only time spent in sqlite counts, not what the caller did in between
+    StatementEntry *entry = it->second.entry;
+    sf::Int64 elapsed = it->second.step_time;
+    entry->exec_count++;
+    entry->total_time += elapsed;
+    if(elapsed > entry->max_time) entry->max_time = elapsed;
+
+    if(it->second.temporary) sqlite3_finalize(stmt);
+    else
+    {
+        sqlite3_reset(stmt);
+        sqlite3_clear_bindings(stmt);
+        entry->busy = false;
+    }
+    m_Active.erase(it);
+
+    m_Mutex.unlock();
+}
+
+void StatementCache::printStats()
+{
+    m_Mutex.lock();
+    std::cout << "SQL statement statistics (" << m_Statements.size() << " statements):\n";
+    for(std::unordered_map<std::string, StatementEntry*>::iterator it = m_Statements.begin(); it != m_Statements.end(); it++)
+    {
+        StatementEntry *entry = it->second;
+        if(!entry->exec_count) continue;
+        std::cout << "  " << entry->exec_count << " calls, ";
+        std::cout << entry->total_time / entry->exec_count << "us avg, ";
+        std::cout << entry->max_time << "us max : " << entry->sql << std::endl;
+    }
+    m_Mutex.unlock();
+}
@@ -0,0 +1,30 @@
+#include "storage.hpp"
+
+#include <iostream>
+#include "sqlitestorage.hpp"
+#include "memorystorage.hpp"
+
+Storage *createStorage(const StorageOptions &options, const std::string &file)
+{
+    if(options.type == STORAGE_MEMORY)
+    {
+        MemoryStorage *storage = new MemoryStorage;
+        if(options.read_latency >= 0 || options.write_latency >= 0)
+        {
+            storage->setLatency(options.read_latency >= 0 ? options.read_latency : STORAGE_MEMORY_READ_LATENCY,
+                                options.write_latency >= 0 ? options.write_latency : STORAGE_MEMORY_WRITE_LATENCY);
+        }
+        storage->failReads(options.fail_reads);
+        storage->failWrites(options.fail_writes);
+        return storage;
+    }
+
+    SqliteStorage *storage = new SqliteStorage(file);
+    if(!storage->isOpen())
+    {
+        std::cout << "Error opening sqlite storage " << file << std::endl;
+        delete storage;
+        return NULL;
+    }
+    return storage;
+}
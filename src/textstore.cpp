@@ -0,0 +1,147 @@
+#include "textstore.hpp"
+
+TextStore::TextStore()
+{
+    // id 0 is reserved for the empty string and is never freed
+    m_Entries.push_back(TextEntry());
+    m_Entries[0].refs = 1;
+}
+
+TextStore::~TextStore()
+{
+
+}
+
+int TextStore::add(const std::string &text)
+{
+    if(text.empty()) return 0;
+
+    size_t hash = std::hash<std::string>()(text);
+    int id = 0;
+
+    m_Mutex.lock();
+
+    // look for identical text already stored
+    std::pair<std::unordered_multimap<size_t, int>::iterator, std::unordered_multimap<size_t, int>::iterator> range = m_Index.equal_range(hash);
+    for(std::unordered_multimap<size_t, int>::iterator it = range.first; it != range.second; it++)
+    {
+        if(m_Entries[it->second].text == text)
+        {
+            id = it->second;
+            m_Entries[id].refs++;
+            m_Mutex.unlock();
+            return id;
+        }
+    }
+
+    // store new text, reusing a freed id if available
+    if(!m_FreeIDs.empty())
+    {
+        id = m_FreeIDs.back();
+        m_FreeIDs.pop_back();
+    }
+    else
+    {
+        id = int(m_Entries.size());
+        m_Entries.push_back(TextEntry());
+    }
+    m_Entries[id].text = text;
+    m_Entries[id].refs = 1;
+    m_Index.insert(std::make_pair(hash, id));
+
+    m_Mutex.unlock();
+    return id;
+}
+
+void TextStore::addRef(int id)
+{
+    if(id <= 0) return;
+
+    m_Mutex.lock();
+    if(id < int(m_Entries.size()) && m_Entries[id].refs > 0) m_Entries[id].refs++;
+    m_Mutex.unlock();
+}
+
+void TextStore::release(int id)
+{
+    if(id <= 0) return;
+
+    m_Mutex.lock();
+    if(id < int(m_Entries.size()) && m_Entries[id].refs > 0)
+    {
+        m_Entries[id].refs--;
+
+        // no longer referenced, remove from index and free storage
+        if(m_Entries[id].refs == 0)
+        {
+            size_t hash = std::hash<std::string>()(m_Entries[id].text);
+            std::pair<std::unordered_multimap<size_t, int>::iterator, std::unordered_multimap<size_t, int>::iterator> range = m_Index.equal_range(hash);
+            for(std::unordered_multimap<size_t, int>::iterator it = range.first; it != range.second; it++)
+            {
+                if(it->second == id)
+                {
+                    m_Index.erase(it);
+                    break;
+                }
+            }
+            std::string().swap(m_Entries[id].text);
+            m_FreeIDs.push_back(id);
+        }
+    }
+    m_Mutex.unlock();
+}
+
+int TextStore::replace(int id, const std::string &text)
+{
+    int new_id = add(text);
+    release(id);
+    return new_id;
+}
+
+std::string TextStore::get(int id)
+{
+    m_Mutex.lock();
+    if(id < 0 || id >= int(m_Entries.size())) id = 0;
+    std::string text = m_Entries[id].text;
+    m_Mutex.unlock();
+    return text;
+}
+
+int TextStore::find(const std::string &text)
+{
+    if(text.empty()) return 0;
+
+    size_t hash = std::hash<std::string>()(text);
+    int id = 0;
+
+    m_Mutex.lock();
+    std::pair<std::unordered_multimap<size_t, int>::iterator, std::unordered_multimap<size_t, int>::iterator> range = m_Index.equal_range(hash);
+    for(std::unordered_multimap<size_t, int>::iterator it = range.first; it != range.second; it++)
+    {
+        if(m_Entries[it->second].text == text)
+        {
+            id = it->second;
+            break;
+        }
+    }
+    m_Mutex.unlock();
+
+    return id;
+}
+
+int TextStore::getCount()
+{
+    m_Mutex.lock();
+    int count = int(m_Entries.size() - m_FreeIDs.size()) - 1;
+    m_Mutex.unlock();
+    return count;
+}
+
+size_t TextStore::getTextBytes()
+{
+    size_t bytes = 0;
+    m_Mutex.lock();
+    for(int i = 1; i < int(m_Entries.size()); i++) bytes += m_Entries[i].text.size();
+    m_Mutex.unlock();
+    return bytes;
+}
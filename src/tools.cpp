@@ -1,4 +1,5 @@
 #include "tools.hpp"
+#include "statementcache.hpp"
 
 #include <iostream>
 
@@ -125,7 +126,7 @@ bool isAlpha(std::string tstring)
     for(int i = 0; i < int(tstring.size()); i++)
     {
         int cval = int(tstring[i]);
-        if( (cval < int('a') || cval > int('z') ) && (cval < int('A') || cval < int('Z')) ) return false;
+        if( (cval < int('a') || cval > int('z') ) && (cval < int('A') || cval > int('Z')) ) return false;
     }
 
     return true;
@@ -392,36 +393,56 @@ int sqlcallback(void *data, int argc, char **argv, char **azColName)
 
 bool tableExists(sqlite3 *db, std::string table_name)
 {
-    sqlite3_stmt *stmt;
-    std::stringstream ss;
+    StatementCache *cache = StatementCache::getCache(db);
 
-    // construct SQL statement to look for table
-    ss << "SELECT name FROM sqlite_master WHERE type = 'table' AND name='" << table_name << "';";
-
-    // compile sql statement to binary
-    if( sqlite3_prepare_v2(db, ss.str().c_str(), -1, &stmt, NULL) != SQLITE_OK)
-    {
-        std::cout << "Error in tableExists while compiling sql:" << sqlite3_errmsg(db) << std::endl;
-        sqlite3_finalize(stmt);
-        return false;
-    }
+    // look for table
+    sqlite3_stmt *stmt = cache->acquire("SELECT name FROM sqlite_master WHERE type = 'table' AND name = ?;");
+    if(!stmt) return false;
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
 
     // execute sql statement
     int ret_code = 0;
     bool found_table = false;
-    while((ret_code = sqlite3_step(stmt)) == SQLITE_ROW)
+    while((ret_code = cache->step(stmt)) == SQLITE_ROW)
     {
         found_table = true;
-        //sqlite3_column_text(stmt, 0)) ) == table_name) found_table = true;
-        //std::cout << "TEST: ID = " << sqlite3_column_int(stmt, 0) << std::endl;
-        //std::cout << "TEST2 = " << sqlite3_column_name(stmt, 0) << std::endl;
-        //std::cout << "TEST3 = " << sqlite3_column_text(stmt, 0) << std::endl;
     }
     if(ret_code != SQLITE_DONE)
     {
         std::cout << "Error in tableExists while performing sql:" << sqlite3_errmsg(db) << std::endl;
     }
 
-    sqlite3_finalize(stmt);
+    cache->release(stmt);
     return found_table;
 }
+
+bool columnExists(sqlite3 *db, std::string table_name, std::string column_name)
+{
+    StatementCache *cache = StatementCache::getCache(db);
+
+    sqlite3_stmt *stmt = cache->acquire("SELECT name FROM pragma_table_info(?) WHERE name = ?;");
+    if(!stmt) return false;
+    sqlite3_bind_text(stmt, 1, table_name.c_str(), -1, SQLITE_TRANSIENT);
+    sqlite3_bind_text(stmt, 2, column_name.c_str(), -1, SQLITE_TRANSIENT);
+
+    int ret_code = 0;
+    bool found_column = false;
+    while((ret_code = cache->step(stmt)) == SQLITE_ROW)
+    {
+        found_column = true;
+    }
+    if(ret_code != SQLITE_DONE)
+    {
+        std::cout << "Error in columnExists while performing sql:" << sqlite3_errmsg(db) << std::endl;
+    }
+
+    cache->release(stmt);
+    return found_column;
+}
+
+std::string sqlColumnString(sqlite3_stmt *stmt, int col)
+{
+    const char *text = reinterpret_cast<const char*>(sqlite3_column_text(stmt, col));
+    if(!text) return std::string();
+    return std::string(text, sqlite3_column_bytes(stmt, col));
+}
@@ -0,0 +1,293 @@
+#include "worldmap.hpp"
+
+#include <cstdlib>
+#include <iostream>
+#include "zone.hpp"
+#include "direction.hpp"
+
+WorldMap::WorldMap(ZoneManager *zmgr)
+{
+    m_ZoneManager = zmgr;
+}
+
+WorldMap::~WorldMap()
+{
+
+}
+
+unsigned long long WorldMap::cellKey(int x, int y)
+{
+    return (static_cast<unsigned long long>(static_cast<unsigned int>(x)) << 32) | static_cast<unsigned int>(y);
+}
+
+bool WorldMap::isPlaced(int room_id)
+{
+    if(room_id <= 0 || room_id >= int(m_Positions.size())) return false;
+    return m_Positions[room_id].zone != 0;
+}
+
+// give room a position, returns false if another room already holds that spot
+bool WorldMap::placeRoom(int room_id, int zone, int x, int y)
+{
+    if(room_id >= int(m_Positions.size())) m_Positions.resize(room_id + 1);
+    m_Positions[room_id].zone = zone;
+    m_Positions[room_id].x = x;
+    m_Positions[room_id].y = y;
+
+    ZoneGrid &grid = m_Grids[zone];
+    if(grid.cells.empty())
+    {
+        grid.min_x = grid.max_x = x;
+        grid.min_y = grid.max_y = y;
+    }
+    else
+    {
+        if(x < grid.min_x) grid.min_x = x;
+        if(x > grid.max_x) grid.max_x = x;
+        if(y < grid.min_y) grid.min_y = y;
+        if(y > grid.max_y) grid.max_y = y;
+    }
+
+    // rooms whose exits do not fit on a grid can end up on top of each other, first one keeps the spot
+    unsigned long long key = cellKey(x, y);
+    if(grid.cells.count(key)) return false;
+    grid.cells[key] = room_id;
+    return true;
+}
+
+// place room and walk its exits placing every connected room in the zone, returns overlapping rooms
+int WorldMap::placeFrom(int room_id, int zone, int x, int y, const std::unordered_set<int> &zone_rooms)
+{
+    int overlaps = 0;
+    std::vector<int> queue;
+
+    if(!placeRoom(room_id, zone, x, y)) overlaps++;
+    queue.push_back(room_id);
+
+    for(int i = 0; i < int(queue.size()); i++)
+    {
+        int room = queue[i];
+        int room_x = m_Positions[room].x;
+        int room_y = m_Positions[room].y;
+
+        for(int n = 0; n < DIR_COUNT; n++)
+        {
+            // rooms above and below are laid out as their own part of the zone map
+            if(dirs[n].z) continue;
+            int troom = m_ZoneManager->getRoomNumInDirection(room, n);
+            if(troom <= 0 || isPlaced(troom) || !zone_rooms.count(troom)) continue;
+
+            if(!placeRoom(troom, zone, room_x + dirs[n].x, room_y + dirs[n].y)) overlaps++;
+            queue.push_back(troom);
+        }
+    }
+
+    return overlaps;
+}
+
+// rooms not connected to anything placed yet start off to the east of the zone
+void WorldMap::newComponentOrigin(int zone, int *x, int *y)
+{
+    std::unordered_map<int, ZoneGrid>::iterator git = m_Grids.find(zone);
+    if(git == m_Grids.end() || git->second.cells.empty())
+    {
+        *x = 0;
+        *y = 0;
+        return;
+    }
+    *x = git->second.max_x + 2;
+    *y = git->second.min_y;
+}
+
+int WorldMap::getRoomAt(int zone, int x, int y)
+{
+    std::unordered_map<int, ZoneGrid>::iterator git = m_Grids.find(zone);
+    if(git == m_Grids.end()) return 0;
+
+    std::unordered_map<unsigned long long, int>::iterator cit = git->second.cells.find(cellKey(x, y));
+    if(cit == git->second.cells.end()) return 0;
+    return cit->second;
+}
+
+void WorldMap::layoutZone(int zone, const std::vector<int> &room_ids)
+{
+    int overlaps = 0;
+    std::unordered_set<int> zone_rooms(room_ids.begin(), room_ids.end());
+
+    for(int i = 0; i < int(room_ids.size()); i++)
+    {
+        if(isPlaced(room_ids[i])) continue;
+
+        int x = 0;
+        int y = 0;
+        newComponentOrigin(zone, &x, &y);
+        overlaps += placeFrom(room_ids[i], zone, x, y, zone_rooms);
+    }
+
+    if(overlaps) std::cout << overlaps << " rooms overlap other rooms on the zone map.\n";
+}
+
+void WorldMap::clearZone(int zone, const std::vector<int> &room_ids)
+{
+    for(int i = 0; i < int(room_ids.size()); i++)
+    {
+        if(room_ids[i] > 0 && room_ids[i] < int(m_Positions.size())) m_Positions[room_ids[i]] = RoomPosition();
+    }
+    m_Grids.erase(zone);
+
+    // drop cached maps of zone
+    std::list<MapCacheEntry>::iterator it = m_Cache.begin();
+    while(it != m_Cache.end())
+    {
+        if(it->zone == zone)
+        {
+            m_CacheIndex.erase(it->key);
+            it = m_Cache.erase(it);
+        }
+        else it++;
+    }
+}
+
+void WorldMap::roomsLinked(int room_a, int zone_a, int room_b, int zone_b, int dir_index)
+{
+    // rooms in the same zone get placed next to each other if they have no position yet
+    if(zone_a == zone_b && !dirs[dir_index].z)
+    {
+        if(!isPlaced(room_a) && !isPlaced(room_b))
+        {
+            int x = 0;
+            int y = 0;
+            newComponentOrigin(zone_a, &x, &y);
+            placeRoom(room_a, zone_a, x, y);
+        }
+        if(isPlaced(room_a) && !isPlaced(room_b))
+        {
+            placeRoom(room_b, zone_b, m_Positions[room_a].x + dirs[dir_index].x, m_Positions[room_a].y + dirs[dir_index].y);
+        }
+        else if(isPlaced(room_b) && !isPlaced(room_a))
+        {
+            placeRoom(room_a, zone_a, m_Positions[room_b].x - dirs[dir_index].x, m_Positions[room_b].y - dirs[dir_index].y);
+        }
+    }
+
+    // only maps that can see one of the rooms need to be drawn again
+    if(isPlaced(room_a)) invalidateNear(m_Positions[room_a].zone, m_Positions[room_a].x, m_Positions[room_a].y);
+    if(isPlaced(room_b)) invalidateNear(m_Positions[room_b].zone, m_Positions[room_b].x, m_Positions[room_b].y);
+}
+
+void WorldMap::roomChanged(int room_id)
+{
+    if(isPlaced(room_id)) invalidateNear(m_Positions[room_id].zone, m_Positions[room_id].x, m_Positions[room_id].y);
+}
+
+void WorldMap::invalidateNear(int zone, int x, int y)
+{
+    std::list<MapCacheEntry>::iterator it = m_Cache.begin();
+    while(it != m_Cache.end())
+    {
+        if(it->zone == zone && abs(it->x - x) <= it->radius && abs(it->y - y) <= it->radius)
+        {
+            m_CacheIndex.erase(it->key);
+            it = m_Cache.erase(it);
+        }
+        else it++;
+    }
+}
+
+bool WorldMap::getPosition(int room_id, int *x, int *y)
+{
+    if(!isPlaced(room_id)) return false;
+    if(x) *x = m_Positions[room_id].x;
+    if(y) *y = m_Positions[room_id].y;
+    return true;
+}
+
+std::string WorldMap::getMap(int room_id, int radius)
+{
+    if(!isPlaced(room_id)) return "";
+    if(radius < 1) radius = 1;
+    if(radius > MAP_MAX_RADIUS) radius = MAP_MAX_RADIUS;
+
+    unsigned long long key = (static_cast<unsigned long long>(room_id) << 32) | static_cast<unsigned int>(radius);
+
+    // check map cache, move hit to front
+    std::unordered_map<unsigned long long, std::list<MapCacheEntry>::iterator>::iterator cit = m_CacheIndex.find(key);
+    if(cit != m_CacheIndex.end())
+    {
+        m_Cache.splice(m_Cache.begin(), m_Cache, cit->second);
+        return cit->second->text;
+    }
+
+    // store rendered map in cache, dropping the least recently used map if full
+    m_Cache.push_front(MapCacheEntry());
+    m_Cache.front().key = key;
+    m_Cache.front().zone = m_Positions[room_id].zone;
+    m_Cache.front().x = m_Positions[room_id].x;
+    m_Cache.front().y = m_Positions[room_id].y;
+    m_Cache.front().radius = radius;
+    m_Cache.front().text = render(room_id, radius);
+    m_CacheIndex[key] = m_Cache.begin();
+    if(int(m_Cache.size()) > MAP_CACHE_SIZE)
+    {
+        m_CacheIndex.erase(m_Cache.back().key);
+        m_Cache.pop_back();
+    }
+
+    return m_Cache.front().text;
+}
+
+// rooms are drawn every other character with their exits in between
+// @ is the center room, # other rooms
+std::string WorldMap::render(int room_id, int radius)
+{
+    RoomPosition center = m_Positions[room_id];
+    int size = radius * 4 + 1;
+    std::vector<std::string> lines(size, std::string(size, ' '));
+
+    for(int dy = -radius; dy <= radius; dy++)
+    {
+        for(int dx = -radius; dx <= radius; dx++)
+        {
+            int troom = getRoomAt(center.zone, center.x + dx, center.y + dy);
+            if(!troom) continue;
+
+            int col = (dx + radius) * 2;
+            int row = (dy + radius) * 2;
+            lines[row][col] = (troom == room_id) ? '@' : '#';
+
+            // exits
+            for(int n = 0; n < DIR_COUNT; n++)
+            {
+                if(dirs[n].z || m_ZoneManager->getRoomNumInDirection(troom, n) <= 0) continue;
+
+                int ecol = col + dirs[n].x;
+                int erow = row + dirs[n].y;
+                if(ecol < 0 || ecol >= size || erow < 0 || erow >= size) continue;
+                if(!dirs[n].y) lines[erow][ecol] = '-';
+                else if(!dirs[n].x) lines[erow][ecol] = '|';
+                else
+                {
+                    // diagonal exits crossing between four rooms
+                    char diagonal = (dirs[n].x == dirs[n].y) ? '\\' : '/';
+                    char &cell = lines[erow][ecol];
+                    cell = (cell != ' ' && cell != diagonal) ? 'X' : diagonal;
+                }
+            }
+        }
+    }
+
+    // trim trailing spaces and empty lines above and below the rooms
+    std::string map;
+    int first = size;
+    int last = -1;
+    for(int i = 0; i < size; i++)
+    {
+        size_t end = lines[i].find_last_not_of(' ');
+        if(end == std::string::npos) continue;
+        lines[i].resize(end + 1);
+        if(first == size) first = i;
+        last = i;
+    }
+    for(int i = first; i <= last; i++) map += lines[i] + "\n";
+    return map;
+}
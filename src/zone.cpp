@@ -6,7 +6,7 @@
 
 bool ZoneManager::m_Initialized = false;
 
-ZoneManager::ZoneManager(sqlite3 *db)
+ZoneManager::ZoneManager(Storage *storage)
 {
     if(m_Initialized)
     {
@@ -15,39 +15,24 @@ ZoneManager::ZoneManager(sqlite3 *db)
     }
     m_Initialized = true;
     m_NextAvailableRoomID = 1;
+    m_Saving = false;
 
-    // database reference
-    m_DB = db;
+    // storage reference
+    m_Storage = storage;
+    m_Journal = NULL;
 
     // create buffer room as room 0 to account for rowid 0 being column names
-    m_Rooms.push_back(Room());
-
-    // create new table if new
-    if(!tableExists(m_DB, "rooms"))
-    {
-        std::cout << "Creating new rooms table in database...\n";
-        std::stringstream ss;
-        char *errormsg = 0;
-        // note : if this changes, update create, save, and load functions
-        ss << "CREATE TABLE rooms( ";
-        ss << "room_id INTEGER PRIMARY KEY,";
-        ss << "zone TEXT NOT NULL,";
-        ss << "name TEXT NOT NULL,";
-        ss << "description INTEGER,";
-        for(int i = 0; i < DIR_COUNT; i++)
-        {
-            ss << "exit_" << dirs[i][0];
-            if( i < DIR_COUNT-1 ) ss << ",";
-        }
-        ss << ");";
+    m_RoomTable.store(new RoomTable(1));
 
-        if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
-        {
-            std::cout << "Error creating rooms table:" << errormsg << std::endl;
-            sqlite3_free(errormsg);
-            return;
-        }
+    m_PathFinder = new PathFinder(this);
+    m_WorldMap = new WorldMap(this);
 
+    bool created = false;
+    if(!m_Storage->openWorld(&created)) return;
+
+    // new world
+    if(created)
+    {
         // create test zone and rooms
         if(!createZone("testzone")) std::cout << "ERROR CREATING TEST ZONE!\n";
 
@@ -55,15 +40,15 @@ ZoneManager::ZoneManager(sqlite3 *db)
         {
             Room *test_room = createRoom("testzone");
             if(!test_room) std::cout << "ERROR CREATING TEST ROOM!\n";
-            test_room->name = "Main room of Cabin";
-            test_room->description = "This cabin has long been abandoned.  The floor is covered in a thick layer of dust.  Cobwebs have taken up all corners of the room.  A fireplace is built into the southern wall.";
+            setRoomName(test_room->room_id, "Main room of Cabin");
+            setRoomDescription(test_room->room_id, "This cabin has long been abandoned.  The floor is covered in a thick layer of dust.  Cobwebs have taken up all corners of the room.  A fireplace is built into the southern wall.");
         }
         // create room 2
         {
             Room *test_room = createRoom("testzone");
             if(!test_room) std::cout << "ERROR CREATING TEST ROOM!\n";
-            test_room->name = "Cabin Storage Room";
-            test_room->description = "This is a small cramped storage room.  Sheleves are lined against the wall containg various odds and ends.";
+            setRoomName(test_room->room_id, "Cabin Storage Room");
+            setRoomDescription(test_room->room_id, "This is a small cramped storage room.  Sheleves are lined against the wall containg various odds and ends.");
             linkRooms(1, 2, getDirectionIndex("west"));
         }
 
@@ -73,75 +58,693 @@ ZoneManager::ZoneManager(sqlite3 *db)
 
 
     }
-    // if room database already exists, load all rooms from db into memory
+    // if world already exists, find zones in storage, rooms are loaded
+    // when their zone is first used
     else
     {
-        std::cout << "Loading rooms from database...\n";
-        if(!_LoadRooms()) std::cout << "Error, failed to load rooms from database!\n";
+        // use world snapshot if it matches storage, otherwise rebuild it
+        sf::Int64 world_version = m_Storage->getWorldVersion();
+        if(WORLD_SNAPSHOT && m_Snapshot.open(WORLD_SNAPSHOT_FILE) && m_Snapshot.getDataVersion() == world_version && m_Snapshot.getDirCount() == DIR_COUNT)
+        {
+            std::cout << "Loading zones from world snapshot...\n";
+            if(!_LoadZoneListFromSnapshot()) std::cout << "Error, failed to load zones from world snapshot!\n";
+        }
+        else
+        {
+            m_Snapshot.close();
+            std::cout << "Loading zones from " << m_Storage->getName() << " storage...\n";
+            if(!_LoadZoneList()) std::cout << "Error, failed to load zones from storage!\n";
+
+            if(WORLD_SNAPSHOT)
+            {
+                std::cout << "Rebuilding world snapshot...\n";
+                if(m_Storage->writeSnapshot(WORLD_SNAPSHOT_FILE, world_version, DIR_COUNT) && m_Snapshot.open(WORLD_SNAPSHOT_FILE))
+                {
+                    _LinkSnapshotZones();
+                }
+                else std::cout << "Error, failed to write world snapshot!\n";
+            }
+        }
+
+        if(!ZONE_LAZY_LOAD)
+        {
+            std::cout << "Loading all rooms from storage...\n";
+            if(!_LoadAllRooms()) std::cout << "Error, failed to load rooms from storage!\n";
+        }
+    }
+}
+
+bool ZoneManager::_LoadZoneList()
+{
+    // get each zone, how many rooms it has and the highest room id used in it
+    std::vector<StoredZone> zones;
+    if(!m_Storage->loadZoneList(&zones)) return false;
+    for(int i = 0; i < int(zones.size()); i++)
+    {
+        // zone rooms are not in memory yet
+        Zone *tzone = createZone(zones[i].name);
+        if(tzone)
+        {
+            tzone->loaded = false;
+            tzone->room_count = zones[i].room_count;
+        }
+        else std::cout << "Failed to create zone " << zones[i].name << " on load.\n";
+
+        if(zones[i].max_room_id >= m_NextAvailableRoomID) m_NextAvailableRoomID = zones[i].max_room_id + 1;
+    }
+
+    // make room for every room id, rooms stay NULL until their zone is loaded
+    growRoomTable(m_NextAvailableRoomID);
+
+    std::cout << m_Zones.size() << " zones found with " << m_NextAvailableRoomID-1 << " rooms.\n";
+    return true;
+}
+
+bool ZoneManager::_LoadZoneListFromSnapshot()
+{
+    for(int i = 0; i < m_Snapshot.getZoneCount(); i++)
+    {
+        std::string zone = m_Snapshot.getZoneName(i);
+
+        // zone rooms are not in memory yet
+        Zone *tzone = createZone(zone);
+        if(tzone)
+        {
+            tzone->loaded = false;
+            tzone->room_count = m_Snapshot.getZoneRoomCount(i);
+        }
+        else std::cout << "Failed to create zone " << zone << " on load.\n";
+    }
+    _LinkSnapshotZones();
+
+    m_NextAvailableRoomID = m_Snapshot.getRoomSlots();
+    if(m_NextAvailableRoomID < 1) m_NextAvailableRoomID = 1;
+    growRoomTable(m_NextAvailableRoomID);
+
+    std::cout << m_Zones.size() << " zones found with " << m_NextAvailableRoomID-1 << " rooms.\n";
+    return true;
+}
+
+// match zones with their copies in the world snapshot
+void ZoneManager::_LinkSnapshotZones()
+{
+    for(int i = 0; i < m_Snapshot.getZoneCount(); i++)
+    {
+        int zone_index = findZone(m_Snapshot.getZoneName(i));
+        if(zone_index == -1) continue;
+        m_Zones[zone_index].snapshot_zone = i;
+        m_Zones[zone_index].snapshot_stale = false;
+    }
+}
+
+// zone can be loaded from snapshot if it is in the snapshot and unchanged since
+bool ZoneManager::useSnapshot(int zone_index)
+{
+    if(!m_Snapshot.isOpen()) return false;
+    return m_Zones[zone_index].snapshot_zone != -1 && !m_Zones[zone_index].snapshot_stale;
+}
+
+// load every room in one pass
+bool ZoneManager::_LoadAllRooms()
+{
+    sf::Clock load_clock;
+    int error_count = 0;
+    int total_rooms = 0;
+    std::vector<int> loaded_rooms;
+
+    m_RoomMutex.lock();
+    m_ZoneMutex.lock();
+
+    // allocate storage for everything up front
+    for(int i = 0; i < int(m_Zones.size()); i++)
+    {
+        if(m_Zones[i].loaded) continue;
+        total_rooms += m_Zones[i].room_count;
+        m_Zones[i].rooms.reserve(m_Zones[i].room_count);
+    }
+    reserveRooms(total_rooms);
+
+    // with a snapshot, zones are loaded one by one so unchanged zones are read from it
+    int room_count = 0;
+    if(m_Snapshot.isOpen())
+    {
+        for(int i = 0; i < int(m_Zones.size()); i++)
+        {
+            if(m_Zones[i].loaded) continue;
+            if(!_LoadZone(i)) error_count++;
+            room_count += int(m_Zones[i].rooms.size());
+        }
+        std::cout << room_count << " rooms loaded in " << load_clock.getElapsedTime().asMilliseconds() << "ms with " << error_count << " errors.\n";
+        m_ZoneMutex.unlock();
+        m_RoomMutex.unlock();
+        return true;
+    }
+
+    // read every room in one pass
+    room_count = _ReadRooms("", &error_count);
+
+    for(int i = 0; i < int(m_Zones.size()); i++)
+    {
+        if(m_Zones[i].loaded) continue;
+        m_Zones[i].loaded = true;
+        m_Zones[i].last_access = m_Clock.getElapsedTime();
+        loaded_rooms.insert(loaded_rooms.end(), m_Zones[i].rooms.begin(), m_Zones[i].rooms.end());
+        if(ROOM_COORDINATES) m_WorldMap->layoutZone(m_Zones[i].name_id, m_Zones[i].rooms);
     }
+    error_count += _ValidateRooms(loaded_rooms);
+
+    std::cout << room_count << " rooms loaded in " << load_clock.getElapsedTime().asMilliseconds() << "ms with " << error_count << " errors.\n";
+    std::cout << m_RoomText.getCount() << " unique room texts stored (" << m_RoomText.getTextBytes() << " bytes).\n";
+
+    m_ZoneMutex.unlock();
+    m_RoomMutex.unlock();
+    return true;
 }
 
-bool ZoneManager::_LoadRooms()
+bool ZoneManager::_LoadZone(int zone_index)
 {
-    std::stringstream ss;
-    sqlite3_stmt *stmt;
+    sf::Clock load_clock;
     int error_count = 0;
 
-    // load all rooms from database
-    ss << "SELECT * FROM rooms;";
-    // compile sql statement to binary
-    int rc = sqlite3_prepare_v2(m_DB, ss.str().c_str(), -1, &stmt, NULL);
-    if( rc != SQLITE_OK)
+    m_RoomMutex.lock();
+    m_ZoneMutex.lock();
+
+    if(zone_index < 0 || zone_index >= int(m_Zones.size()))
     {
-        std::cout << "Error in sql compile during load rooms:" << sqlite3_errmsg(m_DB) << std::endl;
-        sqlite3_finalize(stmt);
+        m_ZoneMutex.unlock();
+        m_RoomMutex.unlock();
         return false;
     }
-    // execute sql statement
-    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+    Zone *tzone = &m_Zones[zone_index];
+    if(tzone->loaded)
+    {
+        m_ZoneMutex.unlock();
+        m_RoomMutex.unlock();
+        return true;
+    }
+
+    // allocate storage for zone up front
+    reserveRooms(tzone->room_count);
+    tzone->rooms.reserve(tzone->room_count);
+
+    int room_count = 0;
+    if(useSnapshot(zone_index))
+    {
+        room_count = _ReadSnapshotRooms(zone_index, &error_count);
+    }
+    // load all zone rooms from storage
+    else
+    {
+        room_count = _ReadRooms(tzone->name, &error_count);
+    }
+
+    tzone->loaded = true;
+    tzone->last_access = m_Clock.getElapsedTime();
+    error_count += _ValidateRooms(tzone->rooms);
+    if(ROOM_COORDINATES) m_WorldMap->layoutZone(tzone->name_id, tzone->rooms);
+
+    std::cout << "Zone " << tzone->name << " loaded " << room_count << " rooms in " << load_clock.getElapsedTime().asMilliseconds() << "ms with " << error_count << " errors.\n";
+
+    m_ZoneMutex.unlock();
+    m_RoomMutex.unlock();
+    return true;
+}
+
+// rooms read by one _ReadRooms call
+struct RoomLoad
+{
+    ZoneManager *zonemgr;
+    int zone_index;             // zone of the last room read
+    std::string zone_name;
+    int room_count;
+    int error_count;
+};
+
+// read rooms of zone (all zones if empty) from storage into room storage, returns number of rooms read
+// expects room and zone mutexes to be locked
+int ZoneManager::_ReadRooms(const std::string &zone, int *error_count)
+{
+    RoomLoad load;
+    load.zonemgr = this;
+    load.zone_index = -1;
+    load.room_count = 0;
+    load.error_count = 0;
+
+    if(!m_Storage->loadRooms(zone, readStoredRoom, &load)) load.error_count++;
+
+    *error_count += load.error_count;
+    return load.room_count;
+}
+
+void ZoneManager::readStoredRoom(void *data, const StoredRoom &troom)
+{
+    RoomLoad *load = static_cast<RoomLoad*>(data);
+    ZoneManager *zonemgr = load->zonemgr;
+
+    // room ids must be valid and unique
+    if(troom.room_id <= 0 || zonemgr->getRoomSlot(troom.room_id))
+    {
+        std::cout << "Invalid or duplicate room id " << troom.room_id << std::endl;
+        load->error_count++;
+        return;
+    }
+
+    // consecutive rooms are usually in the same zone, only look zone up when it changes
+    if(load->zone_index == -1 || load->zone_name != troom.zone)
+    {
+        load->zone_name = troom.zone;
+        load->zone_index = zonemgr->findZone(load->zone_name);
+        if(load->zone_index == -1 && zonemgr->createZone(load->zone_name)) load->zone_index = zonemgr->findZone(load->zone_name);
+    }
+    if(load->zone_index == -1)
+    {
+        std::cout << "Invalid zone '" << load->zone_name << "' for room id " << troom.room_id << std::endl;
+        load->error_count++;
+        return;
+    }
+
+    if(troom.room_id >= zonemgr->m_NextAvailableRoomID) zonemgr->m_NextAvailableRoomID = troom.room_id + 1;
+
+    RoomState *state = zonemgr->newRoomState(troom.name, troom.description);
+    for(int i = 0; i < int(troom.exits.size()); i++)
+    {
+        // exits that are not a direction are named exits
+        const StoredExit &texit = troom.exits[i];
+        int dir_index = getDirectionIndex(texit.dir);
+        if(dir_index != -1)
+        {
+            state->exits[dir_index] = texit.to_room;
+            if(texit.flags) setSpecialExit(state, dir_index, "", texit.to_room, texit.flags);
+        }
+        else setSpecialExit(state, -1, texit.dir, texit.to_room, texit.flags);
+    }
+
+    zonemgr->addLoadedRoom(load->zone_index, troom.room_id, state);
+    load->room_count++;
+}
+
+// make loaded room available, expects room and zone mutexes to be locked
+void ZoneManager::addLoadedRoom(int zone_index, int room_id, RoomState *state)
+{
+    Zone *tzone = &m_Zones[zone_index];
+
+    Room *troom = allocRoom();
+    troom->room_id = room_id;
+    m_ZoneNames.addRef(tzone->name_id);
+    troom->zone = tzone->name_id;
+    troom->state.store(state, std::memory_order_relaxed);
+
+    setRoomSlot(room_id, troom);
+    tzone->rooms.push_back(room_id);
+}
+
+// read zone's rooms straight out of the mapped world snapshot, returns number of rooms read
+// expects room and zone mutexes to be locked
+int ZoneManager::_ReadSnapshotRooms(int zone_index, int *error_count)
+{
+    Zone *tzone = &m_Zones[zone_index];
+    int snapshot_zone = tzone->snapshot_zone;
+    int room_count = 0;
+
+    for(int i = 0; i < m_Snapshot.getZoneRoomCount(snapshot_zone); i++)
+    {
+        int room_id = m_Snapshot.getZoneRoom(snapshot_zone, i);
+
+        // room ids must be valid and unique
+        if(!m_Snapshot.hasRoom(room_id) || getRoomSlot(room_id))
+        {
+            std::cout << "Invalid or duplicate room id " << room_id << " in world snapshot\n";
+            (*error_count)++;
+            continue;
+        }
+        if(room_id >= m_NextAvailableRoomID) m_NextAvailableRoomID = room_id + 1;
+
+        RoomState *state = newRoomState(m_Snapshot.getRoomName(room_id), m_Snapshot.getRoomDescription(room_id));
+        for(int n = 0; n < DIR_COUNT; n++)
+        {
+            state->exits[n] = m_Snapshot.getRoomExit(room_id, n);
+        }
+        for(int n = 0; n < m_Snapshot.getRoomSpecialExitCount(room_id); n++)
+        {
+            std::string name;
+            int to_room = 0;
+            int flags = 0;
+            if(!m_Snapshot.getRoomSpecialExit(room_id, n, &name, &to_room, &flags)) continue;
+            int dir_index = getDirectionIndex(name);
+            setSpecialExit(state, dir_index, dir_index == -1 ? name : "", to_room, flags);
+        }
+
+        addLoadedRoom(zone_index, room_id, state);
+        room_count++;
+    }
+
+    return room_count;
+}
+
+// check exits of newly loaded rooms lead to valid room ids, returns number of bad exits
+int ZoneManager::_ValidateRooms(const std::vector<int> &room_ids)
+{
+    int error_count = 0;
+
+    for(int i = 0; i < int(room_ids.size()); i++)
     {
-        bool failed = false;
+        Room *troom = getRoomSlot(room_ids[i]);
+        if(!troom) continue;
 
-        // get zone name of entry
-        std::string zone = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt,1)) );
-        // if zone doesn't currently exist, create it
-        if(!zoneExists(zone)) createZone(zone);
-        // create room
-        Room *troom = createRoom(zone, false);
-        // if room was successfully created, set room variables from database
-        if(troom)
+        const RoomState *state = troom->state.load(std::memory_order_acquire);
+        RoomState *fixed = NULL;
+        for(int n = 0; n < DIR_COUNT; n++)
         {
-            troom->name = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt,2)) );
-            troom->description = std::string(reinterpret_cast<const char*>(sqlite3_column_text(stmt,3)) );
-            for(int i = 0; i < DIR_COUNT; i++)
+            int exit_id = state->exits[n];
+            if(!exit_id) continue;
+
+            // exit leads outside of known room ids, or to a missing room when everything is loaded
+            if(exit_id < 0 || exit_id >= m_NextAvailableRoomID || (!ZONE_LAZY_LOAD && !getRoomSlot(exit_id)) )
             {
-                troom->exits[i] = sqlite3_column_int(stmt, 4 + i);
+                std::cout << "Room " << troom->room_id << " exit " << dirs[n].name << " leads to invalid room " << exit_id << ", removing exit.\n";
+                if(!fixed) fixed = copyRoomState(state);
+                fixed->exits[n] = 0;
+                setSpecialExit(fixed, n, "", 0, 0);
+                error_count++;
             }
-            // if for some reason newly created room is not synced with expected room id from database, squawk
-            if( troom->room_id != sqlite3_column_int(stmt,0))
+        }
+        for(int n = 0; n < int(state->special_exits.size()); n++)
+        {
+            const SpecialExit &texit = state->special_exits[n];
+            if(texit.dir != -1) continue;
+            if(texit.to_room <= 0 || texit.to_room >= m_NextAvailableRoomID || (!ZONE_LAZY_LOAD && !getRoomSlot(texit.to_room)) )
             {
-                std::cout << "Loaded new room id does not match database room id!\n";
-                failed = true;
+                std::cout << "Room " << troom->room_id << " exit " << texit.name << " leads to invalid room " << texit.to_room << ", removing exit.\n";
+                if(!fixed) fixed = copyRoomState(state);
+                setSpecialExit(fixed, -1, texit.name, 0, 0);
+                error_count++;
             }
         }
-        else
+        if(fixed)
         {
-            std::cout << "Failed to create new room on load.\n";
-            failed = true;
+            publishRoomState(troom, fixed);
+            markRoomDirty(troom);
         }
+    }
+
+    return error_count;
+}
+
+void ZoneManager::reserveRooms(int count)
+{
+    if(int(m_FreeRooms.size()) >= count) return;
+
+    // allocate missing rooms as one block
+    int block_size = count - int(m_FreeRooms.size());
+    Room *block = new Room[block_size];
+    m_RoomBlocks.push_back(block);
+    m_FreeRooms.reserve(m_FreeRooms.size() + block_size);
+    for(int i = block_size - 1; i >= 0; i--) m_FreeRooms.push_back(&block[i]);
+}
+
+Room *ZoneManager::allocRoom()
+{
+    if(m_FreeRooms.empty()) reserveRooms(ROOM_BLOCK_SIZE);
+    Room *troom = m_FreeRooms.back();
+    m_FreeRooms.pop_back();
+    return troom;
+}
+
+void ZoneManager::freeRoom(Room *troom)
+{
+    m_RoomMutex.lock();
+    m_ZoneNames.release(troom->zone);
+    freeRoomState(this, const_cast<RoomState*>(troom->state.load()));
+    troom->room_id = 0;
+    troom->zone = 0;
+    troom->state.store(NULL);
+    troom->last_access.store(0);
+    troom->dirty = false;
+    m_FreeRooms.push_back(troom);
+    m_RoomMutex.unlock();
+}
+
+// unloaded rooms go back to storage once readers are done with them
+void ZoneManager::recycleRoom(void *zmgr, void *troom)
+{
+    static_cast<ZoneManager*>(zmgr)->freeRoom(static_cast<Room*>(troom));
+}
+
+Room *ZoneManager::getRoomSlot(int room_id)
+{
+    RoomTable *table = m_RoomTable.load(std::memory_order_acquire);
+    if(room_id <= 0 || room_id >= int(table->slots.size())) return NULL;
+    return table->slots[room_id].load(std::memory_order_acquire);
+}
+
+// expects room mutex to be locked
+void ZoneManager::setRoomSlot(int room_id, Room *troom)
+{
+    if(room_id <= 0) return;
+    growRoomTable(room_id + 1);
+    m_RoomTable.load(std::memory_order_relaxed)->slots[room_id].store(troom, std::memory_order_release);
+}
+
+// expects room mutex to be locked
+void ZoneManager::growRoomTable(int size)
+{
+    RoomTable *table = m_RoomTable.load(std::memory_order_relaxed);
+    int old_size = int(table->slots.size());
+    if(size <= old_size) return;
+
+    // grow by at least half again so adding rooms one at a time does not copy every time
+    if(size < old_size + old_size / 2) size = old_size + old_size / 2;
+
+    RoomTable *new_table = new RoomTable(size);
+    for(int i = 0; i < old_size; i++)
+    {
+        new_table->slots[i].store(table->slots[i].load(std::memory_order_relaxed), std::memory_order_relaxed);
+    }
+    m_RoomTable.store(new_table, std::memory_order_release);
+    m_Epoch.retire(table);
+}
+
+int ZoneManager::getRoomCount()
+{
+    EpochGuard guard(&m_Epoch);
+    return int(m_RoomTable.load(std::memory_order_acquire)->slots.size());
+}
+
+RoomState *ZoneManager::newRoomState(const std::string &name, const std::string &description)
+{
+    RoomState *state = new RoomState;
+    state->name = m_RoomText.add(name);
+    state->description = m_RoomText.add(description);
+    state->exits.resize(DIR_COUNT, 0);
+    return state;
+}
+
+// editable copy of a room state, the copy holds its own text references
+RoomState *ZoneManager::copyRoomState(const RoomState *state)
+{
+    // rendered look is left behind, the copy is about to change
+    RoomState *copy = new RoomState;
+    copy->name = state->name;
+    copy->description = state->description;
+    copy->exits = state->exits;
+    copy->special_exits = state->special_exits;
+    m_RoomText.addRef(copy->name);
+    m_RoomText.addRef(copy->description);
+    return copy;
+}
+
+// make state the room's current state, expects room mutex to be locked
+void ZoneManager::publishRoomState(Room *troom, RoomState *state)
+{
+    const RoomState *old_state = troom->state.exchange(state, std::memory_order_acq_rel);
+    if(old_state) m_Epoch.retire(freeRoomState, this, const_cast<RoomState*>(old_state));
+}
+
+void ZoneManager::freeRoomState(void *zmgr, void *state)
+{
+    if(!state) return;
+    ZoneManager *zonemgr = static_cast<ZoneManager*>(zmgr);
+    RoomState *tstate = static_cast<RoomState*>(state);
+    zonemgr->m_RoomText.release(tstate->name);
+    zonemgr->m_RoomText.release(tstate->description);
+    delete tstate->look.load();
+    delete tstate;
+}
+
+bool ZoneManager::_LoadRoomZone(int room_id)
+{
+    std::string zone;
 
-        if(failed) error_count++;
+    // find which zone room belongs to
+    if(!m_Storage->findRoomZone(room_id, &zone)) return false;
+
+    if(zone.empty()) return false;
+    return _LoadZone(findZone(zone));
+}
+
+bool ZoneManager::_UnloadZone(int zone_index)
+{
+    // flush changes before letting go of the rooms, the save mutex is held until the
+    // rooms are gone so no other save has rooms taken but not yet confirmed by storage
+    // loading the zone again reads storage under the room mutex without flushing, this is what makes that safe
+    m_SaveMutex.lock();
+    if(!_SaveRooms())
+    {
+        std::cout << "Error saving rooms, not unloading zone.\n";
+        m_SaveMutex.unlock();
+        return false;
     }
-    if(rc != SQLITE_DONE)
+
+    m_RoomMutex.lock();
+    m_ZoneMutex.lock();
+
+    if(zone_index < 0 || zone_index >= int(m_Zones.size()) || !m_Zones[zone_index].loaded)
     {
-        std::cout << "Error in sql during load rooms:" << sqlite3_errmsg(m_DB) << std::endl;
+        m_ZoneMutex.unlock();
+        m_RoomMutex.unlock();
+        m_SaveMutex.unlock();
+        return false;
     }
-    sqlite3_finalize(stmt);
+    Zone *tzone = &m_Zones[zone_index];
 
-    std::cout << m_Rooms.size()-1 << " rooms loaded with " << error_count << " errors.\n";
+    // keep zone in memory rather than lose changes made since, it is tried again later
+    for(int i = 0; i < int(tzone->rooms.size()); i++)
+    {
+        Room *troom = getRoomSlot(tzone->rooms[i]);
+        if(troom && troom->dirty)
+        {
+            m_ZoneMutex.unlock();
+            m_RoomMutex.unlock();
+            m_SaveMutex.unlock();
+            return false;
+        }
+    }
+
+    // free rooms
+    if(ROOM_COORDINATES) m_WorldMap->clearZone(tzone->name_id, tzone->rooms);
+    for(int i = 0; i < int(tzone->rooms.size()); i++)
+    {
+        Room *troom = getRoomSlot(tzone->rooms[i]);
+        if(!troom) continue;
+        setRoomSlot(tzone->rooms[i], NULL);
+        m_Epoch.retire(recycleRoom, this, troom);
+    }
+    std::vector<int>().swap(tzone->rooms);
+    tzone->loaded = false;
+
+    std::cout << "Zone " << tzone->name << " unloaded.\n";
+
+    m_ZoneMutex.unlock();
+    m_RoomMutex.unlock();
+    m_SaveMutex.unlock();
     return true;
 }
 
+void ZoneManager::update()
+{
+    sf::Time now = m_Clock.getElapsedTime();
+
+    // free room data readers are done with
+    m_Epoch.reclaim();
+
+    // unloading would wait for the save to finish, try again next update
+    if(ZONE_IDLE_TIMEOUT <= 0 || m_Saving) return;
+
+    // find zones nobody has used for a while, zone workers can be adding zones and rooms meanwhile
+    // unloading takes the room mutex, which comes before the zone mutex, so it waits until after
+    std::vector<int> idle_zones;
+    {
+        EpochGuard guard(&m_Epoch);
+        m_ZoneMutex.lock();
+        for(int i = 0; i < int(m_Zones.size()); i++)
+        {
+            if(zoneIdle(i, now)) idle_zones.push_back(i);
+        }
+        m_ZoneMutex.unlock();
+    }
+
+    for(int i = 0; i < int(idle_zones.size()); i++) _UnloadZone(idle_zones[i]);
+}
+
+// lock free unless room's zone needs loading, callers outside the room mutex
+// must be in an epoch section for as long as they use the room
+Room *ZoneManager::getRoom(int room_id)
+{
+    if(room_id <= 0 || room_id >= getRoomCount()) return NULL;
+
+    // load room's zone on first use
+    Room *troom = getRoomSlot(room_id);
+    if(!troom)
+    {
+        if(!_LoadRoomZone(room_id)) return NULL;
+        troom = getRoomSlot(room_id);
+        if(!troom) return NULL;
+    }
+
+    touchZone(troom);
+    return troom;
+}
+
+int ZoneManager::findZone(std::string zonename)
+{
+    int zone_index = -1;
+
+    // zone names are interned, so look up by name id instead of comparing names
+    m_ZoneMutex.lock();
+    std::unordered_map<int, int>::iterator zit = m_ZoneLookup.find(m_ZoneNames.find(zonename));
+    if(zit != m_ZoneLookup.end()) zone_index = zit->second;
+    m_ZoneMutex.unlock();
+
+    return zone_index;
+}
+
+// readers only stamp the room, zones pick up the newest stamp when checked for idleness
+void ZoneManager::touchZone(Room *troom)
+{
+    int now = int(m_Clock.getElapsedTime().asSeconds());
+    if(troom->last_access.load(std::memory_order_relaxed) != now) troom->last_access.store(now, std::memory_order_relaxed);
+}
+
+// expects zone mutex to be locked and to be in an epoch section
+bool ZoneManager::zoneIdle(int zone_index, sf::Time now)
+{
+    Zone *tzone = &m_Zones[zone_index];
+    if(!tzone->loaded || (now - tzone->last_access) <= sf::seconds(ZONE_IDLE_TIMEOUT)) return false;
+
+    // zone looks idle, check if any of its rooms were used since
+    int last_access = 0;
+    for(int i = 0; i < int(tzone->rooms.size()); i++)
+    {
+        Room *troom = getRoomSlot(tzone->rooms[i]);
+        if(troom && troom->last_access.load(std::memory_order_relaxed) > last_access) last_access = troom->last_access.load(std::memory_order_relaxed);
+    }
+    if(sf::seconds(float(last_access)) > tzone->last_access) tzone->last_access = sf::seconds(float(last_access));
+
+    return (now - tzone->last_access) > sf::seconds(ZONE_IDLE_TIMEOUT);
+}
+
+// expects room mutex to be locked
+void ZoneManager::markRoomDirty(Room *troom)
+{
+    // every change is journaled, the room is only saved once
+    if(m_Journal)
+    {
+        StoredRoom stored;
+        _StoreRoom(&stored, troom->room_id, troom->zone, troom->state.load(std::memory_order_acquire));
+        m_Journal->logRoom(stored);
+    }
+
+    if(troom->dirty) return;
+    troom->dirty = true;
+    m_DirtyRooms.push_back(troom->room_id);
+
+    // stored copy of zone is about to change, stop loading it from the snapshot
+    m_ZoneMutex.lock();
+    std::unordered_map<int, int>::iterator zit = m_ZoneLookup.find(troom->zone);
+    if(zit != m_ZoneLookup.end()) m_Zones[zit->second].snapshot_stale = true;
+    m_ZoneMutex.unlock();
+}
+
 std::vector<std::string> ZoneManager::getZones()
 {
     std::vector<std::string> zones;
@@ -165,19 +768,21 @@ Zone *ZoneManager::createZone(std::string zonename)
 
     // check that zone doesn't exist
     m_ZoneMutex.lock();
-    for(int i = 0; i < int(m_Zones.size()); i++)
+    if(findZone(zonename) != -1)
     {
-        if(m_Zones[i].name == zonename)
-        {
-            m_ZoneMutex.unlock();
-            return NULL;
-        }
+        m_ZoneMutex.unlock();
+        return NULL;
     }
 
-    // add zone to list
+    // add zone to list, a brand new zone has nothing to load
     m_Zones.push_back(Zone());
     tzone = &m_Zones.back();
     tzone->name = zonename;
+    tzone->loaded = true;
+    tzone->last_access = m_Clock.getElapsedTime();
+    // zone keeps a reference to its interned name so the name id stays valid
+    tzone->name_id = m_ZoneNames.add(zonename);
+    m_ZoneLookup[tzone->name_id] = int(m_Zones.size()) - 1;
     m_ZoneMutex.unlock();
 
     return tzone;
@@ -185,62 +790,41 @@ Zone *ZoneManager::createZone(std::string zonename)
 
 bool ZoneManager::zoneExists(std::string zonename)
 {
-    bool exists = false;
-
-    m_ZoneMutex.lock();
-    for(int i = 0; i < int(m_Zones.size()); i++)
-    {
-        if(m_Zones[i].name == zonename)
-        {
-            exists = true;
-            break;
-        }
-    }
-    m_ZoneMutex.unlock();
-
-    return exists;
+    return findZone(zonename) != -1;
 }
 
 Room *ZoneManager::createRoom(std::string zonename, bool save_to_database)
 {
     Room *troom = NULL;
-    if(!zoneExists(zonename)) return NULL;
+    int zone_index = findZone(zonename);
+    if(zone_index == -1) return NULL;
+
+    // make sure zone's existing rooms are in memory first
+    if(!_LoadZone(zone_index)) return NULL;
 
     // create new room with next available room id
     // put reference in zone
     // return room
     m_RoomMutex.lock();
-    m_Rooms.push_back(Room());
-    troom = &m_Rooms.back();
+    troom = allocRoom();
     troom->room_id = m_NextAvailableRoomID;
     m_NextAvailableRoomID++;
-    troom->name = "no_name";
-    troom->description = "no_description";
+    troom->state.store(newRoomState("no_name", "no_description"), std::memory_order_relaxed);
 
     // add room to zone
     m_ZoneMutex.lock();
-    for(int i = 0; i < int(m_Zones.size()); i++)
-    {
-        if(m_Zones[i].name == zonename)
-        {
-            troom->zone = zonename;
-            for(int n = 0; n < DIR_COUNT; n++) troom->exits.push_back(0);
-            m_Zones[i].rooms.push_back(troom);
-            break;
-        }
-    }
+    m_ZoneNames.addRef(m_Zones[zone_index].name_id);
+    troom->zone = m_Zones[zone_index].name_id;
+    setRoomSlot(troom->room_id, troom);
+    m_Zones[zone_index].rooms.push_back(troom->room_id);
+    m_Zones[zone_index].last_access = m_Clock.getElapsedTime();
 
     // if saving to database
-    if(save_to_database) saveRoom(troom->room_id);
+    if(save_to_database) markRoomDirty(troom);
 
     m_ZoneMutex.unlock();
     m_RoomMutex.unlock();
 
-    if(troom->zone.empty())
-    {
-        std::cout << "ERROR creating room.  Target zone room not found after passing zone check!!\n";
-    }
-
     return troom;
 }
 
@@ -258,183 +842,570 @@ bool ZoneManager::linkRooms(int room_a, int room_b, int dir_index)
     }
 
     // get opposite room direction index
-    room_b_dir = getDirectionIndex(dirs[dir_index][1]);
-    if(room_b_dir == -1)
-    {
-        std::cout << link_error_ss.str() << "unable to determine opposite direction for dir_index " << dir_index << std::endl;
-        return false;
-    }
+    room_b_dir = dirs[dir_index].opposite;
+
+    m_RoomMutex.lock();
 
     // rooms exist?
-    if(!roomExists(room_a) || !roomExists(room_b))
+    Room *troom_a = getRoom(room_a);
+    Room *troom_b = getRoom(room_b);
+    if(!troom_a || !troom_b)
     {
         std::cout << link_error_ss.str() << "one of these rooms does not exist!\n";
+        m_RoomMutex.unlock();
         return false;
     }
 
     // check bi-directional availability
-    if(m_Rooms[room_a].exits[dir_index] || m_Rooms[room_b].exits[room_b_dir])
+    if(troom_a->state.load()->exits[dir_index] || troom_b->state.load()->exits[room_b_dir])
     {
         std::cout << link_error_ss.str() << "one of these rooms is already linked!\n";
+        m_RoomMutex.unlock();
         return false;
     }
 
     // link rooms
-    m_Rooms[room_a].exits[dir_index] = room_b;
-    m_Rooms[room_b].exits[room_b_dir] = room_a;
+    RoomState *state_a = copyRoomState(troom_a->state.load());
+    state_a->exits[dir_index] = room_b;
+    publishRoomState(troom_a, state_a);
+    RoomState *state_b = copyRoomState(troom_b->state.load());
+    state_b->exits[room_b_dir] = room_a;
+    publishRoomState(troom_b, state_b);
+    markRoomDirty(troom_a);
+    markRoomDirty(troom_b);
+    exitsChanged(troom_a, troom_b, dir_index);
+
+    m_RoomMutex.unlock();
     return true;
 }
 
-bool ZoneManager::_SaveRooms()
+// expects room mutex to be locked, troom_b is the room a new exit leads to (if any)
+void ZoneManager::exitsChanged(Room *troom_a, Room *troom_b, int dir_index)
 {
-    int error_count = 0;
+    // any cached routes may now be longer than necessary or blocked
+    m_PathFinder->invalidate();
+
+    if(!ROOM_COORDINATES) return;
+    // place new rooms on the zone map, this drops maps near both rooms as well
+    if(troom_b && dir_index != -1) m_WorldMap->roomsLinked(troom_a->room_id, troom_a->zone, troom_b->room_id, troom_b->zone, dir_index);
+    // exit removed, or a named exit or door changed, maps drawn around the room are out of date
+    else m_WorldMap->roomChanged(troom_a->room_id);
+}
+
+bool ZoneManager::setExit(int room_id, int dir_index, int to_room, int flags)
+{
+    if(dir_index < 0 || dir_index >= DIR_COUNT)
+    {
+        std::cout << "Error setting exit of room " << room_id << ": direction index " << dir_index << " is not a valid direction!\n";
+        return false;
+    }
+
     m_RoomMutex.lock();
-    // save all rooms
-    std::cout << "Saving all rooms...\n";
-    for(int i = 1; i < int(m_Rooms.size()); i++)
+
+    Room *troom = getRoom(room_id);
+    Room *troom_to = to_room ? getRoom(to_room) : NULL;
+    if(!troom || (to_room && !troom_to))
     {
-        if(!saveRoom(m_Rooms[i].room_id))
-        {
-            std::cout << "Error saving room id " << m_Rooms[i].room_id << std::endl;
-            error_count++;
-        }
+        std::cout << "Error setting exit of room " << room_id << ": room does not exist!\n";
+        m_RoomMutex.unlock();
+        return false;
     }
-    std::cout << "Done saving " << m_Rooms.size()-1 << " rooms with " << error_count << " errors.\n";
+
+    if(!to_room) flags = 0;
+    RoomState *state = copyRoomState(troom->state.load());
+    state->exits[dir_index] = to_room;
+    setSpecialExit(state, dir_index, "", to_room, flags);
+    publishRoomState(troom, state);
+    markRoomDirty(troom);
+    exitsChanged(troom, troom_to, dir_index);
+
     m_RoomMutex.unlock();
-    if(error_count) return false;
     return true;
 }
 
-bool ZoneManager::saveRoom(int room_id)
+bool ZoneManager::setNamedExit(int room_id, std::string name, int to_room, int flags)
 {
+    // named exits share the exits table with directions
+    if(name.empty() || getDirectionIndex(name) != -1)
+    {
+        std::cout << "Error setting exit of room " << room_id << ": '" << name << "' is not a valid exit name!\n";
+        return false;
+    }
 
-    if(room_id <= 0 || room_id > int(m_Rooms.size()) ) return false;
+    m_RoomMutex.lock();
 
-    Room *troom = &m_Rooms[room_id];
-    bool exists_in_db = false;
+    Room *troom = getRoom(room_id);
+    if(!troom || (to_room && !getRoom(to_room)))
+    {
+        std::cout << "Error setting exit of room " << room_id << ": room does not exist!\n";
+        m_RoomMutex.unlock();
+        return false;
+    }
 
-    // check if room exists in database
-    std::stringstream sss;
-    sqlite3_stmt *stmt;
-    sss << "SELECT * FROM rooms WHERE rowid = " << room_id << ";";
-    // compile sql statement to binary
-    int rc = sqlite3_prepare_v2(m_DB, sss.str().c_str(), -1, &stmt, NULL);
-    if( rc != SQLITE_OK)
+    RoomState *state = copyRoomState(troom->state.load());
+    setSpecialExit(state, -1, name, to_room, flags);
+    publishRoomState(troom, state);
+    markRoomDirty(troom);
+    exitsChanged(troom, NULL, -1);
+
+    m_RoomMutex.unlock();
+    return true;
+}
+
+bool ZoneManager::setDoorClosed(int room_id, int dir_index, bool closed)
+{
+    if(dir_index < 0 || dir_index >= DIR_COUNT) return false;
+
+    m_RoomMutex.lock();
+
+    Room *troom = getRoom(room_id);
+    const SpecialExit *texit = troom ? findSpecialExit(troom->state.load(), dir_index) : NULL;
+    if(!texit || !(texit->flags & EXIT_DOOR))
     {
-        std::cout << "Error in sql compile during load rooms:" << sqlite3_errmsg(m_DB) << std::endl;
-        sqlite3_finalize(stmt);
+        m_RoomMutex.unlock();
         return false;
     }
-    // execute sql statement
-    while((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+
+    // same door seen from both rooms
+    Room *rooms[2] = {troom, getRoom(texit->to_room)};
+    int room_dirs[2] = {dir_index, dirs[dir_index].opposite};
+    for(int i = 0; i < 2; i++)
     {
-        exists_in_db = true;
+        if(!rooms[i]) continue;
+        const RoomState *old_state = rooms[i]->state.load();
+        texit = findSpecialExit(old_state, room_dirs[i]);
+        if(!texit || !(texit->flags & EXIT_DOOR)) continue;
+        if(i && old_state->exits[room_dirs[i]] != room_id) continue;
+
+        int flags = closed ? (texit->flags | EXIT_CLOSED) : (texit->flags & ~EXIT_CLOSED);
+        if(flags == texit->flags) continue;
+        RoomState *state = copyRoomState(old_state);
+        setSpecialExit(state, room_dirs[i], "", state->exits[room_dirs[i]], flags);
+        publishRoomState(rooms[i], state);
+        markRoomDirty(rooms[i]);
     }
-    if(rc != SQLITE_DONE) {std::cout << "Error in sql during load rooms:" << sqlite3_errmsg(m_DB) << std::endl;}
-    sqlite3_finalize(stmt);
+    exitsChanged(troom, NULL, -1);
+
+    m_RoomMutex.unlock();
+    return true;
+}
 
-    // update database entry if it already exists in database
-    if( exists_in_db)
+// copy room's exits for storage
+void ZoneManager::_SaveExits(StoredRoom *stored, const RoomState *state)
+{
+    for(int i = 0; i < DIR_COUNT; i++)
     {
-        std::stringstream ss;
-        char *errormsg = 0;
-        ss << "UPDATE ";
-        ss << "rooms ";
-        ss << "SET ";
-        ss << "zone = '" << troom->zone << "',";
-        ss << "name = '" << troom->name << "',";
-        ss << "description = '" << troom->description << "',";
-        for(int i = 0; i < DIR_COUNT; i++)
-        {
-            ss << "exit_" << dirs[i][0] << " = " << troom->exits[i];
-            if(i < DIR_COUNT - 1) ss << ",";
-            else ss << " ";
-        }
-        ss << "WHERE ";
-        ss << "rowid = " << troom->room_id;
-        ss << ";";
-        if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
-        {
-            std::cout << "Error saving/updating room in sql:" << errormsg << std::endl;
-            sqlite3_free(errormsg);
-            return false;
-        }
-        return true;
+        if(!state->exits[i]) continue;
+        const SpecialExit *texit = findSpecialExit(state, i);
+        StoredExit sexit;
+        sexit.dir = dirs[i].name;
+        sexit.to_room = state->exits[i];
+        sexit.flags = texit ? texit->flags : 0;
+        stored->exits.push_back(sexit);
     }
-    // else create new entry in database
-    else
+    for(int i = 0; i < int(state->special_exits.size()); i++)
     {
-        std::stringstream ss;
-        char *errormsg = 0;
-        ss << "INSERT INTO ";
-        ss << "rooms(";
-        ss << "zone,";
-        ss << "name,";
-        ss << "description,";
-        for(int i = 0; i < DIR_COUNT; i++)
-        {
-            ss << "exit_" << dirs[i][0];
-            if(i < DIR_COUNT-1) ss << ",";
-        }
-        ss << ") ";
-        ss << "VALUES(";
-        ss << "'" << troom->zone << "',";
-        ss << "'" << troom->name << "',";
-        ss << "'" << troom->description << "',";
-        for(int i = 0; i < DIR_COUNT; i++)
-        {
-            ss << troom->exits[i];
-            if(i < DIR_COUNT-1) ss << ",";
-        }
-        ss << ");";
-        if(sqlite3_exec(m_DB, ss.str().c_str(), sqlcallback, NULL, &errormsg) != SQLITE_OK)
+        const SpecialExit &texit = state->special_exits[i];
+        if(texit.dir != -1) continue;
+        StoredExit sexit;
+        sexit.dir = texit.name;
+        sexit.to_room = texit.to_room;
+        sexit.flags = texit.flags;
+        stored->exits.push_back(sexit);
+    }
+}
+
+// copy of room for storage
+void ZoneManager::_StoreRoom(StoredRoom *stored, int room_id, int zone, const RoomState *state)
+{
+    stored->room_id = room_id;
+    stored->zone = m_ZoneNames.get(zone);
+    stored->name = m_RoomText.get(state->name);
+    stored->description = m_RoomText.get(state->description);
+    _SaveExits(stored, state);
+}
+
+// changed room taken for saving
+struct SavedRoom
+{
+    int room_id;
+    int zone;                   // zone name id
+    const RoomState *state;
+};
+
+// hand all changed rooms to storage as a single write
+// room states are never changed once published, so only the list of changed states is
+// taken under the room mutex, the states are copied out for storage after letting go of it
+bool ZoneManager::_SaveRooms(int *save_count, sf::Time *pause)
+{
+    std::vector<SavedRoom> saved;
+    std::vector<StoredRoom> rooms;
+
+    m_SaveMutex.lock();
+    m_Saving = true;
+    // states taken and the zone names they use are not freed before the guard goes
+    EpochGuard guard(&m_Epoch);
+
+    m_RoomMutex.lock();
+    sf::Clock pause_clock;
+    saved.reserve(m_DirtyRooms.size());
+    for(int i = 0; i < int(m_DirtyRooms.size()); i++)
+    {
+        Room *troom = getRoomSlot(m_DirtyRooms[i]);
+        if(!troom) continue;
+
+        SavedRoom tsaved;
+        tsaved.room_id = troom->room_id;
+        tsaved.zone = troom->zone;
+        tsaved.state = troom->state.load(std::memory_order_acquire);
+        saved.push_back(tsaved);
+        troom->dirty = false;
+    }
+    m_DirtyRooms.clear();
+    sf::Time pause_time = pause_clock.getElapsedTime();
+    m_RoomMutex.unlock();
+
+    rooms.resize(saved.size());
+    for(int i = 0; i < int(saved.size()); i++)
+    {
+        _StoreRoom(&rooms[i], saved[i].room_id, saved[i].zone, saved[i].state);
+    }
+    bool saved_ok = true;
+    if(!rooms.empty())
+    {
+        long long mark = m_Storage->writeMark();
+        m_Storage->saveRooms(rooms);
+        saved_ok = m_Storage->flush(mark);
+    }
+
+    // rooms changed since are dirty again already, the rest go back in the list for the next save
+    if(!saved_ok)
+    {
+        std::cout << "Error saving " << rooms.size() << " rooms, kept for the next save.\n";
+        m_RoomMutex.lock();
+        for(int i = 0; i < int(saved.size()); i++)
         {
-            std::cout << "Error inserting new room in sql:" << errormsg << std::endl;
-            sqlite3_free(errormsg);
-            return false;
+            Room *troom = getRoomSlot(saved[i].room_id);
+            if(!troom || troom->dirty) continue;
+            troom->dirty = true;
+            m_DirtyRooms.push_back(troom->room_id);
         }
-        return true;
+        m_RoomMutex.unlock();
     }
 
-    return false;
+    m_Saving = false;
+    m_SaveMutex.unlock();
+
+    if(save_count) *save_count = saved_ok ? int(rooms.size()) : 0;
+    if(pause) *pause = pause_time;
+    return saved_ok;
+}
+
+bool ZoneManager::saveRoom(int room_id)
+{
+    if(room_id <= 0 || room_id >= getRoomCount()) return false;
+
+    // rooms that are not loaded are already up to date in storage
+    m_RoomMutex.lock();
+    Room *troom = getRoomSlot(room_id);
+    if(troom) markRoomDirty(troom);
+    m_RoomMutex.unlock();
+    return true;
 }
 
 bool ZoneManager::roomExists(int room_id)
 {
-    return (room_id > 0 && room_id < int(m_Rooms.size()) );
+    EpochGuard guard(&m_Epoch);
+    return getRoom(room_id) != NULL;
+}
+
+void ZoneManager::touchRoom(int room_id)
+{
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoomSlot(room_id);
+    if(troom) touchZone(troom);
 }
 
 std::vector<std::string> ZoneManager::getExits(int room_id)
 {
     std::vector<std::string> exits;
-    if(!roomExists(room_id)) return exits;
-
-    Room *troom = &m_Rooms[room_id];
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return exits;
 
+    const RoomState *state = troom->state.load(std::memory_order_acquire);
     for(int i = 0; i < DIR_COUNT; i++)
     {
-        if(troom->exits[i] != 0) exits.push_back(dirs[i][0]);
+        if(state->exits[i] == 0) continue;
+        const SpecialExit *texit = findSpecialExit(state, i);
+        if(texit && (texit->flags & EXIT_HIDDEN)) continue;
+        exits.push_back(dirs[i].name);
+    }
+    for(int i = 0; i < int(state->special_exits.size()); i++)
+    {
+        const SpecialExit &texit = state->special_exits[i];
+        if(texit.dir == -1 && !(texit.flags & EXIT_HIDDEN)) exits.push_back(texit.name);
     }
 
     return exits;
 }
 
+RoomLook *ZoneManager::renderRoomLook(const RoomState *state)
+{
+    RoomLook *look = new RoomLook;
+
+    look->header = m_RoomText.get(state->name);
+    look->header += "\n";
+    look->header += m_RoomText.get(state->description);
+    look->header += "\n\n";
+
+    look->exits = "[ ";
+    bool first = true;
+    for(int i = 0; i < DIR_COUNT; i++)
+    {
+        if(state->exits[i] == 0) continue;
+        const SpecialExit *texit = findSpecialExit(state, i);
+        if(texit && (texit->flags & EXIT_HIDDEN)) continue;
+        if(!first) look->exits += " - ";
+        look->exits += dirs[i].name;
+        if(texit && (texit->flags & EXIT_CLOSED)) look->exits += " (closed)";
+        first = false;
+    }
+    for(int i = 0; i < int(state->special_exits.size()); i++)
+    {
+        const SpecialExit &texit = state->special_exits[i];
+        if(texit.dir != -1 || (texit.flags & EXIT_HIDDEN)) continue;
+        if(!first) look->exits += " - ";
+        look->exits += texit.name;
+        if(texit.flags & EXIT_CLOSED) look->exits += " (closed)";
+        first = false;
+    }
+    if(first) look->exits += "No obvious exits";
+    look->exits += " ]\n";
+
+    return look;
+}
+
+bool ZoneManager::getRoomLook(int room_id, std::string *header, std::string *exits)
+{
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return false;
+
+    const RoomState *state = troom->state.load(std::memory_order_acquire);
+    const RoomLook *look = state->look.load(std::memory_order_acquire);
+    if(!look)
+    {
+        RoomLook *rendered = renderRoomLook(state);
+        if(!ROOM_LOOK_CACHE)
+        {
+            header->append(rendered->header);
+            exits->append(rendered->exits);
+            delete rendered;
+            return true;
+        }
+
+        // readers may race to render the same state, first one in is kept
+        const RoomLook *expected = NULL;
+        if(state->look.compare_exchange_strong(expected, rendered, std::memory_order_acq_rel)) look = rendered;
+        else
+        {
+            delete rendered;
+            look = expected;
+        }
+    }
+
+    header->append(look->header);
+    exits->append(look->exits);
+    return true;
+}
+
+// direction exit (dir_index != -1) or named exit, NULL if room has no such special exit
+const SpecialExit *ZoneManager::findSpecialExit(const RoomState *state, int dir_index, const std::string &name)
+{
+    for(int i = 0; i < int(state->special_exits.size()); i++)
+    {
+        const SpecialExit &texit = state->special_exits[i];
+        if(texit.dir != dir_index) continue;
+        if(dir_index != -1 || texit.name == name) return &texit;
+    }
+    return NULL;
+}
+
+// add, change or remove special exit of unpublished state
+// direction exits without flags and exits leading nowhere are removed
+void ZoneManager::setSpecialExit(RoomState *state, int dir_index, const std::string &name, int to_room, int flags)
+{
+    SpecialExit *texit = const_cast<SpecialExit*>(findSpecialExit(state, dir_index, name));
+    if(!to_room || (dir_index != -1 && !flags))
+    {
+        if(texit) state->special_exits.erase(state->special_exits.begin() + (texit - &state->special_exits[0]));
+        return;
+    }
+    if(!texit)
+    {
+        state->special_exits.push_back(SpecialExit());
+        texit = &state->special_exits.back();
+        texit->dir = dir_index;
+        texit->name = name;
+    }
+    texit->to_room = to_room;
+    texit->flags = flags;
+}
+
+int ZoneManager::getExitFlags(int room_id, int dir_index)
+{
+    if(dir_index < 0 || dir_index >= DIR_COUNT) return 0;
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return 0;
+    const SpecialExit *texit = findSpecialExit(troom->state.load(std::memory_order_acquire), dir_index);
+    if(!texit) return 0;
+    return texit->flags;
+}
+
+int ZoneManager::getNamedExit(int room_id, std::string name, int *flags)
+{
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return 0;
+    const SpecialExit *texit = findSpecialExit(troom->state.load(std::memory_order_acquire), -1, name);
+    if(!texit) return 0;
+    if(flags) *flags = texit->flags;
+    return texit->to_room;
+}
+
+bool ZoneManager::getOpenExits(int room_id, std::vector<SpecialExit> *exits)
+{
+    exits->clear();
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return false;
+
+    const RoomState *state = troom->state.load(std::memory_order_acquire);
+    for(int i = 0; i < DIR_COUNT; i++)
+    {
+        if(!state->exits[i]) continue;
+        const SpecialExit *texit = findSpecialExit(state, i);
+        if(texit && (texit->flags & EXIT_CLOSED)) continue;
+
+        exits->push_back(SpecialExit());
+        exits->back().dir = i;
+        exits->back().to_room = state->exits[i];
+        exits->back().flags = texit ? texit->flags : 0;
+    }
+    for(int i = 0; i < int(state->special_exits.size()); i++)
+    {
+        const SpecialExit &texit = state->special_exits[i];
+        if(texit.dir == -1 && texit.to_room && !(texit.flags & EXIT_CLOSED)) exits->push_back(texit);
+    }
+    return true;
+}
+
 int ZoneManager::getRoomNumInDirection(int room_id, int dir_index)
 {
     if(dir_index < 0 || dir_index >= DIR_COUNT) return 0;
-    if(room_id < 1 || room_id >= int(m_Rooms.size()) ) return 0;
-    return m_Rooms[room_id].exits[dir_index];
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return 0;
+    return troom->state.load(std::memory_order_acquire)->exits[dir_index];
 
 }
 
 std::string ZoneManager::getRoomName(int room_id)
 {
-    if(!roomExists(room_id)) return "";
-    return m_Rooms[room_id].name;
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return "";
+    return m_RoomText.get(troom->state.load(std::memory_order_acquire)->name);
 }
 
 std::string ZoneManager::getRoomDescription(int room_id)
 {
-    if(!roomExists(room_id)) return "";
-    return m_Rooms[room_id].description;
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return "";
+    return m_RoomText.get(troom->state.load(std::memory_order_acquire)->description);
+}
+
+std::string ZoneManager::getRoomZone(int room_id)
+{
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return "";
+    return m_ZoneNames.get(troom->zone);
+}
+
+int ZoneManager::getRoomZoneID(int room_id)
+{
+    EpochGuard guard(&m_Epoch);
+    Room *troom = getRoom(room_id);
+    if(!troom) return 0;
+    return troom->zone;
+}
+
+bool ZoneManager::setRoomName(int room_id, std::string name)
+{
+    m_RoomMutex.lock();
+    Room *troom = getRoom(room_id);
+    if(!troom)
+    {
+        m_RoomMutex.unlock();
+        return false;
+    }
+    RoomState *state = copyRoomState(troom->state.load());
+    state->name = m_RoomText.replace(state->name, name);
+    publishRoomState(troom, state);
+    markRoomDirty(troom);
+    m_RoomMutex.unlock();
+    return true;
+}
+
+bool ZoneManager::setRoomDescription(int room_id, std::string description)
+{
+    m_RoomMutex.lock();
+    Room *troom = getRoom(room_id);
+    if(!troom)
+    {
+        m_RoomMutex.unlock();
+        return false;
+    }
+    RoomState *state = copyRoomState(troom->state.load());
+    state->description = m_RoomText.replace(state->description, description);
+    publishRoomState(troom, state);
+    markRoomDirty(troom);
+    m_RoomMutex.unlock();
+    return true;
+}
+
+// each search has scratch space of its own, cached routes are shared
+bool ZoneManager::findPath(int from_room, int to_room, std::vector<std::string> *route)
+{
+    return m_PathFinder->findPath(from_room, to_room, route);
+}
+
+std::string ZoneManager::getNextStep(int from_room, int to_room)
+{
+    return m_PathFinder->getNextStep(from_room, to_room);
+}
+
+bool ZoneManager::getRoomPosition(int room_id, int *x, int *y)
+{
+    if(!ROOM_COORDINATES) return false;
+
+    m_RoomMutex.lock();
+    bool found = getRoom(room_id) && m_WorldMap->getPosition(room_id, x, y);
+    m_RoomMutex.unlock();
+    return found;
+}
+
+std::string ZoneManager::getMap(int room_id, int radius)
+{
+    if(!ROOM_COORDINATES) return "";
+
+    m_RoomMutex.lock();
+    std::string map;
+    if(getRoom(room_id)) map = m_WorldMap->getMap(room_id, radius);
+    m_RoomMutex.unlock();
+    return map;
 }